@@ -108,6 +108,33 @@ public:
   /// \return The UTF-32 character at the specified offset.
   char32_t operator[](size_t index) const;
 
+  /// Walks the rope's storage in order, one node at a time, without copying.
+  /// Any change to the rope invalidates the iterator.
+  class chunk_iterator {
+  public:
+    chunk_iterator() noexcept : _node{nullptr} {}
+
+    /// \return The bytes stored in the current node. May be empty.
+    std::string_view operator*() const;
+    chunk_iterator &operator++();
+
+    bool operator==(const chunk_iterator &other) const {
+      return _node == other._node;
+    }
+
+  private:
+    friend class Rope;
+    explicit chunk_iterator(const void *node) noexcept : _node{node} {}
+
+    const void *_node;
+  };
+
+  /// \return An iterator to the first storage chunk.
+  chunk_iterator chunks_begin() const;
+
+  /// \return The past-the-end chunk iterator.
+  chunk_iterator chunks_end() const { return chunk_iterator{}; }
+
 private:
   c_rope_t *_c_rope;
 };
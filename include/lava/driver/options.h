@@ -40,6 +40,7 @@ enum class CliOpt : unsigned {
   Eval,
   Interactive,
   LSPServer,
+  CacheDir,
 };
 
 // Driver program options.
@@ -53,6 +54,10 @@ struct Options {
   // Source passed to `-e` or `--eval`.
   std::string eval_source;
 
+  // Directory passed to `--cache-dir`; empty if parse results should not be
+  // cached.
+  std::filesystem::path cache_dir;
+
   uint32_t    wants_help   : 1; // Did we see `-h`?
   uint32_t    wants_stdin  : 1; // Did we see `-`?
   OptBool     wants_color  : 2; // `true`/`false`/`auto`.
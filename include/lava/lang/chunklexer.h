@@ -0,0 +1,74 @@
+#ifndef LAVA_LANG_CHUNKLEXER_H_
+#define LAVA_LANG_CHUNKLEXER_H_
+
+#include "lexer.h"
+#include "lava/data/rope.h"
+
+namespace lava::lang {
+
+// A source of document text in order, one chunk at a time.
+struct ChunkReader {
+  virtual ~ChunkReader() = 0;
+
+  // Returns the next chunk, or an empty view at the end of the input. The
+  // returned bytes must stay valid until the lexer is done with them.
+  virtual std::string_view next_chunk() = 0;
+};
+
+// Reads a rope's nodes in place.
+struct RopeChunkReader : ChunkReader {
+private:
+  data::Rope::chunk_iterator _it;
+  data::Rope::chunk_iterator _end;
+
+public:
+  explicit RopeChunkReader(const data::Rope &rope) noexcept
+    : _it{rope.chunks_begin()}
+    , _end{rope.chunks_end()}
+  {}
+
+  std::string_view next_chunk() override;
+};
+
+// Lexes text supplied as a sequence of chunks. Tokens are lexed in place in
+// each chunk; a token that may run into the next chunk is copied into a
+// scratch buffer together with the following chunk(s) and lexed again.
+//
+// The document passed in only provides the name; its content is not read.
+// Since tokens may not point into it, use `text()` instead of `Token::text`.
+struct ChunkLexer {
+private:
+  const SourceDoc *_doc;
+  ChunkReader *_reader;
+  unsigned _flags;
+
+  // The text tokens are currently lexed from: either `_chunk` or
+  // `_scratch`, starting at document offset `_window_base`.
+  std::string_view _window;
+  size_t _window_base;
+
+  // The most recent chunk from the reader.
+  std::string_view _chunk;
+  size_t _chunk_base;
+  bool _done;
+
+  std::string _scratch;
+  SourceLoc _loc;
+  std::string_view _text;
+
+public:
+  ChunkLexer(const SourceDoc &doc, ChunkReader &reader,
+             unsigned flags = 0) noexcept;
+
+  Token lex();
+
+  // The text of the last token. Valid until the next call to `lex`.
+  std::string_view text() const { return _text; }
+
+private:
+  bool next_chunk();
+};
+
+} // namespace lava::lang
+
+#endif // LAVA_LANG_CHUNKLEXER_H_
@@ -0,0 +1,97 @@
+#ifndef LAVA_LANG_DIAGNOSTICS_H_
+#define LAVA_LANG_DIAGNOSTICS_H_
+
+#include "token.h"
+#include "lava/data/arena.h"
+#include <climits>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lava::lang {
+
+enum class Severity : uint8_t {
+  Error,
+  Warning,
+  Note,
+};
+
+struct Diagnostic {
+  static constexpr int NoToken = INT_MIN;
+
+  const SourceDoc *doc;
+  // Byte range in `doc`.
+  uint32_t start;
+  uint32_t end;
+  Severity severity;
+  // The kind of the token that was found, or NoToken.
+  int found;
+  // Owned by the Diagnostics that holds this.
+  std::string_view message;
+};
+
+// Collects diagnostics while parsing, so that reporting costs a few stores
+// instead of a write to stderr. Messages are copied into an arena along with
+// the list itself; nothing is formatted until asked.
+struct Diagnostics {
+private:
+  struct Arena {
+    lava_arena arena;
+    Arena() { lava_arena_init(&arena); }
+    ~Arena() { lava_arena_fini(&arena); }
+  };
+
+  // Declared first so it outlives `_diags`.
+  Arena _arena;
+  std::vector<Diagnostic, data::arena_allocator<Diagnostic>> _diags;
+  size_t _error_count = 0;
+  size_t _suppressed = 0;
+  // The range of the last error that was kept.
+  const SourceDoc *_last_doc = nullptr;
+  uint32_t _last_start = 0;
+  uint32_t _last_end = 0;
+
+public:
+  Diagnostics()
+    : _diags{data::arena_allocator<Diagnostic>{&_arena.arena}}
+  {}
+
+  Diagnostics(const Diagnostics&) = delete;
+  Diagnostics &operator=(const Diagnostics&) = delete;
+
+  // Adds a diagnostic and returns true, or returns false if it cascades
+  // from the last error: an error that starts where the previous one did,
+  // or inside it, is almost always the parser recovering from it.
+  bool report(Severity severity, const SourceDoc &doc, size_t start,
+              size_t end, std::string_view message,
+              int found = Diagnostic::NoToken);
+
+  // Reports an error at `token`.
+  bool error(const Token &token, std::string_view message) {
+    return report(Severity::Error, *token.doc, token.start.offset,
+                  token.end.offset, message, token.what);
+  }
+
+  size_t size() const { return _diags.size(); }
+  bool empty() const { return _diags.empty(); }
+  const Diagnostic &operator[](size_t i) const { return _diags[i]; }
+  auto begin() const { return _diags.begin(); }
+  auto end() const { return _diags.end(); }
+
+  size_t error_count() const { return _error_count; }
+  // How many cascading errors were dropped.
+  size_t suppressed() const { return _suppressed; }
+
+  // Formats diagnostics `[first, size())` as
+  // "file:line:column: severity: message (found Token)" lines.
+  void format(std::string &out, size_t first = 0) const;
+
+  // Formats diagnostics `[first, size())` and writes them in one call.
+  // Returns the number of diagnostics written.
+  size_t print(FILE *file, size_t first = 0) const;
+};
+
+} // namespace lava::lang
+
+#endif /* LAVA_LANG_DIAGNOSTICS_H_ */
@@ -6,30 +6,51 @@
 
 namespace lava::lang {
 
-struct FirstPass : NodeVisitor {
+struct FirstPass : StaticVisitor<FirstPass> {
   SymbolTable *_symtab;
   Namespace *_current_ns;
 
   FirstPass(SymbolTable &symtab);
 
+  using StaticVisitor::visit;
+
   const FunctionType &get_function_type(const FunItemBase &item);
-  void visit(const FunDeclItem &item) override;
-  void visit(const FunDefItem &item) override;
+  void visit(const FunDeclItem &item);
+  void visit(const FunDefItem &item);
+
+  // For a changed item: puts a new function in place of the old one with
+  // the same name, leaving every other symbol alone. If the type changed,
+  // the IR of the functions that read the name is cleared and they are
+  // returned; the caller emits them again along with the new function.
+  std::vector<Function*> replace(const FunItemBase &item);
+
+  // For a deleted item: removes its function and, like `replace`, returns
+  // the functions whose IR read it.
+  std::vector<Function*> remove(InternString name);
+
+private:
+  std::vector<Function*> invalidate_users(InternString name);
 };
 
-struct TypeVisitor : NodeVisitor {
+struct TypeVisitor : StaticVisitor<TypeVisitor> {
   SymbolTable *_symtab;
   Namespace *_current_ns;
+  // Set after the first part of a qualified name, which is looked up
+  // through the scope chain; later parts are looked up in `_current_ns`.
+  bool _qualified;
   const Type *type;
 
   TypeVisitor(SymbolTable &symtab, Namespace &current_ns)
     : _symtab{&symtab}
     , _current_ns{&current_ns}
+    , _qualified{false}
     , type{nullptr}
   {}
 
-  void visit(const IdentExpr &ident) override;
-  void visit(const BinaryExpr &binary) override;
+  using StaticVisitor::visit;
+
+  void visit(const IdentExpr &ident);
+  void visit(const BinaryExpr &binary);
 };
 
 } // namespace lava::lang
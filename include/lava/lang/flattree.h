@@ -0,0 +1,150 @@
+#ifndef LAVA_LANG_FLATTREE_H_
+#define LAVA_LANG_FLATTREE_H_
+
+#include "nodes.h"
+#include <cstdint>
+#include <span>
+
+namespace lava::lang {
+
+enum class FlatKind : uint8_t {
+  Document,
+  Literal,
+  Ident,
+  Prefix,
+  Postfix,
+  Binary,
+  Paren,
+  Invoke,
+  Scope,
+  Return,
+  If,
+  Else,
+  While,
+  Loop,
+  BreakContinue,
+  EmptyItem,
+  ExprItem,
+  VarDeclItem,
+  VarDecl,
+  FunDeclItem,
+  FunDefItem,
+  ArgDecl,
+  StructDefItem,
+};
+
+// A syntax tree stored as one array of nodes in pre-order, so a walk over
+// the whole tree is a linear scan and the tree can be copied or written out
+// as plain data. Each node has a run of 32-bit references: first the tokens
+// it was built from, as indices into a TokenBuffer, then its children, as
+// node indices. Optional tokens and children are `None`.
+//
+// The layout for each kind is (tokens; children), with `n` repeated
+// delimiters or children and `?` marking optional ones:
+//
+//   Document      (; item*n)
+//   Literal       (token; ) followed by the value as two words
+//   Ident         (token; )
+//   Prefix        (op; expr)
+//   Postfix       (op; expr)
+//   Binary        (op; left, right)
+//   Paren         (lparen, rparen; expr)
+//   Invoke        (lparen, rparen, delimiter*n; expr, arg*n)
+//   Scope         (lbrace, rbrace, delimiter*n; expr*n)
+//   Return        (return; expr?)
+//   If            (if; expr, scope, else*n)
+//   Else          (else, if?; expr?, scope)
+//   While         (while; expr, scope)
+//   Loop          (loop; scope)
+//   BreakContinue (token; expr?)
+//   EmptyItem     (semi; )
+//   ExprItem      (semi; expr)
+//   VarDeclItem   (semi, delimiter*n; type, decl*n)
+//   VarDecl       (name, eq?; init?)
+//   FunDeclItem   (fun, name, lparen, rparen, arrow?, semi, delimiter*n;
+//                  arg*n, return?)
+//   FunDefItem    (fun, name, lparen, rparen, arrow?, delimiter*n;
+//                  arg*n, return?, body)
+//   ArgDecl       (name, eq?; type, init?)
+//   StructDefItem (keyword, name, lbrace, rbrace; var*n)
+struct FlatTree {
+  static constexpr uint32_t None = UINT32_MAX;
+
+  struct Node {
+    FlatKind kind;
+    // The LiteralType for a literal.
+    uint8_t literal_type;
+    uint32_t refs;
+    uint32_t token_count;
+    uint32_t child_count;
+    // One past the last node in this subtree.
+    uint32_t end;
+  };
+
+private:
+  const TokenBuffer *_tokens;
+  std::vector<Node> _nodes;
+  std::vector<uint32_t> _refs;
+
+public:
+  // Flattens `doc`, which must have been parsed from `tokens`. Skipped
+  // function bodies are parsed into the tree but not into `doc`; throws
+  // ParseError if one is invalid.
+  explicit FlatTree(const Document &doc, const TokenBuffer &tokens);
+
+  const TokenBuffer &tokens() const { return *_tokens; }
+
+  // Node 0 is the document.
+  size_t size() const { return _nodes.size(); }
+  const Node &node(uint32_t n) const { return _nodes[n]; }
+  FlatKind kind(uint32_t n) const { return _nodes[n].kind; }
+
+  std::span<const uint32_t> token_refs(uint32_t n) const {
+    return {_refs.data() + _nodes[n].refs, _nodes[n].token_count};
+  }
+
+  std::span<const uint32_t> children(uint32_t n) const {
+    const Node &node = _nodes[n];
+    return {_refs.data() + node.refs + node.token_count, node.child_count};
+  }
+
+  // Builds the `i`th token of node `n`, or an empty token for `None`.
+  Token token(uint32_t n, size_t i) const;
+
+  // The raw bits of a literal's value.
+  uint64_t literal_bits(uint32_t n) const;
+
+  // Rebuilds the pointer-based tree, for passes written against `Node`.
+  std::unique_ptr<Document> expand() const;
+
+private:
+  friend struct ParseCache;
+
+  FlatTree(const TokenBuffer &tokens, std::vector<Node> nodes,
+           std::vector<uint32_t> refs)
+    : _tokens{&tokens}
+    , _nodes{std::move(nodes)}
+    , _refs{std::move(refs)}
+  {}
+
+  uint32_t add(FlatKind kind, size_t token_count, size_t child_count);
+  void set_token(uint32_t n, size_t i, const Token &token);
+  void set_child(uint32_t n, size_t i, uint32_t child);
+  void finish(uint32_t n) { _nodes[n].end = (uint32_t)_nodes.size(); }
+
+  uint32_t flatten(const Expr *expr);
+  uint32_t flatten(const ScopeExpr &scope);
+  uint32_t flatten(const Item &item);
+  uint32_t flatten(const VarDeclItem &item);
+
+  std::unique_ptr<Expr> expand_expr(uint32_t n) const;
+  ScopeExpr expand_scope(uint32_t n) const;
+  std::unique_ptr<Item> expand_item(uint32_t n) const;
+  VarDeclItem expand_var_decl_item(uint32_t n) const;
+  std::optional<VarInit> expand_init(uint32_t n, size_t eq,
+                                     uint32_t init) const;
+};
+
+} // namespace lava::lang
+
+#endif // LAVA_LANG_FLATTREE_H_
@@ -75,13 +75,13 @@ struct LdF64Args {
 
 struct LdStrArgs {
   unsigned dest;
-  unsigned offset;
+  unsigned index;
   unsigned size;
 };
 
 struct LdVarArgs {
   unsigned dest;
-  unsigned offset;
+  unsigned index;
   unsigned size;
 };
 
@@ -153,6 +153,9 @@ struct Instruction {
 
 std::string instr_to_string(const Instruction &instr);
 
+// Compares the op and the operands it uses.
+bool operator==(const Instruction &a, const Instruction &b);
+
 } // namespace lava::lang
 
 #endif /* LAVA_LANG_INSTR_H_ */
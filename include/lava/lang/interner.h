@@ -0,0 +1,175 @@
+#ifndef LAVA_LANG_INTERNER_H_
+#define LAVA_LANG_INTERNER_H_
+
+#include "lava/data/arena.h"
+#include <boost/container_hash/hash.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace lava::lang {
+
+struct InternString {
+  // Position of the string in its interner.
+  size_t index;
+  size_t size;
+
+  InternString() noexcept : index{0}, size{0} {}
+  InternString(size_t index, size_t size) noexcept
+    : index{index}, size{size}
+  {}
+  InternString(const InternString&) = default;
+  InternString &operator=(const InternString&) = default;
+
+  bool operator==(const InternString &other) const {
+    return index == other.index && size == other.size;
+  }
+
+  operator bool() const { return size != 0; }
+
+  size_t hash() const {
+    size_t hash = 0;
+    boost::hash_combine(hash, index);
+    boost::hash_combine(hash, size);
+    return hash;
+  }
+};
+
+// Deduplicates strings. The bytes are copied into arena chunks that are
+// never moved or freed until the interner is destroyed, so views returned
+// by `get` stay valid across later interning. Lookup uses an open
+// addressing table that keeps each string's hash next to its index, so
+// probing only touches the bytes of a string whose hash already matches.
+struct StringInterner {
+private:
+  struct Arena {
+    lava_arena arena;
+    Arena() { lava_arena_init(&arena); }
+    ~Arena() { lava_arena_fini(&arena); }
+  };
+
+  struct Entry {
+    const char *data;
+    size_t size;
+  };
+
+  struct Slot {
+    uint64_t hash;
+    // Index into `_entries` plus one; zero marks an empty slot.
+    uint32_t entry;
+  };
+
+  Arena _arena;
+  std::vector<Entry> _entries;
+  std::vector<Slot> _slots;
+
+  // Returns the slot holding `str`, or the empty slot where it belongs.
+  const Slot &probe(std::string_view str, uint64_t hash) const;
+  void grow();
+
+public:
+  StringInterner();
+
+  StringInterner(const StringInterner&) = delete;
+  StringInterner &operator=(const StringInterner&) = delete;
+
+  InternString intern(std::string_view str);
+
+  // Returns the interned string equal to `str`, or an empty InternString if
+  // there isn't one.
+  InternString find(std::string_view str) const;
+
+  std::string_view get(InternString str) const {
+    auto const &entry = _entries[str.index];
+    return {entry.data, entry.size};
+  }
+
+  // The number of distinct strings.
+  size_t size() const { return _entries.size(); }
+};
+
+// A StringInterner that can be shared between threads. Strings are split
+// into shards by hash, each with its own lock, table and arena. Looking up
+// a string that is already interned never takes a lock: tables are only
+// ever replaced, never changed in place, except for filling empty slots,
+// and replaced tables are kept alive until the interner is destroyed.
+//
+// Indices are sparse: the low bits name the shard.
+struct ConcurrentStringInterner {
+  static constexpr unsigned ShardBits = 6;
+  static constexpr size_t Shards = size_t{1} << ShardBits;
+
+private:
+  struct Entry {
+    const char *data;
+    size_t size;
+  };
+
+  struct Slot {
+    std::atomic<uint64_t> hash;
+    // Index into the shard's entries plus one; zero marks an empty slot.
+    // Stored last, with release, so a reader that sees it sees the rest.
+    std::atomic<uint32_t> entry;
+  };
+
+  struct Table {
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+    // The table this one replaced, which readers may still be probing.
+    std::unique_ptr<Table> previous;
+
+    explicit Table(size_t size);
+  };
+
+  // Entries live in segments that double in size, so they never move.
+  static constexpr size_t FirstSegment = 64;
+  static constexpr size_t Segments = 26;
+
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    std::atomic<Table*> table{nullptr};
+    std::unique_ptr<Table> owned_table;
+    std::atomic<Entry*> segments[Segments] = {};
+    std::atomic<uint32_t> count{0};
+    lava_arena arena;
+
+    Shard();
+    ~Shard();
+
+    const Entry &entry(uint32_t index) const;
+  };
+
+  std::unique_ptr<Shard[]> _shards;
+
+  static uint32_t lookup(const Shard &shard, std::string_view str,
+                         uint64_t hash);
+  uint32_t insert(Shard &shard, std::string_view str, uint64_t hash);
+
+public:
+  ConcurrentStringInterner();
+  ~ConcurrentStringInterner();
+
+  ConcurrentStringInterner(const ConcurrentStringInterner&) = delete;
+  ConcurrentStringInterner &
+  operator=(const ConcurrentStringInterner&) = delete;
+
+  InternString intern(std::string_view str);
+  InternString find(std::string_view str) const;
+
+  // `str` must have been returned by this interner, and passed to this
+  // thread through some synchronization if it came from another.
+  std::string_view get(InternString str) const {
+    auto const &entry = _shards[str.index & (Shards - 1)]
+      .entry((uint32_t)(str.index >> ShardBits));
+    return {entry.data, entry.size};
+  }
+
+  size_t size() const;
+};
+
+} // namespace lava::lang
+
+#endif /* LAVA_LANG_INTERNER_H_ */
@@ -3,37 +3,63 @@
 
 #include "lava/lang/nodes.h"
 #include "visitor.h"
+#include "walker.h"
 #include "symbol.h"
 
 namespace lava::lang {
 
-struct IREmitter : NodeVisitor {
+// Items are visited recursively; expressions are walked with an explicit
+// stack so deeply nested code can't overflow the call stack.
+struct IREmitter : StaticVisitor<IREmitter>, ExprWalker<IREmitter> {
   SymbolTable *_symtab;
   Namespace *_current_ns;
   Function *_current_fn = nullptr;
+  // Where the names read by `_current_fn` are recorded, if anywhere.
+  DependencyGraph *_deps = nullptr;
   BasicBlock _current_bb;
   unsigned _current_reg = 0;
   unsigned _current_continue = 0;
+  // Values an expression needs after its children are emitted, such as a
+  // binary operator's left register or a loop's start block.
+  std::vector<unsigned> _saved;
 
   IREmitter(SymbolTable &symtab);
 
-  void visit(const LiteralExpr &expr) override;
-  void visit(const IdentExpr &expr) override;
-  void visit(const PrefixExpr &expr) override;
-  void visit(const PostfixExpr &expr) override;
-  void visit(const BinaryExpr &expr) override;
-  void visit(const InvokeExpr &expr) override;
-  void visit(const ScopeExpr &expr) override;
-  void visit(const ReturnExpr &expr) override;
-  void visit(const IfExpr &expr) override;
-  void visit(const WhileExpr &expr) override;
-  void visit(const LoopExpr &expr) override;
-  void visit(const BreakContinueExpr &expr) override;
+  using StaticVisitor::visit;
+  using ExprWalker::pre_visit;
+  using ExprWalker::in_visit;
+  using ExprWalker::post_visit;
 
+  void visit(const Expr &expr) { walk(expr); }
+  void visit(const ScopeExpr &expr) { walk(expr); }
+
+  void post_visit(const LiteralExpr &expr);
+  void post_visit(const IdentExpr &expr);
+  void post_visit(const PrefixExpr &expr);
+  void post_visit(const PostfixExpr &expr);
+  void in_visit(const BinaryExpr &expr, size_t slot);
+  void post_visit(const BinaryExpr &expr);
+  void in_visit(const InvokeExpr &expr, size_t slot);
+  void post_visit(const InvokeExpr &expr);
+  void post_visit(const ReturnExpr &expr);
+  void in_visit(const IfExpr &expr, size_t slot);
+  void post_visit(const IfExpr &expr);
+  bool pre_visit(const WhileExpr &expr);
+  void in_visit(const WhileExpr &expr, size_t slot);
+  void post_visit(const WhileExpr &expr);
+  bool pre_visit(const LoopExpr &expr);
+  void post_visit(const LoopExpr &expr);
+  bool pre_visit(const BreakContinueExpr &expr);
+  void post_visit(const BreakContinueExpr &expr);
+
+  void push_basicblock();
   void fix_breaks(unsigned from, unsigned to);
   bool simplify_jumps();
 
-  void visit(const FunDefItem &item) override;
+  void visit(const FunDefItem &item);
+
+  // Emits `item`'s body into `fn`, which need not be in any namespace.
+  void emit(const FunDefItem &item, Function &fn);
 };
 
 } // namespace lava::lang
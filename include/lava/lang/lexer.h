@@ -8,11 +8,36 @@ namespace lava::lang {
 struct Lexer {
 private:
   const SourceDoc *doc;
+  // The bytes being lexed, starting at document offset `base`.
   std::string_view text;
+  size_t base;
   SourceLoc loc;
+  bool track_lines;
 
 public:
-  explicit Lexer(const SourceDoc &doc) noexcept;
+  // The lexer never looks at more than this many bytes past the end of the
+  // token it returns.
+  static constexpr size_t MaxLookahead = 2;
+
+  enum Flags {
+    // Record only offsets in token locations; line and column are left at 0
+    // and can be filled in later with `SourceDoc::resolve`.
+    LF_OffsetsOnly = 1
+  };
+
+  explicit Lexer(const SourceDoc &doc, unsigned flags = 0) noexcept;
+
+  // Lexes the byte range [begin, end) of the document. Token offsets are
+  // still relative to the start of the document. Both ends should fall on
+  // token boundaries.
+  Lexer(const SourceDoc &doc, size_t begin, size_t end,
+        unsigned flags = 0) noexcept;
+
+  // Lexes `window`, which holds the document's bytes from offset `base`,
+  // starting at `start`. The document's content is not read, so this works
+  // for text that is not stored contiguously; see `ChunkLexer`.
+  Lexer(const SourceDoc &doc, std::string_view window, size_t base,
+        SourceLoc start, unsigned flags = 0) noexcept;
 
   const SourceDoc &get_doc() { return *doc; }
 
@@ -22,6 +47,11 @@ private:
   int getch(unsigned lookahead = 0) const;
   void nextch();
 
+  const char *current() const { return text.data() + (loc.offset - base); }
+  const char *text_end() const { return text.data() + text.size(); }
+  void advance_to(const char *p);
+  void advance_in_line(const char *p);
+
   static int get_keyword(std::string_view word);
 
   void lex_whitespace(Token &token);
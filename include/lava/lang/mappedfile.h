@@ -0,0 +1,38 @@
+#ifndef LAVA_LANG_MAPPEDFILE_H_
+#define LAVA_LANG_MAPPEDFILE_H_
+
+#include <filesystem>
+#include <string>
+
+namespace lava::lang {
+
+// A read-only view of a whole file: mapped where the OS supports it,
+// otherwise read into memory. Empty if the file couldn't be opened.
+struct MappedFile {
+private:
+#ifdef _WIN32
+  std::string _buffer;
+#else
+  void *_map = nullptr;
+#endif
+  const char *_data = nullptr;
+  size_t _size = 0;
+
+public:
+  explicit MappedFile(const std::filesystem::path &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile &operator=(const MappedFile&) = delete;
+
+  const char *data() const { return _data; }
+  size_t size() const { return _size; }
+};
+
+// A name next to `path` that no other process or call will pick, for
+// writing a file and then renaming it over `path`.
+std::filesystem::path temp_path_for(const std::filesystem::path &path);
+
+} // namespace lava::lang
+
+#endif /* LAVA_LANG_MAPPEDFILE_H_ */
@@ -0,0 +1,39 @@
+#ifndef LAVA_LANG_MODULE_H_
+#define LAVA_LANG_MODULE_H_
+
+#include "symbol.h"
+#include <filesystem>
+
+namespace lava::lang {
+
+// Precompiled modules: a namespace's symbols, the types and strings they
+// use, and each function's IR, written as flat arrays of fixed size
+// records. Loading one maps the file and copies each record out as it is
+// needed, interns the strings and types into the destination table and
+// rebuilds the symbols, with no lexing or parsing. Records are checked
+// against the arrays they index and the function they belong to, so a
+// damaged file is rejected rather than loaded.
+//
+// Types are numbered with the built in types first and every other type
+// after the types it refers to, so one pass over the records can build
+// them all. Symbols are stored in preorder, each followed by its children;
+// a function's children are its locals. Using declarations are not saved.
+//
+// Files are only valid for the pointer size they were written with.
+
+// Writes `ns` and everything under it to `path`. For the global
+// namespace, the built in type aliases are skipped. Returns false if the
+// file could not be written.
+bool save_module(const SymbolTable &symtab, const Namespace &ns,
+                 const std::filesystem::path &path);
+
+// Reads a module into a new namespace called `name` in `symtab`'s global
+// namespace, which other namespaces can then `add_using`. Returns null,
+// leaving the global namespace unchanged, if the file is missing or
+// invalid or the name is taken.
+Namespace *load_module(SymbolTable &symtab, InternString name,
+                       const std::filesystem::path &path);
+
+} // namespace lava::lang
+
+#endif /* LAVA_LANG_MODULE_H_ */
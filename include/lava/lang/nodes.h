@@ -3,11 +3,15 @@
 
 #include "token.h"
 #include <vector>
+#include <cassert>
 #include <memory>
 #include <optional>
+#include <cstddef>
 
 namespace lava::lang {
 
+struct TokenBuffer;
+
 enum class NodeKind {
   Document,
   Expr,
@@ -20,6 +24,23 @@ public:
   virtual NodeKind node_kind() const = 0;
   virtual SourceLoc start() const = 0;
   virtual SourceLoc end() const = 0;
+
+  // Moves every source location in the subtree by `delta` bytes. Used when
+  // a subtree is reused after an edit earlier in the document.
+  virtual void shift(ptrdiff_t delta) = 0;
+};
+
+// The tokens an item or scope was parsed from, recorded when parsing from a
+// TokenBuffer. Positions are relative so that a subtree stays valid when it
+// is moved: `offset` counts tokens from the start of the parent (the
+// previous item's end for an item, the enclosing item or scope's first
+// token for a scope) to this node's first token, and `width` counts the
+// node's tokens including inner trivia. `fingerprint` hashes the source
+// text they cover.
+struct SyntaxSpan {
+  uint32_t offset = 0;
+  uint32_t width = 0;
+  uint64_t fingerprint = 0;
 };
 
 struct Item;
@@ -40,8 +61,13 @@ public:
   NodeKind node_kind() const override;
   SourceLoc start() const override;
   SourceLoc end() const override;
+  void shift(ptrdiff_t delta) override;
 
   const std::vector<std::unique_ptr<Item>> &items() const { return _items; }
+
+  std::vector<std::unique_ptr<Item>> take_items() {
+    return std::move(_items);
+  }
 };
 
 enum class ExprKind {
@@ -60,9 +86,22 @@ enum class ExprKind {
   BreakContinue,
 };
 
+struct ScopeExpr;
 struct Expr : Node {
   virtual NodeKind node_kind() const override;
   virtual ExprKind expr_kind() const = 0;
+
+protected:
+  // Moves this node's child expressions, including those inside its scopes,
+  // into `out`.
+  virtual void release_children(std::vector<std::unique_ptr<Expr>> &out);
+  static void release_children(ScopeExpr &scope,
+                               std::vector<std::unique_ptr<Expr>> &out);
+
+  // Frees the children one at a time from an explicit stack, so that
+  // destroying a deeply nested tree can't overflow the call stack. Called
+  // by the destructor of every node that has children.
+  void drop_children() noexcept;
 };
 
 enum class LiteralType {
@@ -80,7 +119,6 @@ private:
     uint64_t u;
     float f;
     double d;
-    std::string_view s;
   } _value;
 
 public:
@@ -102,10 +140,11 @@ public:
     , _value{.d = d}
   {}
 
-  explicit LiteralExpr(Token token, std::string_view s) noexcept
+  // A string literal, whose value is the token's text.
+  explicit LiteralExpr(Token token) noexcept
     : _type{LiteralType::String}
     , _token{token}
-    , _value{.s = s}
+    , _value{.u = 0}
   {}
 
   LiteralExpr(const LiteralExpr&) = default;
@@ -118,13 +157,16 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   const Token &token() const { return _token; }
 
   uint64_t int_value() const { return _value.u; }
   float float_value() const { return _value.f; }
   double double_value() const { return _value.d; }
-  std::string_view string_value() const { return _value.s; }
+  // Read through the token, which stays valid when the document's text is
+  // reallocated by an edit.
+  std::string_view string_value() const { return _token.text(); }
 };
 
 struct IdentExpr final : Expr {
@@ -144,8 +186,10 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   std::string_view value() const { return _token.text(); }
+  const Token &token() const { return _token; }
 };
 
 struct PrefixExpr final : Expr {
@@ -168,9 +212,14 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   int op() const { return _op.what; }
+  const Token &op_token() const { return _op; }
   const Expr *expr() const { return _expr.get(); }
+
+private:
+  void release_children(std::vector<std::unique_ptr<Expr>> &out) override;
 };
 
 struct PostfixExpr final : Expr {
@@ -193,9 +242,14 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   int op() const { return _op.what; }
+  const Token &op_token() const { return _op; }
   const Expr *expr() const { return _expr.get(); }
+
+private:
+  void release_children(std::vector<std::unique_ptr<Expr>> &out) override;
 };
 
 struct BinaryExpr final : Expr {
@@ -220,10 +274,15 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   int op() const { return _op.what; }
+  const Token &op_token() const { return _op; }
   const Expr *left() const { return _left.get(); }
   const Expr *right() const { return _right.get(); }
+
+private:
+  void release_children(std::vector<std::unique_ptr<Expr>> &out) override;
 };
 
 struct ParenExpr final : Expr {
@@ -248,8 +307,14 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   const Expr *expr() const { return _expr.get(); }
+  const Token &lparen() const { return _left; }
+  const Token &rparen() const { return _right; }
+
+private:
+  void release_children(std::vector<std::unique_ptr<Expr>> &out) override;
 };
 
 template<class T>
@@ -304,10 +369,16 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   const Expr *expr() const { return _expr.get(); }
   const ExprsWithDelimiter &args() const { return _args; }
   BracketKind bracket_kind() const;
+  const Token &lparen() const { return _lparen; }
+  const Token &rparen() const { return _rparen; }
+
+private:
+  void release_children(std::vector<std::unique_ptr<Expr>> &out) override;
 };
 
 struct ScopeExpr final : Expr {
@@ -315,6 +386,7 @@ private:
   Token _lbrace;
   Token _rbrace;
   ExprsWithDelimiter _exprs;
+  SyntaxSpan _span;
 
 public:
   ScopeExpr(Token lbrace, Token rbrace, ExprsWithDelimiter exprs)
@@ -322,6 +394,7 @@ public:
     : _lbrace{lbrace}
     , _rbrace{rbrace}
     , _exprs{std::move(exprs)}
+    , _span{}
   {}
 
   ScopeExpr(ScopeExpr&&) = default;
@@ -332,8 +405,17 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   const ExprsWithDelimiter &exprs() const { return _exprs; }
+  const Token &lbrace() const { return _lbrace; }
+  const Token &rbrace() const { return _rbrace; }
+
+  const SyntaxSpan &span() const { return _span; }
+  void set_span(SyntaxSpan span) { _span = span; }
+
+private:
+  void release_children(std::vector<std::unique_ptr<Expr>> &out) override;
 };
 
 struct ReturnExpr final : Expr {
@@ -357,12 +439,19 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   const Expr *expr() const { return _expr.get(); }
+  const Token &return_token() const { return _return; }
+
+private:
+  void release_children(std::vector<std::unique_ptr<Expr>> &out) override;
 };
 
 struct ElsePart {
 private:
+  friend struct IfExpr;
+
   Token _else;
   Token _if;
   std::unique_ptr<Expr> _expr;
@@ -390,6 +479,11 @@ public:
   SourceLoc end() const { return _scope.end(); }
   const Expr *expr() const { return _expr.get(); }
   const ScopeExpr &scope() const { return _scope; }
+  const Token &else_token() const { return _else; }
+  // Only set for `else if`.
+  const Token &if_token() const { return _if; }
+
+  void shift(ptrdiff_t delta);
 };
 
 struct IfExpr final : Expr {
@@ -413,10 +507,15 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   const Expr *expr() const { return _expr.get(); }
   const ScopeExpr &scope() const { return _scope; }
   const std::vector<ElsePart> &elses() const { return _elses; }
+  const Token &if_token() const { return _if; }
+
+private:
+  void release_children(std::vector<std::unique_ptr<Expr>> &out) override;
 };
 
 struct WhileExpr final : Expr {
@@ -437,9 +536,14 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   const Expr *expr() const { return _expr.get(); }
   const ScopeExpr &scope() const { return _scope; }
+  const Token &while_token() const { return _while; }
+
+private:
+  void release_children(std::vector<std::unique_ptr<Expr>> &out) override;
 };
 
 struct LoopExpr final : Expr {
@@ -458,8 +562,13 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   const ScopeExpr &scope() const { return _scope; }
+  const Token &loop_token() const { return _loop; }
+
+private:
+  void release_children(std::vector<std::unique_ptr<Expr>> &out) override;
 };
 
 struct BreakContinueExpr final : Expr {
@@ -483,10 +592,15 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ExprKind expr_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   bool is_break() const { return _break_or_continue.what == TkBreak; }
   bool is_continue() const { return _break_or_continue.what == TkContinue; }
   const Expr *expr() const { return _expr.get(); }
+  const Token &token() const { return _break_or_continue; }
+
+private:
+  void release_children(std::vector<std::unique_ptr<Expr>> &out) override;
 };
 
 enum class ItemKind {
@@ -499,10 +613,16 @@ enum class ItemKind {
 };
 
 struct Item : Node {
+private:
+  SyntaxSpan _span;
+
 public:
   NodeKind node_kind() const override;
 
   virtual ItemKind item_kind() const = 0;
+
+  const SyntaxSpan &span() const { return _span; }
+  void set_span(SyntaxSpan span) { _span = span; }
 };
 
 struct EmptyItem : Item {
@@ -522,6 +642,9 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ItemKind item_kind() const override;
+  void shift(ptrdiff_t delta) override;
+
+  const Token &semi() const { return _semi; }
 };
 
 struct ExprItem : Item {
@@ -543,8 +666,10 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ItemKind item_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   const Expr *expr() const { return _expr.get(); }
+  const Token &semi() const { return _semi; }
 };
 
 struct VarInit {
@@ -562,6 +687,9 @@ public:
   VarInit &operator=(VarInit&&) = default;
 
   const Expr *expr() const { return _expr.get(); }
+  const Token &eq() const { return _eq; }
+
+  void shift(ptrdiff_t delta);
 };
 
 struct VarDecl {
@@ -584,7 +712,10 @@ public:
   VarDecl &operator=(VarDecl&&) = default;
 
   std::string_view name() const { return _name.text(); }
+  const Token &name_token() const { return _name; }
   const std::optional<VarInit> &init() const { return _init; }
+
+  void shift(ptrdiff_t delta);
 };
 
 using VarDeclWithDelimiter = WithDelimiter<VarDecl>;
@@ -612,9 +743,11 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ItemKind item_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   const Expr *type() const { return _type.get(); }
   const VarDeclsWithDelimiter &decls() const { return _decls; }
+  const Token &semi() const { return _semi; }
 };
 
 struct ArgDecl {
@@ -640,7 +773,10 @@ public:
 
   const Expr *type() const { return _type.get(); }
   std::string_view name() const { return _name.text(); }
+  const Token &name_token() const { return _name; }
   const std::optional<VarInit> &init() const { return _init; }
+
+  void shift(ptrdiff_t delta);
 };
 
 using ArgDeclWithDelimiter = WithDelimiter<ArgDecl>;
@@ -664,6 +800,10 @@ public:
   ArgList &operator=(ArgList&&) = default;
 
   const ArgDeclsWithDelimiter &args() const { return _args; }
+  const Token &lparen() const { return _lparen; }
+  const Token &rparen() const { return _rparen; }
+
+  void shift(ptrdiff_t delta);
 };
 
 struct ReturnSpec {
@@ -678,6 +818,9 @@ public:
   {}
 
   const Expr *type() const { return _type.get(); }
+  const Token &arrow() const { return _arrow; }
+
+  void shift(ptrdiff_t delta);
 };
 
 struct FunItemBase : Item {
@@ -702,11 +845,17 @@ public:
   ~FunItemBase();
 
   SourceLoc start() const override;
+  void shift(ptrdiff_t delta) override;
 
   std::string_view name() const { return _name.text(); }
   const ArgDeclsWithDelimiter &args() const { return _args.args(); }
   const Expr *return_type() const
   { return _return ? _return->type() : nullptr; }
+
+  const Token &fun_token() const { return _fun; }
+  const Token &name_token() const { return _name; }
+  const ArgList &arg_list() const { return _args; }
+  const std::optional<ReturnSpec> &return_spec() const { return _return; }
 };
 
 struct FunDeclItem final : FunItemBase {
@@ -727,11 +876,18 @@ public:
 
   SourceLoc end() const override;
   ItemKind item_kind() const override;
+  void shift(ptrdiff_t delta) override;
+
+  const Token &semi() const { return _semi; }
 };
 
 struct FunDefItem final : FunItemBase {
 private:
-  ScopeExpr _body;
+  // Empty until the parser expands it if the body was skipped.
+  std::optional<ScopeExpr> _body;
+  // For a skipped body, its braces. Unused otherwise.
+  Token _lbrace;
+  Token _rbrace;
 
 public:
   explicit FunDefItem(Token fun, Token name, ArgList args,
@@ -739,6 +895,19 @@ public:
     noexcept
     : FunItemBase{fun, name, std::move(args), std::move(ret)}
     , _body{std::move(body)}
+    , _lbrace{}
+    , _rbrace{}
+  {}
+
+  // A body that was skipped by matching braces, to be parsed later by
+  // `Parser::expand_body`.
+  explicit FunDefItem(Token fun, Token name, ArgList args,
+                      std::optional<ReturnSpec> ret, Token lbrace,
+                      Token rbrace)
+    noexcept
+    : FunItemBase{fun, name, std::move(args), std::move(ret)}
+    , _lbrace{lbrace}
+    , _rbrace{rbrace}
   {}
 
   FunDefItem(FunDefItem&&) = default;
@@ -748,8 +917,20 @@ public:
 
   SourceLoc end() const override;
   ItemKind item_kind() const override;
+  void shift(ptrdiff_t delta) override;
+
+  bool is_body_parsed() const { return _body.has_value(); }
+
+  // Where the body's opening brace is, parsed or not.
+  SourceLoc body_start() const;
+
+  // A skipped body must be expanded first.
+  const ScopeExpr &body() const {
+    assert(_body && "skipped fun body was not expanded");
+    return *_body;
+  }
 
-  const ScopeExpr &body() const { return _body; }
+  void set_body(ScopeExpr body) { _body = std::move(body); }
 };
 
 struct StructDefItem final : Item {
@@ -779,6 +960,7 @@ public:
   SourceLoc start() const override;
   SourceLoc end() const override;
   ItemKind item_kind() const override;
+  void shift(ptrdiff_t delta) override;
 
   bool is_union() const {
     return _struct_or_union.what == TkUnion;
@@ -786,6 +968,10 @@ public:
 
   std::string_view name() const { return _name.text(); }
   const std::vector<VarDeclItem> &vars() const { return _vars; }
+  const Token &keyword() const { return _struct_or_union; }
+  const Token &name_token() const { return _name; }
+  const Token &lbrace() const { return _lbrace; }
+  const Token &rbrace() const { return _rbrace; }
 };
 
 } // namespace lava::lang
@@ -0,0 +1,76 @@
+#ifndef LAVA_LANG_PARSECACHE_H_
+#define LAVA_LANG_PARSECACHE_H_
+
+#include "flattree.h"
+#include "tokenbuffer.h"
+#include <filesystem>
+#include <memory>
+
+namespace lava::lang {
+
+struct Diagnostics;
+
+// An on-disk cache of front end results, keyed by a hash of the source
+// text. Each entry holds a document's token buffer and flat syntax tree as
+// raw arrays, so a hit is an mmap, a checksum and a few copies instead of
+// lexing and parsing. Entries are only valid on the machine that wrote
+// them.
+struct ParseCache {
+  struct Result {
+  private:
+    std::unique_ptr<Document> _document;
+
+  public:
+    std::unique_ptr<TokenBuffer> tokens;
+    // Null if the document has errors; those are never cached.
+    std::unique_ptr<FlatTree> tree;
+    bool hit = false;
+
+    // The pointer-based tree. After a hit this is expanded from `tree` on
+    // first use, so callers that only scan the flat tree never build it.
+    Document *document() {
+      if (!_document && tree) {
+        _document = tree->expand();
+      }
+      return _document.get();
+    }
+
+    friend struct ParseCache;
+  };
+
+private:
+  std::filesystem::path _dir;
+  uint64_t _max_bytes;
+
+public:
+  // Creates `dir` if needed. When a store takes the cache over `max_bytes`,
+  // the least recently used entries are deleted.
+  explicit ParseCache(std::filesystem::path dir,
+                      uint64_t max_bytes = 256 * 1024 * 1024);
+
+  const std::filesystem::path &dir() const { return _dir; }
+
+  // Loads the tokens and syntax tree for `doc` from the cache, or lexes and
+  // parses it and stores the result. Parse errors go to `diagnostics`.
+  Result parse(const SourceDoc &doc, Diagnostics *diagnostics = nullptr);
+
+  // Returns a cached entry for `doc`'s content, or a result with null
+  // tokens on a miss or an invalid entry.
+  Result load(const SourceDoc &doc) const;
+
+  // Writes an entry for `doc` and evicts old entries if needed. Returns
+  // false if the entry could not be written.
+  bool store(const SourceDoc &doc, const TokenBuffer &tokens,
+             const FlatTree &tree);
+
+  // Deletes least recently used entries until the total size is at most
+  // `max_bytes`.
+  void evict(uint64_t max_bytes);
+
+private:
+  std::filesystem::path entry_path(const SourceDoc &doc) const;
+};
+
+} // namespace lava::lang
+
+#endif /* LAVA_LANG_PARSECACHE_H_ */
@@ -2,7 +2,9 @@
 #define LAVA_LANG_PARSER_H_
 
 #include "nodes.h"
+#include "diagnostics.h"
 #include "lexer.h"
+#include "tokenbuffer.h"
 #include <stdexcept>
 
 namespace lava::lang {
@@ -22,15 +24,48 @@ public:
 
 struct Parser {
 private:
+  // Exactly one of these is set. With a token buffer, `index` is the
+  // position of `token` in it.
   Lexer *lexer;
+  const TokenBuffer *tokens;
+  size_t index;
   Token token;
 
+  // With a token buffer: one past the last token consumed, and the first
+  // token of the item or scope being parsed. These give each node's span.
+  size_t span_end;
+  size_t span_parent;
+
+  // Set during `reparse_document`.
+  struct Reuse;
+  Reuse *reuse;
+
+  bool lazy_bodies;
+  // Where errors go; null for speculative parses whose errors may not be
+  // real, or when the caller doesn't want them.
+  Diagnostics *diagnostics;
+
 public:
   enum Flags {
-    PF_NoComma = 1
+    PF_NoComma = 1,
+    // For the token buffer constructor: skip function bodies by matching
+    // braces, to be parsed later with `expand_body`.
+    PF_LazyBodies = 2,
   };
 
-  explicit Parser(Lexer &lexer) noexcept;
+  explicit Parser(Lexer &lexer, Diagnostics *diagnostics = nullptr) noexcept;
+  explicit Parser(const TokenBuffer &tokens, int flags = 0,
+                  Diagnostics *diagnostics = nullptr) noexcept;
+
+  // Lookahead and backtracking; these require a token buffer.
+
+  // Returns the kind of the `n`th non-trivia token after the current one.
+  int peek(unsigned n = 1) const;
+
+  // Returns a position that can be passed to `reset` to return to the
+  // current token.
+  size_t mark() const;
+  void reset(size_t mark);
 
 private:
   void next();
@@ -39,6 +74,25 @@ private:
 public:
   std::unique_ptr<Document> parse_document();
 
+  // Parses the rest of the document on a thread pool; this requires a token
+  // buffer. A scan over the token kinds finds where each top-level item
+  // ends, the items are grouped into chunks of at least `min_chunk_tokens`
+  // tokens, and each chunk is parsed by its own parser. If a chunk does not
+  // end where the scan expected, the document is parsed sequentially.
+  std::unique_ptr<Document> parse_document(ThreadPool &pool,
+                                           size_t min_chunk_tokens = 16384);
+
+  // Parses the document again after an edit, reusing what the edit did not
+  // touch. `old` must have been parsed from this token buffer before
+  // `splice` (the result of `TokenBuffer::relex(edit)`) was applied; its
+  // items are moved into the new document or destroyed. Top-level items and
+  // nested scopes whose tokens lie entirely before or after the damaged
+  // tokens, with at least one token in between, are kept and shifted to
+  // their new offsets rather than parsed again.
+  std::unique_ptr<Document> reparse_document(Document &old,
+                                             const TokenBuffer::Splice &splice,
+                                             const TextEdit &edit);
+
   std::unique_ptr<Item> parse_item();
 
   std::unique_ptr<VarDeclItem> parse_var_item(std::unique_ptr<Expr> type);
@@ -46,6 +100,15 @@ public:
   std::optional<VarInit> parse_var_init();
 
   std::unique_ptr<FunItemBase> parse_fun_item();
+  // Parses the body of a function that was skipped with PF_LazyBodies
+  // into `item`. This requires the token buffer `item` was parsed from.
+  // Returns false, leaving the body skipped and reporting the error, if
+  // it is invalid.
+  bool expand_body(FunDefItem &item);
+  // Like `expand_body`, but returns the body without storing it in `item`.
+  std::optional<ScopeExpr> parse_body(const FunDefItem &item);
+  // Expands every skipped body in `doc`; returns false if any is invalid.
+  bool expand_bodies(Document &doc);
   std::optional<ArgList> parse_arg_list();
   std::optional<ArgDecl> parse_arg_decl();
 
@@ -60,6 +123,12 @@ public:
   std::unique_ptr<LoopExpr> parse_loop();
 
 private:
+  bool parse_items(size_t first, size_t last,
+                   std::vector<std::unique_ptr<Item>> &items);
+  std::unique_ptr<Item> parse_item_contents();
+  SyntaxSpan make_span(size_t parent, size_t first, size_t last) const;
+  std::optional<ScopeExpr> reuse_scope_expr();
+
   static unsigned get_prefix_prec(int op, int flags);
   static unsigned get_infix_prec(int op, int flags);
   static unsigned get_postfix_prec(int op, int flags);
@@ -0,0 +1,182 @@
+#ifndef LAVA_LANG_QUERY_H_
+#define LAVA_LANG_QUERY_H_
+
+#include "symbol.h"
+#include "tokenbuffer.h"
+#include "nodes.h"
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace lava::lang {
+
+struct Diagnostics;
+
+enum class QueryKind : uint8_t {
+  // Inputs.
+  Document,
+  Scope,
+  // Derived.
+  Items,
+  Item,
+  ItemTokens,
+  ItemHeader,
+  Resolve,
+  Signature,
+  FunctionIr,
+};
+
+constexpr size_t QueryKinds = (size_t)QueryKind::FunctionIr + 1;
+
+struct QueryKey {
+  QueryKind kind;
+  // Unused for queries without a key.
+  InternString name;
+};
+
+// Demand-driven front end passes for one document. Each query is
+// memoised along with the queries it read while running. An edit bumps
+// the revision; a memo from an older revision is reused if none of its
+// inputs changed, which is checked by bringing each input up to date in
+// turn. A query that reruns and produces an equal value keeps its old
+// change revision, so whatever read it is not rerun either.
+//
+// Queries read the syntax tree of an item only through fingerprints of
+// its tokens, ignoring trivia. A signature depends on the tokens before
+// the body, so editing a function body only reruns that function's IR,
+// and editing a comment reruns nothing past the fingerprints.
+//
+// Functions are the only items with queries; their symbols are owned here
+// rather than added to the global namespace.
+struct QueryEngine {
+  // An item is destroyed when an edit reaches it, and a new one may be
+  // allocated at the same address, so items are compared by their text
+  // as well.
+  struct ItemRef {
+    const FunItemBase *item = nullptr;
+    uint64_t fingerprint = 0;
+
+    bool operator==(const ItemRef &other) const {
+      return item == other.item && fingerprint == other.fingerprint;
+    }
+  };
+
+  struct ItemMap {
+    // In document order.
+    std::vector<InternString> names;
+    std::unordered_map<InternString, ItemRef> items;
+
+    bool operator==(const ItemMap &other) const {
+      return names == other.names && items == other.items;
+    }
+  };
+
+private:
+  template<class T>
+  struct Memo {
+    T value{};
+    uint64_t verified_at = 0;
+    uint64_t changed_at = 0;
+    std::vector<QueryKey> deps;
+    bool valid = false;
+    bool running = false;
+  };
+
+  // The queries read by the query that is running.
+  struct Frame {
+    std::vector<QueryKey> deps;
+    bool tracked;
+  };
+
+  SymbolTable *_symtab;
+  Diagnostics *_diagnostics;
+  SourceDoc _doc;
+  TokenBuffer _tokens;
+  std::unique_ptr<Document> _document;
+
+  uint64_t _revision = 1;
+  uint64_t _document_changed = 1;
+  uint64_t _scope_changed = 1;
+  std::vector<Frame> _frames;
+  size_t _executions[QueryKinds] = {};
+
+  Memo<ItemMap> _items;
+  std::unordered_map<InternString, Memo<ItemRef>> _item;
+  std::unordered_map<InternString, Memo<uint64_t>> _item_tokens;
+  std::unordered_map<InternString, Memo<uint64_t>> _item_header;
+  std::unordered_map<InternString, Memo<Symbol*>> _resolve;
+  std::unordered_map<InternString, Memo<const FunctionType*>> _signature;
+  std::unordered_map<InternString, Memo<std::unique_ptr<Function>>>
+    _function_ir;
+
+  template<class T, class Compute, class Equal>
+  const T &fetch(QueryKey key, Memo<T> &memo, Compute compute, Equal equal);
+
+  template<class T, class Compute>
+  const T &fetch(QueryKey key, Memo<T> &memo, Compute compute) {
+    return fetch(key, memo, compute, std::equal_to<T>{});
+  }
+
+  // Brings `key` up to date without recording a dependency on it, and
+  // returns the revision its value last changed in.
+  uint64_t refresh(QueryKey key);
+  bool deps_changed_since(const std::vector<QueryKey> &deps,
+                          uint64_t revision);
+  // Records a dependency on an input.
+  void read_input(QueryKind kind);
+
+  // Reads an item without depending on it. Only for queries that depend on
+  // a fingerprint covering everything they read.
+  const FunItemBase *item_untracked(InternString name);
+
+  uint64_t fingerprint(size_t begin, size_t end) const;
+
+public:
+  QueryEngine(SymbolTable &symtab, std::string name, std::string content,
+              Diagnostics *diagnostics = nullptr);
+  ~QueryEngine();
+
+  QueryEngine(const QueryEngine&) = delete;
+  QueryEngine &operator=(const QueryEngine&) = delete;
+
+  const SourceDoc &doc() const { return _doc; }
+  // Null if the last parse failed.
+  const Document *document() const { return _document.get(); }
+  uint64_t revision() const { return _revision; }
+
+  // Applies `edit` to the document and reparses incrementally.
+  void edit(const TextEdit &edit);
+
+  // Marks the global namespace as changed, such as after loading a module.
+  void scope_changed();
+
+  // The functions declared or defined at the top level.
+  const ItemMap &items();
+
+  // The definition of `name` if there is one, else its declaration, or
+  // null.
+  const FunItemBase *item(InternString name);
+
+  // Hashes of an item's non-trivia tokens: all of them, or those before a
+  // function's body.
+  uint64_t item_tokens(InternString name);
+  uint64_t item_header(InternString name);
+
+  // What `name` means in the global namespace.
+  Symbol *resolve(InternString name);
+
+  const FunctionType *signature(InternString name);
+
+  // The function with its IR emitted, or null if it has no definition.
+  const Function *function_ir(InternString name);
+
+  // How many times queries of `kind` have run.
+  size_t executions(QueryKind kind) const {
+    return _executions[(size_t)kind];
+  }
+};
+
+} // namespace lava::lang
+
+#endif /* LAVA_LANG_QUERY_H_ */
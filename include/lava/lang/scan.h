@@ -0,0 +1,39 @@
+#ifndef LAVA_LANG_SCAN_H_
+#define LAVA_LANG_SCAN_H_
+
+#include <cstddef>
+#include <vector>
+
+// Bulk byte scanners for the lexer. Each function looks at the bytes in
+// [first, last) and returns a pointer to the first byte that ends the run, or
+// `last` if the run reaches the end of the input. The implementation picks
+// AVX2 or SSE2 at runtime where available and otherwise falls back to a
+// scalar loop.
+
+namespace lava::lang::scan {
+
+// Skips ' ', '\t', '\r' and '\n'.
+const char *skip_whitespace(const char *first, const char *last);
+
+// Skips [A-Za-z0-9_].
+const char *skip_ident(const char *first, const char *last);
+
+// Finds the first occurrence of `c`.
+const char *find_byte(const char *first, const char *last, char c);
+
+// Finds the first "*/".
+const char *find_block_comment_end(const char *first, const char *last);
+
+// Counts occurrences of '\n'.
+size_t count_newlines(const char *first, const char *last);
+
+// Finds the last '\n', or returns null if there is none.
+const char *find_last_newline(const char *first, const char *last);
+
+// Appends the offset from `first` of the byte after each '\n'.
+void append_line_starts(const char *first, const char *last,
+                        std::vector<size_t> &starts);
+
+} // namespace lava::lang::scan
+
+#endif // LAVA_LANG_SCAN_H_
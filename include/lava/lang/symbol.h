@@ -3,43 +3,21 @@
 
 #include <string>
 #include <string_view>
-#include <unordered_map>
-#include <unordered_set>
 #include <memory>
 #include <vector>
 #include <cassert>
+#include <unordered_map>
 #include <boost/container_hash/hash.hpp>
 #include <boost/container/small_vector.hpp>
 
 #include "instr.h"
+#include "interner.h"
+#include "symbolmap.h"
+#include "lava/util/casting.h"
+#include "lava/util/hash.h"
 
 namespace lava::lang {
 
-  struct InternString {
-    size_t offset;
-    size_t size;
-
-    InternString() noexcept : offset{0}, size{0} {}
-    InternString(size_t offset, size_t size) noexcept
-      : offset{offset}, size{size}
-    {}
-    InternString(const InternString&) = default;
-    InternString &operator=(const InternString&) = default;
-
-    bool operator==(const InternString &other) const {
-      return offset == other.offset && size == other.size;
-    }
-
-    operator bool() const { return size != 0; }
-
-    size_t hash() const {
-      size_t hash = 0;
-      boost::hash_combine(hash, offset);
-      boost::hash_combine(hash, size);
-      return hash;
-    }
-  };
-
   using SymbolPath = boost::container::small_vector<InternString, 1>;
 
 } // namespace lava::lang
@@ -55,7 +33,7 @@ namespace std {
     size_t operator()(const lava::lang::SymbolPath &path) const {
       size_t hash = 0;
       for (auto const &str : path) {
-        boost::hash_combine(hash, str.offset);
+        boost::hash_combine(hash, str.index);
         boost::hash_combine(hash, str.size);
       }
       return hash;
@@ -73,13 +51,22 @@ namespace boost {
 
 namespace lava::lang {
 
+enum class SymbolKind : uint8_t {
+  Namespace,
+  TypeAlias,
+  Function,
+  Variable,
+};
+
 struct Symbol {
 private:
   InternString _name;
+  SymbolKind _kind;
 
 public:
-  Symbol(InternString name)
+  Symbol(SymbolKind kind, InternString name)
     : _name{name}
+    , _kind{kind}
   {}
   Symbol(const Symbol &) = default;
   Symbol &operator=(const Symbol &) = default;
@@ -89,6 +76,134 @@ public:
   virtual ~Symbol() = 0;
 
   InternString name() const { return _name; }
+  SymbolKind kind() const { return _kind; }
+};
+
+struct Namespace;
+
+// Remembers the results of scope chain lookups from every namespace under
+// one root. A result can depend on any namespace in the chain and on
+// anything they use, so instead of tracking that, any change under the
+// root bumps one generation counter and retires every entry at once.
+// Function scopes are left out, since they change constantly and nothing
+// above them can see them. Entries are direct mapped; a collision just
+// evicts the older result.
+struct ResolutionCache {
+  static constexpr size_t NameEntries = 1024;
+  static constexpr size_t PathEntries = 256;
+
+private:
+  struct NameEntry {
+    const Namespace *ns = nullptr;
+    InternString name;
+    Symbol *symbol = nullptr;
+    uint64_t generation = 0;
+  };
+
+  struct PathEntry {
+    const Namespace *ns = nullptr;
+    SymbolPath path;
+    Symbol *symbol = nullptr;
+    uint64_t generation = 0;
+  };
+
+  uint64_t _generation = 1;
+  // Allocated on first use.
+  std::unique_ptr<NameEntry[]> _names;
+  std::unique_ptr<PathEntry[]> _paths;
+
+  static size_t slot(const Namespace *ns, uint64_t key, size_t size) {
+    return hash_mix((uint64_t)(uintptr_t)ns ^ key) & (size - 1);
+  }
+
+  static uint64_t key(const SymbolPath &path) {
+    uint64_t key = path.size();
+    for (auto const &name : path) {
+      key = hash_mix(key ^ name.index) + name.size;
+    }
+    return key;
+  }
+
+public:
+  void invalidate() { ++_generation; }
+  uint64_t generation() const { return _generation; }
+
+  // On a hit, sets `symbol`, which may be null for a name that wasn't
+  // found, and returns true.
+  bool find(const Namespace *ns, InternString name, Symbol *&symbol) const {
+    if (!_names) {
+      return false;
+    }
+    auto const &entry = _names[slot(ns, name.index, NameEntries)];
+    if (entry.generation != _generation || entry.ns != ns
+        || !(entry.name == name)) {
+      return false;
+    }
+    symbol = entry.symbol;
+    return true;
+  }
+
+  bool find(const Namespace *ns, const SymbolPath &path,
+            Symbol *&symbol) const {
+    if (!_paths) {
+      return false;
+    }
+    auto const &entry = _paths[slot(ns, key(path), PathEntries)];
+    if (entry.generation != _generation || entry.ns != ns
+        || entry.path != path) {
+      return false;
+    }
+    symbol = entry.symbol;
+    return true;
+  }
+
+  void insert(const Namespace *ns, InternString name, Symbol *symbol) {
+    if (!_names) {
+      _names.reset(new NameEntry[NameEntries]);
+    }
+    _names[slot(ns, name.index, NameEntries)] = {
+      ns, name, symbol, _generation
+    };
+  }
+
+  void insert(const Namespace *ns, const SymbolPath &path, Symbol *symbol) {
+    if (!_paths) {
+      _paths.reset(new PathEntry[PathEntries]);
+    }
+    auto &entry = _paths[slot(ns, key(path), PathEntries)];
+    entry.ns = ns;
+    entry.path = path;
+    entry.symbol = symbol;
+    entry.generation = _generation;
+  }
+};
+
+// Which functions in a namespace read which names in their IR, so that
+// replacing one symbol only has to invalidate the functions that read it.
+// Functions are named rather than pointed to, since a user may itself be
+// replaced before it is emitted again.
+struct DependencyGraph {
+private:
+  // User to the names it reads, and name to the functions that read it.
+  std::unordered_map<InternString, std::vector<InternString>> _uses;
+  std::unordered_map<InternString, std::vector<InternString>> _users;
+
+public:
+  // Records that `user` reads `name`; recording it twice is harmless.
+  void add(InternString user, InternString name);
+
+  // Forgets everything `user` reads, before it is emitted again.
+  void remove_user(InternString user);
+
+  // The functions that read `name`, or null if there are none.
+  const std::vector<InternString> *users(InternString name) const;
+
+  bool empty() const { return _uses.empty(); }
+
+  void clear() {
+    _uses.clear();
+    _users.clear();
+  }
 };
 
 struct Namespace : Symbol {
@@ -96,28 +211,64 @@ private:
   Namespace *_parent;
   std::vector<Namespace*> _using;
   std::vector<std::unique_ptr<Symbol>> _symbols_ordered;
-  std::unordered_map<InternString, Symbol*> _symbols;
+  SymbolMap _symbols;
+  // Only the root owns a cache; its descendants share it, except for
+  // function scopes and anything under them, which have none.
+  std::unique_ptr<ResolutionCache> _own_cache;
+  ResolutionCache *_cache;
+  // Allocated on first use.
+  std::unique_ptr<DependencyGraph> _deps;
 
   Namespace()
-    : Symbol{InternString{}}
+    : Symbol{SymbolKind::Namespace, InternString{}}
     , _parent{nullptr}
+    , _own_cache{std::make_unique<ResolutionCache>()}
+    , _cache{_own_cache.get()}
   {}
 
+  Symbol *getrec_uncached(InternString name);
+  Symbol *getrec_uncached(const SymbolPath &path);
+  // Looks here and in each used namespace, but not in the parent.
+  Symbol *get_or_using(InternString name);
+  Symbol *get_or_using(const SymbolPath &path);
+
+  void changed() {
+    if (_cache) {
+      _cache->invalidate();
+    }
+  }
+
   friend struct SymbolTable;
 
 public:
+  // For a function's scopes. Changes here don't retire cached lookups, and
+  // lookups from here are cached from the parent up.
+  struct FunctionScope {};
+
   Namespace(Namespace &parent)
-    : Symbol{InternString{}}
+    : Symbol{SymbolKind::Namespace, InternString{}}
+    , _parent{&parent}
+    , _cache{parent._cache}
+  {}
+
+  Namespace(Namespace &parent, FunctionScope)
+    : Symbol{SymbolKind::Namespace, InternString{}}
     , _parent{&parent}
+    , _cache{nullptr}
   {}
 
   Namespace(InternString name, Namespace &parent)
-    : Symbol{name}
+    : Symbol{SymbolKind::Namespace, name}
     , _parent{&parent}
+    , _cache{parent._cache}
   {}
 
   ~Namespace();
 
+  static bool classof(const Symbol &symbol) {
+    return symbol.kind() == SymbolKind::Namespace;
+  }
+
   size_t size() const {
     return _symbols_ordered.size();
   }
@@ -134,31 +285,48 @@ public:
     _using.clear();
     _symbols_ordered.clear();
     _symbols.clear();
+    _deps.reset();
+    changed();
   }
 
   bool has(InternString name) const {
-    return _symbols.find(name) != _symbols.end();
+    return _symbols.contains(name);
   }
 
   // Returns the new symbol if succeeded, else null.
   Symbol *add(std::unique_ptr<Symbol> value) {
-    auto [it, inserted] = _symbols.emplace(value->name(), value.get());
-    if (inserted) {
+    if (_symbols.insert(value->name(), value.get())) {
+      changed();
       return _symbols_ordered.emplace_back(std::move(value)).get();
     }
     return nullptr;
   }
 
+  // Puts `value` in place of the symbol with the same name, keeping its
+  // position, and returns the old one. If there wasn't one, adds `value`
+  // and returns null.
+  std::unique_ptr<Symbol> replace(std::unique_ptr<Symbol> value);
+
+  // Takes the symbol called `name` out, or returns null. This rebuilds the
+  // name map, so it is meant for items that were deleted, not for
+  // replacing symbols.
+  std::unique_ptr<Symbol> remove(InternString name);
+
+  // Which functions here read which names.
+  DependencyGraph &dependencies() {
+    if (!_deps) {
+      _deps = std::make_unique<DependencyGraph>();
+    }
+    return *_deps;
+  }
+
   void add_using(Namespace &ns) {
     _using.emplace_back(&ns);
+    changed();
   }
 
   Symbol *get(InternString name) {
-    auto it = _symbols.find(name);
-    if (it == _symbols.end()) {
-      return nullptr;
-    }
-    return it->second;
+    return _symbols.find(name);
   }
 
   const Symbol *get(InternString name) const {
@@ -171,6 +339,12 @@ public:
     return const_cast<Namespace*>(this)->get(path);
   }
 
+  // Looks `name` up here, then in each used namespace, then in the
+  // parent. Results are cached until a namespace under the same root
+  // changes.
+  //
+  // Namespaces meant to be used by others should not be function scopes,
+  // since changes to those aren't seen by the cache.
   Symbol *getrec(InternString name);
 
   const Symbol *getrec(InternString name) const {
@@ -182,6 +356,9 @@ public:
   const Symbol *getrec(const SymbolPath &path) const {
     return const_cast<Namespace*>(this)->getrec(path);
   }
+
+  // Null for function scopes.
+  const ResolutionCache *resolution_cache() const { return _cache; }
 };
 
 enum class TypeKind {
@@ -199,23 +376,33 @@ enum class TypeKind {
 };
 
 struct Type {
+protected:
+  // Set once by each concrete type's constructor. Child types are hashed
+  // by their own cached hash, so this never walks the whole type.
+  size_t _hash = 0;
+
+public:
   virtual ~Type();
   virtual TypeKind kind() const = 0;
-  virtual size_t hash() const = 0;
+  size_t hash() const { return _hash; }
+  // Compares one level deep; child types are compared by pointer, which
+  // is exact for types that came from the same SymbolTable.
   bool operator==(const Type &other) const;
 };
 
 struct NeverType : Type {
+  NeverType() { _hash = compute_hash(); }
   ~NeverType();
   TypeKind kind() const override;
-  size_t hash() const override;
+  size_t compute_hash() const;
   bool operator==(const NeverType &) const { return true; }
 };
 
 struct AnyType : Type {
+  AnyType() { _hash = compute_hash(); }
   ~AnyType();
   TypeKind kind() const override;
-  size_t hash() const override;
+  size_t compute_hash() const;
   bool operator==(const AnyType &) const { return true; }
 };
 
@@ -229,21 +416,32 @@ struct DataType : Type {
   DataType &operator=(const DataType &) = default;
   DataType(DataType&&) = default;
   DataType &operator=(DataType&&) = default;
+
+  static bool classof(const Type &type) {
+    switch (type.kind()) {
+    case TypeKind::Never:
+    case TypeKind::Any:
+    case TypeKind::Function:
+      return false;
+    default:
+      return true;
+    }
+  }
 };
 
 struct VoidType : DataType {
-  VoidType() : DataType(0) {}
+  VoidType() : DataType(0) { _hash = compute_hash(); }
   ~VoidType();
   TypeKind kind() const override;
-  size_t hash() const override;
+  size_t compute_hash() const;
   bool operator==(const VoidType &) const { return true; }
 };
 
 struct BoolType : DataType {
-  BoolType() : DataType(1) {}
+  BoolType() : DataType(1) { _hash = compute_hash(); }
   ~BoolType();
   TypeKind kind() const override;
-  size_t hash() const override;
+  size_t compute_hash() const;
   bool operator==(const BoolType &) const { return true; }
 };
 
@@ -253,24 +451,26 @@ struct IntType : DataType {
   IntType(unsigned size, bool is_signed)
     : DataType{size}
     , is_signed{is_signed}
-  {}
+  {
+    _hash = compute_hash();
+  }
 
   ~IntType();
 
   TypeKind kind() const override;
-  size_t hash() const override;
+  size_t compute_hash() const;
   bool operator==(const IntType &other) const;
 };
 
 struct FloatType : DataType {
 private:
-  FloatType(unsigned size) : DataType{size} {}
+  FloatType(unsigned size) : DataType{size} { _hash = compute_hash(); }
 
 public:
   ~FloatType();
 
   TypeKind kind() const override;
-  size_t hash() const override;
+  size_t compute_hash() const;
   bool operator==(const FloatType &other) const;
 
   static FloatType float_type() { return FloatType(4); }
@@ -287,6 +487,7 @@ struct PointerType : DataType {
     , pointed_at{pointed_at}
   {
     assert(TargetPointerSize != 0);
+    _hash = compute_hash();
   }
 
   PointerType(const PointerType&) = default;
@@ -295,7 +496,7 @@ struct PointerType : DataType {
   ~PointerType();
 
   TypeKind kind() const override;
-  size_t hash() const override;
+  size_t compute_hash() const;
   bool operator==(const PointerType &other) const;
 };
 
@@ -324,7 +525,7 @@ struct ArrayType : DataType {
   ~ArrayType();
 
   TypeKind kind() const override;
-  size_t hash() const override;
+  size_t compute_hash() const;
   bool operator==(const ArrayType &other) const;
 };
 
@@ -332,35 +533,61 @@ struct StructField {
   InternString name;
   const DataType *type;
   unsigned offset;
+  // A hint for the compact layout to put this field after the others, so
+  // the fields that are used together share fewer cache lines.
+  bool cold;
 
-  StructField(InternString name, const DataType *type)
+  StructField(InternString name, const DataType *type, bool cold = false)
     : name{name}
     , type{type}
     , offset{0}
+    , cold{cold}
   {}
 
   StructField(const DataType *type)
     : name{}
     , type{type}
     , offset{0}
+    , cold{false}
   {}
 
   StructField(const StructField&) = default;
   StructField &operator=(const StructField&) = default;
 };
 
+enum class StructLayout : uint8_t {
+  // Fields in the order they were declared, padded as needed.
+  Declared,
+  // Hot fields before cold ones, each by decreasing alignment, with
+  // smaller fields moved into any padding left behind.
+  Compact,
+};
+
+// Fields always stay in declaration order, so a field's index means the
+// same thing in every layout; only the offsets move. `order` lists the
+// field indices by offset, for anything that walks memory in order.
 struct StructType : DataType {
   typedef boost::container::small_vector<StructField, 2> FieldVector;
+  typedef boost::container::small_vector<unsigned, 2> OrderVector;
 
   FieldVector fields;
+  StructLayout layout;
+  OrderVector order;
 
   static unsigned get_align(const FieldVector &field_types);
-  static unsigned align_fields(FieldVector &field_types);
+  // Sets each field's offset and fills in `order`. Returns the size.
+  static unsigned align_fields(FieldVector &field_types, StructLayout layout,
+                               OrderVector &order);
 
-  StructType(FieldVector fields)
-    : DataType{align_fields(fields), get_align(fields)}
+  StructType(FieldVector fields, StructLayout layout = StructLayout::Declared)
+    : DataType{0}
     , fields{std::move(fields)}
-  {}
+    , layout{layout}
+  {
+    size = align_fields(this->fields, layout, order);
+    align = get_align(this->fields);
+    _hash = compute_hash();
+  }
 
   StructType(StructType&&) = default;
   StructType &operator=(StructType&&) = default;
@@ -368,7 +595,7 @@ struct StructType : DataType {
   ~StructType();
 
   TypeKind kind() const override;
-  size_t hash() const override;
+  size_t compute_hash() const;
   bool operator==(const StructType &other) const;
 };
 
@@ -399,7 +626,9 @@ struct FunctionType : Type {
   FunctionType(const DataType *return_type, ArgVector arg_types)
     : return_type{return_type}
     , arg_types{std::move(arg_types)}
-  {}
+  {
+    _hash = compute_hash();
+  }
 
   FunctionType(FunctionType&&) = default;
   FunctionType &operator=(FunctionType&&) = default;
@@ -407,52 +636,29 @@ struct FunctionType : Type {
   ~FunctionType();
 
   TypeKind kind() const override;
-  size_t hash() const override;
+  size_t compute_hash() const;
   bool operator==(const FunctionType &other) const;
 
   // Compares only argument types, not names.
   bool are_types_same(const FunctionType &other) const;
 };
 
-} // namespace lava::lang
-
-namespace std {
-  template<> struct hash<lava::lang::PointerType> {
-    size_t operator()(const lava::lang::PointerType &t) const {
-      return t.hash();
-    }
-  };
-  template<> struct hash<lava::lang::ArrayType> {
-    size_t operator()(const lava::lang::ArrayType &t) const {
-      return t.hash();
-    }
-  };
-  template<> struct hash<lava::lang::StructType> {
-    size_t operator()(const lava::lang::StructType &t) const {
-      return t.hash();
-    }
-  };
-  template<> struct hash<lava::lang::FunctionType> {
-    size_t operator()(const lava::lang::FunctionType &t) const {
-      return t.hash();
-    }
-  };
-}
-
-namespace lava::lang {
-
 struct TypeAlias : Symbol {
   const Type *type;
   bool is_newtype;
 
   TypeAlias(InternString name, const Type *type, bool is_newtype = false)
-    : Symbol{name}
+    : Symbol{SymbolKind::TypeAlias, name}
     , type{type}
     , is_newtype{is_newtype}
   {}
 
   TypeAlias(const TypeAlias&) = default;
   TypeAlias &operator=(const TypeAlias&) = default;
+
+  static bool classof(const Symbol &symbol) {
+    return symbol.kind() == SymbolKind::TypeAlias;
+  }
 };
 
 struct BasicBlock {
@@ -472,6 +678,10 @@ private:
 public:
   Function(InternString name, const FunctionType *type, Namespace &current_ns);
 
+  static bool classof(const Symbol &symbol) {
+    return symbol.kind() == SymbolKind::Function;
+  }
+
   const FunctionType *type() const { return _type; }
 
   // To be used to set an equivalent type with only differering arg names.
@@ -493,8 +703,17 @@ public:
     return r;
   }
 
+  unsigned register_count() const { return _registers; }
+  void set_register_count(unsigned registers) { _registers = registers; }
+
   std::vector<BasicBlock> &basicblocks() { return _bbs; }
   const std::vector<BasicBlock> &basicblocks() const { return _bbs; }
+
+  // Drops the IR so that it can be emitted again.
+  void clear_ir() {
+    _bbs.clear();
+    _registers = 0;
+  }
 };
 
 struct Variable : Symbol {
@@ -503,29 +722,70 @@ private:
 
 public:
   Variable(InternString name, const DataType *type)
-    : Symbol{name}
+    : Symbol{SymbolKind::Variable, name}
     , _type{type}
   {}
 
+  static bool classof(const Symbol &symbol) {
+    return symbol.kind() == SymbolKind::Variable;
+  }
+
   const DataType *type() const { return _type; }
 };
 
-struct SymbolTable {
+// Hash-conses derived types. Each distinct type is moved into an arena
+// once and found again by its cached hash and a one-level compare, so two
+// types from the same table are equal exactly when their pointers are.
+struct TypeTable {
 private:
-  struct string_hash {
-    using hash_type = std::hash<std::string_view>;
-    using is_transparent = void;
+  struct Arena {
+    lava_arena arena;
+    Arena() { lava_arena_init(&arena); }
+    ~Arena() { lava_arena_fini(&arena); }
+  };
 
-    size_t operator()(const char* str) const        { return hash_type{}(str); }
-    size_t operator()(std::string_view str) const   { return hash_type{}(str); }
-    size_t operator()(std::string const& str) const { return hash_type{}(str); }
+  struct Slot {
+    size_t hash;
+    const Type *type;
   };
 
-  std::string _the_string;
-  std::unordered_map<std::string, InternString, string_hash, std::equal_to<>>
-    _string_map;
+  Arena _arena;
+  // Every type in the arena, to run destructors.
+  std::vector<Type*> _types;
+  std::vector<Slot> _slots;
+
+  const Type *find(const Type &type) const;
+  void insert(Type *type);
+
+public:
+  TypeTable();
+  ~TypeTable();
+
+  TypeTable(const TypeTable&) = delete;
+  TypeTable &operator=(const TypeTable&) = delete;
+
+  template<class T>
+  const T &intern(T &&type) {
+    if (const Type *found = find(type)) {
+      return static_cast<const T&>(*found);
+    }
+    void *p = lava_arena_alloc(&_arena.arena, alignof(T), sizeof(T));
+    T *canonical = new(p) T{std::move(type)};
+    insert(canonical);
+    return *canonical;
+  }
+
+  size_t size() const { return _types.size(); }
+};
+
+struct SymbolTable {
+private:
+  StringInterner _strings;
+  // Used instead of `_strings` when names are shared between threads.
+  ConcurrentStringInterner *_shared_strings;
   size_t _anon_index;
   Namespace _global_ns;
+  size_t _builtin_symbols;
 
   NeverType _never_type;
   AnyType _any_type;
@@ -547,23 +807,37 @@ private:
   FloatType _float_type;
   FloatType _double_type;
 
-  mutable std::unordered_set<PointerType> _pointer_types;
-  mutable std::unordered_set<ArrayType> _array_types;
-  mutable std::unordered_set<StructType> _struct_types;
-  mutable std::unordered_set<FunctionType> _function_types;
+  mutable TypeTable _types;
 
   void add_base_types();
 
 public:
-  SymbolTable();
+  // With `shared_strings`, names are interned there instead, so tables
+  // built on different threads can compare names directly. The table
+  // itself is still for one thread at a time.
+  explicit SymbolTable(ConcurrentStringInterner *shared_strings = nullptr);
+
+  InternString intern(std::string_view str) {
+    if (_shared_strings) {
+      return _shared_strings->intern(str);
+    }
+    return _strings.intern(str);
+  }
 
-  InternString intern(std::string_view str);
-  std::string_view get_string(InternString str);
+  std::string_view get_string(InternString str) const {
+    if (_shared_strings) {
+      return _shared_strings->get(str);
+    }
+    return _strings.get(str);
+  }
   InternString get_anon_name();
 
   Namespace &global_namespace() { return _global_ns; }
   const Namespace &global_namespace() const { return _global_ns; }
 
+  // The global namespace starts with this many built in type aliases.
+  size_t builtin_symbol_count() const { return _builtin_symbols; }
+
   const NeverType &never_type() const { return _never_type; }
   const AnyType &any_type() const { return _any_type; }
   const VoidType &void_type() const { return _void_type; }
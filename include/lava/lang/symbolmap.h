@@ -0,0 +1,124 @@
+#ifndef LAVA_LANG_SYMBOLMAP_H_
+#define LAVA_LANG_SYMBOLMAP_H_
+
+#include "interner.h"
+#include "lava/util/hash.h"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace lava::lang {
+
+struct Symbol;
+
+// A flat map from names to symbols, laid out like a SwissTable. Slots come
+// in groups of eight with one control byte each: 0x80 for empty, or the
+// low 7 bits of the key's hash. A lookup reads a group's control bytes as
+// one word and only compares keys where those bits match, so a miss
+// usually costs one load. Values must not be null, and entries are never
+// erased one at a time, though a key can be given a new value.
+struct SymbolMap {
+  static constexpr size_t GroupSize = 8;
+
+private:
+  static constexpr uint8_t Empty = 0x80;
+  static constexpr uint64_t LowBits = 0x0101010101010101ull;
+  static constexpr uint64_t HighBits = 0x8080808080808080ull;
+
+  struct Slot {
+    InternString key;
+    Symbol *value;
+  };
+
+  std::vector<uint8_t> _ctrl;
+  std::vector<Slot> _slots;
+  size_t _size = 0;
+
+  static uint64_t hash(InternString key) {
+    return hash_mix((uint64_t)key.index * 0x9E3779B97F4A7C15ull ^ key.size);
+  }
+
+  size_t group_mask() const { return _ctrl.size() / GroupSize - 1; }
+
+  // Byte i of the group is byte i of the word, counting from the low end.
+  uint64_t load_group(size_t group) const {
+    const uint8_t *ctrl = &_ctrl[group * GroupSize];
+    if constexpr (std::endian::native == std::endian::little) {
+      uint64_t word;
+      std::memcpy(&word, ctrl, sizeof(word));
+      return word;
+    } else {
+      uint64_t word = 0;
+      for (size_t i = 0; i < GroupSize; ++i) {
+        word |= (uint64_t)ctrl[i] << (i * 8);
+      }
+      return word;
+    }
+  }
+
+  // High bit set in each byte that may equal `h2`. False positives are
+  // possible after a real match; keys are compared anyway.
+  static uint64_t match(uint64_t word, uint8_t h2) {
+    uint64_t x = word ^ (LowBits * h2);
+    return (x - LowBits) & ~x & HighBits;
+  }
+
+  void grow();
+
+  Slot *find_slot(InternString key) const {
+    if (_ctrl.empty()) {
+      return nullptr;
+    }
+    uint64_t h = hash(key);
+    uint8_t h2 = h & 0x7F;
+    size_t mask = group_mask();
+    size_t group = (h >> 7) & mask;
+    for (size_t step = 1;; group = (group + step++) & mask) {
+      uint64_t word = load_group(group);
+      for (uint64_t m = match(word, h2); m; m &= m - 1) {
+        auto const &slot = _slots[group * GroupSize
+                                  + std::countr_zero(m) / 8];
+        if (slot.key == key) {
+          return const_cast<Slot*>(&slot);
+        }
+      }
+      if (word & HighBits) {
+        return nullptr;
+      }
+    }
+  }
+
+public:
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  Symbol *find(InternString key) const {
+    auto *slot = find_slot(key);
+    return slot ? slot->value : nullptr;
+  }
+
+  bool contains(InternString key) const { return find(key) != nullptr; }
+
+  // Returns false, leaving the map unchanged, if `key` is already there.
+  bool insert(InternString key, Symbol *value);
+
+  // Returns false if `key` is not there.
+  bool assign(InternString key, Symbol *value) {
+    if (auto *slot = find_slot(key)) {
+      slot->value = value;
+      return true;
+    }
+    return false;
+  }
+
+  void clear() {
+    _ctrl.clear();
+    _slots.clear();
+    _size = 0;
+  }
+};
+
+} // namespace lava::lang
+
+#endif /* LAVA_LANG_SYMBOLMAP_H_ */
@@ -3,17 +3,16 @@
 
 #include <string>
 #include <string_view>
+#include <vector>
+#include <cstddef>
 #include <cstdint>
 
 namespace lava::lang {
 
-struct SourceDoc {
-  std::string name;
-  std::string content;
-};
-
 struct SourceLoc {
   size_t offset;
+  // Line and column are 1-based. Both are 0 if the location was produced
+  // without line tracking; see `SourceDoc::resolve`.
   uint32_t line;
   uint32_t column;
 
@@ -22,6 +21,30 @@ struct SourceLoc {
     , line{1}
     , column{1}
   {}
+
+  bool is_resolved() const { return line != 0; }
+};
+
+// Replaces `removed` bytes at `offset` with `inserted`.
+struct TextEdit {
+  size_t offset;
+  size_t removed;
+  std::string_view inserted;
+};
+
+struct SourceDoc {
+  std::string name;
+  std::string content;
+
+  // Offset of the first byte of each line, built on first use. Must be
+  // cleared if `content` changes other than through `apply`.
+  mutable std::vector<size_t> line_starts{};
+
+  // Returns `loc` with its line and column filled in from its offset.
+  SourceLoc resolve(SourceLoc loc) const;
+
+  // Edits `content`, keeping `line_starts` up to date.
+  void apply(const TextEdit &edit);
 };
 
 #define LAVA_TOKENS \
@@ -98,6 +121,10 @@ struct SourceLoc {
   X(SlashEq) \
   X(Question) \
   \
+  LAVA_KEYWORDS(X)
+
+// Keywords are spelled as their lowercase token name.
+#define LAVA_KEYWORDS(X) \
   X(If) \
   X(Else) \
   X(Switch) \
@@ -136,6 +163,15 @@ struct Token {
     return std::string_view(doc->content)
       .substr(start.offset, end.offset - start.offset);
   }
+
+  // Moves the token by `delta` bytes. Its line and column become
+  // unresolved.
+  void shift(ptrdiff_t delta) {
+    start.offset += delta;
+    start.line = start.column = 0;
+    end.offset += delta;
+    end.line = end.column = 0;
+  }
 };
 
 
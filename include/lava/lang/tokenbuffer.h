@@ -0,0 +1,111 @@
+#ifndef LAVA_LANG_TOKENBUFFER_H_
+#define LAVA_LANG_TOKENBUFFER_H_
+
+#include "token.h"
+#include <vector>
+
+namespace lava {
+  class ThreadPool;
+}
+
+namespace lava::lang {
+
+// The tokens of a document (or a range of one) stored as parallel arrays:
+// 9 bytes per token instead of a full `Token`. Locations are offsets only;
+// use `SourceDoc::resolve` to get lines and columns.
+struct TokenBuffer {
+private:
+  // Token kinds fit in 7 bits; the high bit marks trivia (whitespace and
+  // comments) and TkInvalid is stored as 0x7F.
+  static constexpr uint8_t TriviaBit = 0x80;
+  static constexpr uint8_t InvalidKind = 0x7F;
+
+  const SourceDoc *_doc;
+  std::vector<uint8_t> _kinds;
+  std::vector<uint32_t> _starts;
+  std::vector<uint32_t> _lengths;
+
+public:
+  // Lexes the whole document. The last token is always TkEof.
+  explicit TokenBuffer(const SourceDoc &doc);
+
+  // Lexes the byte range [begin, end). The last token is TkEof at `end`.
+  TokenBuffer(const SourceDoc &doc, size_t begin, size_t end);
+
+  // Lexes the whole document on a thread pool. The document is split into
+  // chunks at line starts and each chunk is lexed on the assumption that no
+  // token crosses into it. A sequential pass then joins the chunks and
+  // relexes from the true token boundary where that guess was wrong, such
+  // as a chunk that starts inside a block comment or string. The result is
+  // identical to sequential lexing.
+  TokenBuffer(const SourceDoc &doc, ThreadPool &pool,
+              size_t min_chunk_size = 256 * 1024);
+
+  const SourceDoc &doc() const { return *_doc; }
+
+  size_t size() const { return _kinds.size(); }
+
+  int kind(size_t i) const {
+    uint8_t k = _kinds[i] & ~TriviaBit;
+    return k == InvalidKind ? (int)TkInvalid : (int)k;
+  }
+
+  bool is_trivia(size_t i) const { return _kinds[i] & TriviaBit; }
+
+  size_t start(size_t i) const { return _starts[i]; }
+  size_t length(size_t i) const { return _lengths[i]; }
+  size_t end(size_t i) const { return (size_t)_starts[i] + _lengths[i]; }
+
+  std::string_view text(size_t i) const {
+    return std::string_view(_doc->content).substr(_starts[i], _lengths[i]);
+  }
+
+  // Returns the first non-trivia token at or after `i`. The final TkEof is
+  // never trivia, so this stays in bounds for any `i < size()`.
+  size_t skip_trivia(size_t i) const {
+    while (_kinds[i] & TriviaBit) {
+      ++i;
+    }
+    return i;
+  }
+
+  // Returns the first token that starts at or after `offset`.
+  size_t find(size_t offset) const;
+
+  // Builds a full token with unresolved line/column.
+  Token token(size_t i) const;
+
+  // Tokens [first, first + removed) were replaced by
+  // [first, first + inserted).
+  struct Splice {
+    size_t first;
+    size_t removed;
+    size_t inserted;
+  };
+
+  // Updates the buffer after `edit` has been applied to the document.
+  // Lexing restarts at the first token that could have seen the edited
+  // bytes and stops as soon as a new token starts where a shifted old token
+  // did; the lexer keeps no state between tokens, so everything after that
+  // point is unchanged. A long block comment or string that the edit opens
+  // or closes is relexed in full, since its end moves.
+  Splice relex(const TextEdit &edit);
+
+private:
+  friend struct ParseCache;
+
+  TokenBuffer(const SourceDoc &doc, std::vector<uint8_t> kinds,
+              std::vector<uint32_t> starts, std::vector<uint32_t> lengths)
+    : _doc{&doc}
+    , _kinds{std::move(kinds)}
+    , _starts{std::move(starts)}
+    , _lengths{std::move(lengths)}
+  {}
+
+  static uint8_t pack_kind(int what);
+  void lex(size_t begin, size_t end);
+};
+
+} // namespace lava::lang
+
+#endif // LAVA_LANG_TOKENBUFFER_H_
@@ -5,6 +5,8 @@
 
 namespace lava::lang {
 
+// Function bodies skipped with Parser::PF_LazyBodies are not visited;
+// expand them first to include them.
 struct NodeVisitor {
   virtual void visit(const Document &doc);
 
@@ -35,6 +37,204 @@ struct NodeVisitor {
   virtual void visit(const ArgDecl &arg);
 };
 
+// Like NodeVisitor, but dispatch is resolved at compile time, so the kind
+// switch calls straight into `Derived`'s overloads and can be inlined.
+// `Derived` hides these overloads by declaring its own, so it should bring
+// them back with `using StaticVisitor::visit;`. Calling
+// `StaticVisitor::visit(node)` runs the default traversal for that node.
+template<typename Derived>
+struct StaticVisitor {
+private:
+  Derived &derived() { return static_cast<Derived&>(*this); }
+
+public:
+  void visit(const Document &doc) {
+    for (auto const &item : doc.items()) {
+      derived().visit(*item);
+    }
+  }
+
+  void visit(const Expr &expr) {
+    switch (expr.expr_kind()) {
+    case ExprKind::Literal:
+      derived().visit(static_cast<const LiteralExpr&>(expr));
+      break;
+    case ExprKind::Ident:
+      derived().visit(static_cast<const IdentExpr&>(expr));
+      break;
+    case ExprKind::Prefix:
+      derived().visit(static_cast<const PrefixExpr&>(expr));
+      break;
+    case ExprKind::Postfix:
+      derived().visit(static_cast<const PostfixExpr&>(expr));
+      break;
+    case ExprKind::Binary:
+      derived().visit(static_cast<const BinaryExpr&>(expr));
+      break;
+    case ExprKind::Paren:
+      derived().visit(static_cast<const ParenExpr&>(expr));
+      break;
+    case ExprKind::Invoke:
+      derived().visit(static_cast<const InvokeExpr&>(expr));
+      break;
+    case ExprKind::Scope:
+      derived().visit(static_cast<const ScopeExpr&>(expr));
+      break;
+    case ExprKind::Return:
+      derived().visit(static_cast<const ReturnExpr&>(expr));
+      break;
+    case ExprKind::If:
+      derived().visit(static_cast<const IfExpr&>(expr));
+      break;
+    case ExprKind::While:
+      derived().visit(static_cast<const WhileExpr&>(expr));
+      break;
+    case ExprKind::Loop:
+      derived().visit(static_cast<const LoopExpr&>(expr));
+      break;
+    case ExprKind::BreakContinue:
+      derived().visit(static_cast<const BreakContinueExpr&>(expr));
+      break;
+    }
+  }
+
+  void visit(const LiteralExpr &) {}
+
+  void visit(const IdentExpr &) {}
+
+  void visit(const PrefixExpr &expr) {
+    derived().visit(*expr.expr());
+  }
+
+  void visit(const PostfixExpr &expr) {
+    derived().visit(*expr.expr());
+  }
+
+  void visit(const BinaryExpr &expr) {
+    derived().visit(*expr.left());
+    derived().visit(*expr.right());
+  }
+
+  void visit(const ParenExpr &expr) {
+    derived().visit(*expr.expr());
+  }
+
+  void visit(const InvokeExpr &expr) {
+    derived().visit(*expr.expr());
+    for (auto const &arg : expr.args()) {
+      derived().visit(*arg.value);
+    }
+  }
+
+  void visit(const ScopeExpr &expr) {
+    for (auto const &inner_expr : expr.exprs()) {
+      derived().visit(*inner_expr.value);
+    }
+  }
+
+  void visit(const ReturnExpr &expr) {
+    if (expr.expr()) {
+      derived().visit(*expr.expr());
+    }
+  }
+
+  void visit(const IfExpr &expr) {
+    derived().visit(*expr.expr());
+    derived().visit(expr.scope());
+    for (auto const &else_ : expr.elses()) {
+      if (else_.expr()) {
+        derived().visit(*else_.expr());
+      }
+      derived().visit(else_.scope());
+    }
+  }
+
+  void visit(const WhileExpr &expr) {
+    derived().visit(*expr.expr());
+    derived().visit(expr.scope());
+  }
+
+  void visit(const LoopExpr &expr) {
+    derived().visit(expr.scope());
+  }
+
+  void visit(const BreakContinueExpr &expr) {
+    if (expr.expr()) {
+      derived().visit(*expr.expr());
+    }
+  }
+
+  void visit(const Item &item) {
+    switch (item.item_kind()) {
+    case ItemKind::Empty:
+      derived().visit(static_cast<const EmptyItem&>(item));
+      break;
+    case ItemKind::Expr:
+      derived().visit(static_cast<const ExprItem&>(item));
+      break;
+    case ItemKind::VarDecl:
+      derived().visit(static_cast<const VarDeclItem&>(item));
+      break;
+    case ItemKind::FunDecl:
+      derived().visit(static_cast<const FunDeclItem&>(item));
+      break;
+    case ItemKind::FunDef:
+      derived().visit(static_cast<const FunDefItem&>(item));
+      break;
+    case ItemKind::StructDef:
+      derived().visit(static_cast<const StructDefItem&>(item));
+      break;
+    }
+  }
+
+  void visit(const EmptyItem &) {}
+
+  void visit(const ExprItem &item) {
+    derived().visit(*item.expr());
+  }
+
+  void visit(const VarDeclItem &item) {
+    derived().visit(*item.type());
+    for (auto const &decl : item.decls()) {
+      derived().visit(decl.value);
+    }
+  }
+
+  void visit(const FunDeclItem &item) {
+    for (auto const &arg : item.args()) {
+      derived().visit(arg.value);
+    }
+    if (item.return_type()) {
+      derived().visit(*item.return_type());
+    }
+  }
+
+  void visit(const FunDefItem &item) {
+    for (auto const &arg : item.args()) {
+      derived().visit(arg.value);
+    }
+    if (item.return_type()) {
+      derived().visit(*item.return_type());
+    }
+    if (item.is_body_parsed()) {
+      derived().visit(item.body());
+    }
+  }
+
+  void visit(const StructDefItem &item) {
+    for (auto const &var : item.vars()) {
+      derived().visit(*var.type());
+      for (auto const &decl : var.decls()) {
+        derived().visit(decl.value);
+      }
+    }
+  }
+
+  void visit(const VarDecl &) {}
+
+  void visit(const ArgDecl &) {}
+};
+
 } // namespace lava::lang
 
 #endif /* LAVA_LANG_VISITOR_H_ */
@@ -0,0 +1,277 @@
+#ifndef LAVA_LANG_WALKER_H_
+#define LAVA_LANG_WALKER_H_
+
+#include "nodes.h"
+#include <vector>
+
+namespace lava::lang {
+
+// Walks an expression tree with an explicit stack instead of recursion, so
+// that a long operator chain or deep nesting can't overflow the call stack.
+// `Derived` gets three hooks per node type, resolved at compile time:
+//
+//   bool pre_visit(const T&)            before the children; returning
+//                                       false skips them
+//   void in_visit(const T&, size_t)     after the child in the given slot
+//   void post_visit(const T&)           after the children
+//
+// `Derived` should bring back the defaults it doesn't override with
+// `using ExprWalker::pre_visit;` and so on.
+//
+// Children are numbered by slot, in evaluation order. Empty optional slots
+// are skipped and get no in_visit.
+//
+//   Prefix, Postfix, Paren, Return, BreakContinue
+//                  0: operand
+//   Binary         0: left, 1: right
+//   Invoke         0..n-1: arguments, n: callee
+//   Scope          0..n-1: expressions
+//   If             0: condition, 1: scope, 2 + 2k: else k's condition,
+//                  3 + 2k: else k's scope
+//   While          0: condition, 1: scope
+//   Loop           0: scope
+template<typename Derived>
+struct ExprWalker {
+private:
+  struct Frame {
+    const Expr *expr;
+    size_t slot;
+  };
+
+  Derived &derived() { return static_cast<Derived&>(*this); }
+
+public:
+  void walk(const Expr &root) {
+    std::vector<Frame> stack;
+    const Expr *expr = &root;
+    while (true) {
+      if (pre(*expr)) {
+        Frame frame{expr, 0};
+        if (const Expr *child = next_child(frame)) {
+          stack.push_back(frame);
+          expr = child;
+          continue;
+        }
+      }
+      post(*expr);
+
+      // Climb until some ancestor has another child to visit.
+      expr = nullptr;
+      while (!stack.empty()) {
+        Frame &frame = stack.back();
+        in(*frame.expr, frame.slot);
+        ++frame.slot;
+        if ((expr = next_child(frame))) {
+          break;
+        }
+        const Expr *done = frame.expr;
+        stack.pop_back();
+        post(*done);
+      }
+      if (!expr) {
+        return;
+      }
+    }
+  }
+
+  bool pre_visit(const LiteralExpr &) { return true; }
+  bool pre_visit(const IdentExpr &) { return true; }
+  bool pre_visit(const PrefixExpr &) { return true; }
+  bool pre_visit(const PostfixExpr &) { return true; }
+  bool pre_visit(const BinaryExpr &) { return true; }
+  bool pre_visit(const ParenExpr &) { return true; }
+  bool pre_visit(const InvokeExpr &) { return true; }
+  bool pre_visit(const ScopeExpr &) { return true; }
+  bool pre_visit(const ReturnExpr &) { return true; }
+  bool pre_visit(const IfExpr &) { return true; }
+  bool pre_visit(const WhileExpr &) { return true; }
+  bool pre_visit(const LoopExpr &) { return true; }
+  bool pre_visit(const BreakContinueExpr &) { return true; }
+
+  void in_visit(const PrefixExpr &, size_t) {}
+  void in_visit(const PostfixExpr &, size_t) {}
+  void in_visit(const BinaryExpr &, size_t) {}
+  void in_visit(const ParenExpr &, size_t) {}
+  void in_visit(const InvokeExpr &, size_t) {}
+  void in_visit(const ScopeExpr &, size_t) {}
+  void in_visit(const ReturnExpr &, size_t) {}
+  void in_visit(const IfExpr &, size_t) {}
+  void in_visit(const WhileExpr &, size_t) {}
+  void in_visit(const LoopExpr &, size_t) {}
+  void in_visit(const BreakContinueExpr &, size_t) {}
+
+  void post_visit(const LiteralExpr &) {}
+  void post_visit(const IdentExpr &) {}
+  void post_visit(const PrefixExpr &) {}
+  void post_visit(const PostfixExpr &) {}
+  void post_visit(const BinaryExpr &) {}
+  void post_visit(const ParenExpr &) {}
+  void post_visit(const InvokeExpr &) {}
+  void post_visit(const ScopeExpr &) {}
+  void post_visit(const ReturnExpr &) {}
+  void post_visit(const IfExpr &) {}
+  void post_visit(const WhileExpr &) {}
+  void post_visit(const LoopExpr &) {}
+  void post_visit(const BreakContinueExpr &) {}
+
+private:
+  // Advances `frame.slot` to the next filled slot and returns its child, or
+  // returns null when there are none left.
+  static const Expr *next_child(Frame &frame) {
+    for (size_t count = slot_count(*frame.expr); frame.slot < count;
+         ++frame.slot) {
+      if (const Expr *child = child_at(*frame.expr, frame.slot)) {
+        return child;
+      }
+    }
+    return nullptr;
+  }
+
+  static size_t slot_count(const Expr &expr) {
+    switch (expr.expr_kind()) {
+    case ExprKind::Literal:
+    case ExprKind::Ident:
+      return 0;
+    case ExprKind::Prefix:
+    case ExprKind::Postfix:
+    case ExprKind::Paren:
+    case ExprKind::Return:
+    case ExprKind::Loop:
+    case ExprKind::BreakContinue:
+      return 1;
+    case ExprKind::Binary:
+    case ExprKind::While:
+      return 2;
+    case ExprKind::Invoke:
+      return static_cast<const InvokeExpr&>(expr).args().size() + 1;
+    case ExprKind::Scope:
+      return static_cast<const ScopeExpr&>(expr).exprs().size();
+    case ExprKind::If:
+      return 2 + 2 * static_cast<const IfExpr&>(expr).elses().size();
+    }
+    return 0;
+  }
+
+  static const Expr *child_at(const Expr &expr, size_t slot) {
+    switch (expr.expr_kind()) {
+    case ExprKind::Literal:
+    case ExprKind::Ident:
+      return nullptr;
+    case ExprKind::Prefix:
+      return static_cast<const PrefixExpr&>(expr).expr();
+    case ExprKind::Postfix:
+      return static_cast<const PostfixExpr&>(expr).expr();
+    case ExprKind::Paren:
+      return static_cast<const ParenExpr&>(expr).expr();
+    case ExprKind::Return:
+      return static_cast<const ReturnExpr&>(expr).expr();
+    case ExprKind::BreakContinue:
+      return static_cast<const BreakContinueExpr&>(expr).expr();
+    case ExprKind::Loop:
+      return &static_cast<const LoopExpr&>(expr).scope();
+    case ExprKind::Binary:
+      {
+        auto &binary = static_cast<const BinaryExpr&>(expr);
+        return slot == 0 ? binary.left() : binary.right();
+      }
+    case ExprKind::While:
+      {
+        auto &while_ = static_cast<const WhileExpr&>(expr);
+        return slot == 0 ? while_.expr() : &while_.scope();
+      }
+    case ExprKind::Invoke:
+      {
+        auto &invoke = static_cast<const InvokeExpr&>(expr);
+        return slot < invoke.args().size()
+          ? invoke.args()[slot].value.get()
+          : invoke.expr();
+      }
+    case ExprKind::Scope:
+      return static_cast<const ScopeExpr&>(expr).exprs()[slot].value.get();
+    case ExprKind::If:
+      {
+        auto &if_ = static_cast<const IfExpr&>(expr);
+        if (slot < 2) {
+          return slot == 0 ? if_.expr() : &if_.scope();
+        }
+        auto &else_ = if_.elses()[(slot - 2) / 2];
+        return slot % 2 == 0 ? else_.expr() : &else_.scope();
+      }
+    }
+    return nullptr;
+  }
+
+  bool pre(const Expr &expr) {
+    switch (expr.expr_kind()) {
+#define LAVA_WALKER_CASE(Kind) \
+    case ExprKind::Kind: \
+      return derived().pre_visit(static_cast<const Kind##Expr&>(expr));
+    LAVA_WALKER_CASE(Literal)
+    LAVA_WALKER_CASE(Ident)
+    LAVA_WALKER_CASE(Prefix)
+    LAVA_WALKER_CASE(Postfix)
+    LAVA_WALKER_CASE(Binary)
+    LAVA_WALKER_CASE(Paren)
+    LAVA_WALKER_CASE(Invoke)
+    LAVA_WALKER_CASE(Scope)
+    LAVA_WALKER_CASE(Return)
+    LAVA_WALKER_CASE(If)
+    LAVA_WALKER_CASE(While)
+    LAVA_WALKER_CASE(Loop)
+    LAVA_WALKER_CASE(BreakContinue)
+#undef LAVA_WALKER_CASE
+    }
+    return false;
+  }
+
+  void in(const Expr &expr, size_t slot) {
+    switch (expr.expr_kind()) {
+    case ExprKind::Literal:
+    case ExprKind::Ident:
+      break;
+#define LAVA_WALKER_CASE(Kind) \
+    case ExprKind::Kind: \
+      derived().in_visit(static_cast<const Kind##Expr&>(expr), slot); \
+      break;
+    LAVA_WALKER_CASE(Prefix)
+    LAVA_WALKER_CASE(Postfix)
+    LAVA_WALKER_CASE(Binary)
+    LAVA_WALKER_CASE(Paren)
+    LAVA_WALKER_CASE(Invoke)
+    LAVA_WALKER_CASE(Scope)
+    LAVA_WALKER_CASE(Return)
+    LAVA_WALKER_CASE(If)
+    LAVA_WALKER_CASE(While)
+    LAVA_WALKER_CASE(Loop)
+    LAVA_WALKER_CASE(BreakContinue)
+#undef LAVA_WALKER_CASE
+    }
+  }
+
+  void post(const Expr &expr) {
+    switch (expr.expr_kind()) {
+#define LAVA_WALKER_CASE(Kind) \
+    case ExprKind::Kind: \
+      derived().post_visit(static_cast<const Kind##Expr&>(expr)); \
+      break;
+    LAVA_WALKER_CASE(Literal)
+    LAVA_WALKER_CASE(Ident)
+    LAVA_WALKER_CASE(Prefix)
+    LAVA_WALKER_CASE(Postfix)
+    LAVA_WALKER_CASE(Binary)
+    LAVA_WALKER_CASE(Paren)
+    LAVA_WALKER_CASE(Invoke)
+    LAVA_WALKER_CASE(Scope)
+    LAVA_WALKER_CASE(Return)
+    LAVA_WALKER_CASE(If)
+    LAVA_WALKER_CASE(While)
+    LAVA_WALKER_CASE(Loop)
+    LAVA_WALKER_CASE(BreakContinue)
+#undef LAVA_WALKER_CASE
+    }
+  }
+};
+
+} // namespace lava::lang
+
+#endif /* LAVA_LANG_WALKER_H_ */
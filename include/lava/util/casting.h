@@ -0,0 +1,56 @@
+#ifndef LAVA_UTIL_CASTING_H_
+#define LAVA_UTIL_CASTING_H_
+
+#include <cassert>
+#include <type_traits>
+
+namespace lava {
+
+namespace detail {
+  /// `To`, const if `From` is.
+  template<class To, class From>
+  using cast_result_t =
+    std::conditional_t<std::is_const_v<From>, const To, To>;
+} // namespace detail
+
+/// Checks the dynamic kind of `from` with `To::classof`, which reads a kind
+/// tag instead of walking RTTI.
+template<class To, class From>
+bool isa(const From &from) {
+  return To::classof(from);
+}
+
+/// @see `isa`. `from` must not be null.
+template<class To, class From>
+bool isa(const From *from) {
+  assert(from && "isa on null pointer");
+  return To::classof(*from);
+}
+
+/// Downcasts `from`, which must be a `To`.
+template<class To, class From>
+detail::cast_result_t<To, From> &cast(From &from) {
+  assert(isa<To>(from) && "cast to the wrong kind");
+  return static_cast<detail::cast_result_t<To, From>&>(from);
+}
+
+/// @see `cast`.
+template<class To, class From>
+detail::cast_result_t<To, From> *cast(From *from) {
+  assert(isa<To>(from) && "cast to the wrong kind");
+  return static_cast<detail::cast_result_t<To, From>*>(from);
+}
+
+/// Downcasts `from` if it is a `To`, otherwise returns null. Unlike LLVM's,
+/// this accepts null and returns it unchanged.
+template<class To, class From>
+detail::cast_result_t<To, From> *dyn_cast(From *from) {
+  if (from && To::classof(*from)) {
+    return static_cast<detail::cast_result_t<To, From>*>(from);
+  }
+  return nullptr;
+}
+
+} // namespace lava
+
+#endif // LAVA_UTIL_CASTING_H_
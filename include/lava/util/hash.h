@@ -0,0 +1,42 @@
+#ifndef LAVA_UTIL_HASH_H_
+#define LAVA_UTIL_HASH_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace lava {
+
+/// Finalizer from MurmurHash3; every input bit affects every output bit.
+constexpr uint64_t hash_mix(uint64_t h) noexcept {
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDull;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+/// A fast non-cryptographic hash of a byte string, read 8 bytes at a time.
+inline uint64_t hash_bytes(std::string_view bytes, uint64_t seed = 0) noexcept {
+  const char *p = bytes.data();
+  size_t size = bytes.size();
+  uint64_t h = hash_mix(seed ^ (size * 0x9E3779B97F4A7C15ull));
+  while (size >= 8) {
+    uint64_t word;
+    std::memcpy(&word, p, 8);
+    h = hash_mix(h ^ word) + 0x9E3779B97F4A7C15ull;
+    p += 8;
+    size -= 8;
+  }
+  if (size) {
+    uint64_t word = 0;
+    std::memcpy(&word, p, size);
+    h = hash_mix(h ^ word);
+  }
+  return h;
+}
+
+} // namespace lava
+
+#endif // LAVA_UTIL_HASH_H_
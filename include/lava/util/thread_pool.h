@@ -0,0 +1,170 @@
+#ifndef LAVA_UTIL_THREAD_POOL_H_
+#define LAVA_UTIL_THREAD_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lava {
+
+/// A fixed set of worker threads that run index-parallel loops.
+class ThreadPool {
+  struct Batch {
+    const std::function<void(size_t)> *task;
+    size_t count;
+    std::atomic<size_t> next{0};
+    size_t finished = 0;
+    std::exception_ptr error;
+  };
+
+  std::vector<std::thread> _threads;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _done;
+  Batch *_batch = nullptr;
+  unsigned _active = 0;
+  uint64_t _generation = 0;
+  bool _stop = false;
+
+  // Only one loop runs at a time.
+  std::mutex _run_mutex;
+
+  static inline thread_local bool t_is_worker = false;
+
+public:
+  /// \param threads The number of worker threads. The thread that calls
+  ///                `parallel_for` also does work, so 0 is valid and runs
+  ///                everything on the caller.
+  explicit ThreadPool(unsigned threads = default_threads()) {
+    _threads.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+      _threads.emplace_back([this] { worker(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock{_mutex};
+      _stop = true;
+    }
+    _wake.notify_all();
+    for (auto &thread : _threads) {
+      thread.join();
+    }
+  }
+
+  /// \return One less than the number of hardware threads.
+  static unsigned default_threads() {
+    return std::max(std::thread::hardware_concurrency(), 1u) - 1;
+  }
+
+  /// \return The number of threads that run a loop, including the caller.
+  unsigned concurrency() const { return (unsigned)_threads.size() + 1; }
+
+  /// Calls `fn(i)` for each i in [0, count) and waits for all of them.
+  /// If any call throws, the first exception is rethrown here. Calls from
+  /// inside a task run sequentially on the current thread.
+  template<class F>
+  void parallel_for(size_t count, F &&fn) {
+    if (count == 0) {
+      return;
+    }
+    if (_threads.empty() || count == 1 || t_is_worker) {
+      for (size_t i = 0; i < count; ++i) {
+        fn(i);
+      }
+      return;
+    }
+
+    std::function<void(size_t)> task = std::ref(fn);
+    Batch batch;
+    batch.task = &task;
+    batch.count = count;
+
+    std::lock_guard run_lock{_run_mutex};
+    {
+      std::lock_guard lock{_mutex};
+      _batch = &batch;
+      ++_generation;
+    }
+    _wake.notify_all();
+
+    run(batch);
+
+    std::unique_lock lock{_mutex};
+    _done.wait(lock, [&] {
+      return batch.finished == batch.count && _active == 0;
+    });
+    _batch = nullptr;
+    lock.unlock();
+
+    if (batch.error) {
+      std::rethrow_exception(batch.error);
+    }
+  }
+
+private:
+  void worker() {
+    t_is_worker = true;
+    uint64_t seen = 0;
+    std::unique_lock lock{_mutex};
+    while (true) {
+      _wake.wait(lock, [&] { return _stop || _generation != seen; });
+      if (_stop) {
+        return;
+      }
+      seen = _generation;
+      if (!_batch) {
+        continue;
+      }
+      Batch &batch = *_batch;
+      ++_active;
+      lock.unlock();
+      run(batch);
+      lock.lock();
+      if (--_active == 0) {
+        _done.notify_all();
+      }
+    }
+  }
+
+  void run(Batch &batch) {
+    size_t finished = 0;
+    std::exception_ptr error;
+    size_t i;
+    while ((i = batch.next.fetch_add(1, std::memory_order_relaxed))
+           < batch.count) {
+      try {
+        (*batch.task)(i);
+      } catch (...) {
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+      ++finished;
+    }
+
+    std::lock_guard lock{_mutex};
+    batch.finished += finished;
+    if (error && !batch.error) {
+      batch.error = error;
+    }
+    if (batch.finished == batch.count) {
+      _done.notify_all();
+    }
+  }
+};
+
+} // namespace lava
+
+#endif // LAVA_UTIL_THREAD_POOL_H_
@@ -228,3 +228,18 @@ char32_t Rope::operator[](size_t index) const {
   substr(ch, &bufsize, index, 1);
   return utf8_to_utf32(ch);
 }
+
+std::string_view Rope::chunk_iterator::operator*() const {
+  auto node = static_cast<const rope_node *>(_node);
+  return std::string_view(reinterpret_cast<const char *>(node->str),
+                          node->num_bytes);
+}
+
+Rope::chunk_iterator &Rope::chunk_iterator::operator++() {
+  _node = static_cast<const rope_node *>(_node)->nexts[0].node;
+  return *this;
+}
+
+Rope::chunk_iterator Rope::chunks_begin() const {
+  return chunk_iterator{&_c_rope->head};
+}
@@ -1,7 +1,12 @@
 #include "lava/lava.h"
 #include "lava/driver/cliparser.h"
 #include "lava/driver/options.h"
+#include "lava/lang/diagnostics.h"
+#include "lava/lang/parsecache.h"
+#include "lava/lang/parser.h"
 #include <fmt/format.h>
+#include <fstream>
+#include <optional>
 
 using namespace lava;
 using namespace lava::driver;
@@ -23,10 +28,44 @@ Options:
                     stdin is a tty. Necessary if specifying other scripts to
                     load on the command line.
   --lsp             Run in language server mode.
+  --cache-dir=DIR   Cache lexed and parsed sources in DIR, keyed by their
+                    content, so unchanged files skip the front end.
 )==="
   );
 }
 
+static std::optional<std::string>
+read_file(const std::filesystem::path &path) {
+  std::ifstream ifs{path, std::ios::in | std::ios::binary};
+  if (!ifs) {
+    return std::nullopt;
+  }
+  return std::string{std::istreambuf_iterator<char>{ifs}, {}};
+}
+
+// Lexes and parses a source, through the cache if there is one. Returns
+// false if the source can't be read or has errors.
+static bool parse_source(const std::filesystem::path &path,
+                         lang::ParseCache *cache) {
+  auto content = read_file(path);
+  if (!content) {
+    fmt::print(stderr, "Can't read {}.\n", path.string());
+    return false;
+  }
+  lang::SourceDoc doc{path.string(), std::move(content).value()};
+  lang::Diagnostics diagnostics;
+
+  bool ok;
+  if (cache) {
+    ok = cache->parse(doc, &diagnostics).tree != nullptr;
+  } else {
+    lang::TokenBuffer tokens{doc};
+    ok = lang::Parser{tokens, 0, &diagnostics}.parse_document() != nullptr;
+  }
+  diagnostics.print(stderr);
+  return ok;
+}
+
 #ifndef _WIN32
 int main(int argc, char **argv)
 #else
@@ -66,10 +105,17 @@ static int u8main(int argc, char **argv)
     fmt::print("TODO: Command line eval\n");
   }
 
+  std::optional<lang::ParseCache> cache;
+  if (!opts.cache_dir.empty()) {
+    cache.emplace(opts.cache_dir);
+  }
+
+  int status = 0;
   for (auto &source : opts.sources) {
     auto absolute_path = std::filesystem::absolute(source);
-    auto path_str = absolute_path.string();
-    fmt::print("TODO: Add source {}\n", path_str);
+    if (!parse_source(absolute_path, cache ? &*cache : nullptr)) {
+      status = 1;
+    }
   }
 
   if (opts.startup_mode == StartupModeInteractive) {
@@ -79,7 +125,7 @@ static int u8main(int argc, char **argv)
     fmt::print("TODO: Process files\n");
   }
 
-  return 0;
+  return status;
 }
 
 #ifdef _WIN32
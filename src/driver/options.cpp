@@ -99,6 +99,11 @@ noexcept {
     opt = CliOpt::Interactive;
   } else if (arg == "lsp"sv) {
     opt = CliOpt::LSPServer;
+  } else if (arg == "cache-dir"sv) {
+    opt = CliOpt::CacheDir;
+    if (!value_long(value) || value.empty()) {
+      return expected_option("directory"sv);
+    }
   } else {
     return invalid_option();
   }
@@ -154,6 +159,13 @@ int OptionsParser::apply_option(CliOpt opt, std::string_view value) noexcept {
     }
     _opts->startup_mode = StartupModeLSPServer;
     break;
+
+  case CliOpt::CacheDir:
+    if (!_opts->cache_dir.empty()) {
+      return duplicate_option();
+    }
+    _opts->cache_dir = value;
+    break;
   }
 
   return 0;
@@ -0,0 +1,88 @@
+#include "lava/lang/chunklexer.h"
+#include <algorithm>
+
+using namespace lava::lang;
+
+ChunkReader::~ChunkReader() {}
+
+std::string_view RopeChunkReader::next_chunk() {
+  while (_it != _end) {
+    auto chunk = *_it;
+    ++_it;
+    if (!chunk.empty()) {
+      return chunk;
+    }
+  }
+  return {};
+}
+
+ChunkLexer::ChunkLexer(const SourceDoc &doc, ChunkReader &reader,
+                       unsigned flags) noexcept
+  : _doc{&doc}
+  , _reader{&reader}
+  , _flags{flags}
+  , _window{}
+  , _window_base{0}
+  , _chunk{}
+  , _chunk_base{0}
+  , _done{false}
+  , _scratch{}
+  , _loc{}
+  , _text{}
+{
+  if (flags & Lexer::LF_OffsetsOnly) {
+    _loc.line = 0;
+    _loc.column = 0;
+  }
+}
+
+bool ChunkLexer::next_chunk() {
+  if (_done) {
+    return false;
+  }
+  auto chunk = _reader->next_chunk();
+  if (chunk.empty()) {
+    _done = true;
+    return false;
+  }
+  _chunk_base += _chunk.size();
+  _chunk = chunk;
+  return true;
+}
+
+Token ChunkLexer::lex() {
+  // Once past the stitched text, go back to lexing the chunk in place.
+  if (_window.data() != _chunk.data() && _loc.offset >= _chunk_base
+      && !_chunk.empty()) {
+    _window = _chunk;
+    _window_base = _chunk_base;
+  }
+  while (_loc.offset == _window_base + _window.size() && next_chunk()) {
+    _window = _chunk;
+    _window_base = _chunk_base;
+  }
+
+  while (true) {
+    Lexer lexer{*_doc, _window, _window_base, _loc, _flags};
+    Token token = lexer.lex();
+    size_t window_end = _window_base + _window.size();
+    if (_done || token.end.offset + Lexer::MaxLookahead <= window_end) {
+      _text = _window.substr(token.start.offset - _window_base,
+                             token.end.offset - token.start.offset);
+      _loc = token.end;
+      return token;
+    }
+
+    // The lexer may have stopped early or peeked at the end of the window.
+    // Lex the token again with more text after it, at least doubling the
+    // amount each time so that long comments stay linear.
+    std::string stitched{_window.substr(token.start.offset - _window_base)};
+    size_t target = std::max(stitched.size() * 2, stitched.size() + 1);
+    while (stitched.size() < target && next_chunk()) {
+      stitched.append(_chunk);
+    }
+    _scratch = std::move(stitched);
+    _window = _scratch;
+    _window_base = token.start.offset;
+  }
+}
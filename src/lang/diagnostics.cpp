@@ -0,0 +1,76 @@
+#include "lava/lang/diagnostics.h"
+#include <cstring>
+
+using namespace lava::lang;
+
+bool Diagnostics::report(Severity severity, const SourceDoc &doc,
+                         size_t start, size_t end, std::string_view message,
+                         int found) {
+  if (severity == Severity::Error) {
+    if (&doc == _last_doc && start >= _last_start
+        && (start == _last_start || start < _last_end)) {
+      ++_suppressed;
+      return false;
+    }
+    ++_error_count;
+    _last_doc = &doc;
+    _last_start = (uint32_t)start;
+    _last_end = (uint32_t)end;
+  }
+
+  char *text = static_cast<char*>(
+    lava_arena_alloc(&_arena.arena, 1, message.size())
+  );
+  std::memcpy(text, message.data(), message.size());
+  _diags.push_back(Diagnostic{
+    .doc = &doc,
+    .start = (uint32_t)start,
+    .end = (uint32_t)end,
+    .severity = severity,
+    .found = found,
+    .message = {text, message.size()},
+  });
+  return true;
+}
+
+void Diagnostics::format(std::string &out, size_t first) const {
+  for (size_t i = first; i < _diags.size(); ++i) {
+    auto const &diag = _diags[i];
+    SourceLoc loc;
+    loc.offset = diag.start;
+    loc = diag.doc->resolve(loc);
+    out += diag.doc->name;
+    out += ':';
+    out += std::to_string(loc.line);
+    out += ':';
+    out += std::to_string(loc.column);
+    switch (diag.severity) {
+    case Severity::Error:
+      out += ": error: ";
+      break;
+    case Severity::Warning:
+      out += ": warning: ";
+      break;
+    case Severity::Note:
+      out += ": note: ";
+      break;
+    }
+    out += diag.message;
+    if (diag.found != Diagnostic::NoToken) {
+      out += " (found ";
+      out += get_token_name(diag.found);
+      out += ')';
+    }
+    out += '\n';
+  }
+}
+
+size_t Diagnostics::print(FILE *file, size_t first) const {
+  if (first >= _diags.size()) {
+    return 0;
+  }
+  std::string out;
+  format(out, first);
+  fwrite(out.data(), 1, out.size(), file);
+  return _diags.size() - first;
+}
@@ -12,8 +12,8 @@ const FunctionType &FirstPass::get_function_type(const FunItemBase &item) {
   const DataType *return_type;
   if (item.return_type()) {
     TypeVisitor return_type_visitor{*_symtab, *_current_ns};
-    return_type_visitor.NodeVisitor::visit(*item.return_type());
-    return_type = dynamic_cast<const DataType*>(return_type_visitor.type);
+    return_type_visitor.visit(*item.return_type());
+    return_type = dyn_cast<DataType>(return_type_visitor.type);
     if (!return_type) {
       throw std::runtime_error{"Return type is not a DataType"};
     }
@@ -24,8 +24,8 @@ const FunctionType &FirstPass::get_function_type(const FunItemBase &item) {
   FunctionType::ArgVector args;
   for (auto const &arg : item.args()) {
     TypeVisitor arg_type_visitor{*_symtab, *_current_ns};
-    arg_type_visitor.NodeVisitor::visit(*arg.value.type());
-    auto type = dynamic_cast<const DataType*>(arg_type_visitor.type);
+    arg_type_visitor.visit(*arg.value.type());
+    auto type = dyn_cast<DataType>(arg_type_visitor.type);
     if (!type) {
       throw std::runtime_error{"Arg is not a DataType"};
     }
@@ -54,7 +54,7 @@ void FirstPass::visit(const FunDefItem &item) {
   if (!_current_ns->add(
       std::make_unique<Function>(name, &type, *_current_ns)
      )) {
-    auto fn = dynamic_cast<Function*>(_current_ns->get(name));
+    auto fn = dyn_cast<Function>(_current_ns->get(name));
     if (!fn || !type.are_types_same(*fn->type())) {
       throw std::runtime_error{"Function declaration/definition mismatch"};
     } else {
@@ -64,12 +64,53 @@ void FirstPass::visit(const FunDefItem &item) {
   }
 }
 
+std::vector<Function*> FirstPass::replace(const FunItemBase &item) {
+  auto name = _symtab->intern(item.name());
+  auto const &type = get_function_type(item);
+  auto old = _current_ns->replace(
+    std::make_unique<Function>(name, &type, *_current_ns)
+  );
+  _current_ns->dependencies().remove_user(name);
+  auto *old_fn = dyn_cast<Function>(old.get());
+  if (old_fn && type.are_types_same(*old_fn->type())) {
+    return {};
+  }
+  return invalidate_users(name);
+}
+
+std::vector<Function*> FirstPass::remove(InternString name) {
+  if (!_current_ns->remove(name)) {
+    return {};
+  }
+  _current_ns->dependencies().remove_user(name);
+  return invalidate_users(name);
+}
+
+std::vector<Function*> FirstPass::invalidate_users(InternString name) {
+  std::vector<Function*> invalidated;
+  auto &deps = _current_ns->dependencies();
+  auto *users = deps.users(name);
+  if (!users) {
+    return invalidated;
+  }
+  // Removing a user changes the list.
+  for (auto user : std::vector<InternString>(*users)) {
+    deps.remove_user(user);
+    if (auto *fn = dyn_cast<Function>(_current_ns->get(user))) {
+      fn->clear_ir();
+      invalidated.push_back(fn);
+    }
+  }
+  return invalidated;
+}
+
 void TypeVisitor::visit(const IdentExpr &ident) {
   auto name = _symtab->intern(ident.value());
-  auto *sym = _current_ns->get(name);
-  if (auto *ns = dynamic_cast<Namespace*>(sym)) {
+  auto *sym = _qualified ? _current_ns->get(name) : _current_ns->getrec(name);
+  if (auto *ns = dyn_cast<Namespace>(sym)) {
     _current_ns = ns;
-  } else if (auto *typealias = dynamic_cast<TypeAlias*>(sym)) {
+    _qualified = true;
+  } else if (auto *typealias = dyn_cast<TypeAlias>(sym)) {
     type = typealias->type;
   } else {
     throw std::runtime_error{"Unknown ident kind"};
@@ -78,9 +119,9 @@ void TypeVisitor::visit(const IdentExpr &ident) {
 
 void TypeVisitor::visit(const BinaryExpr &binary) {
   if (binary.op() == TkDot) {
-    NodeVisitor::visit(*binary.left());
+    StaticVisitor::visit(*binary.left());
     assert(type == nullptr && _current_ns);
-    NodeVisitor::visit(*binary.right());
+    StaticVisitor::visit(*binary.right());
     assert(type);
   } else {
     throw std::runtime_error{"Expression not supported for type"};
@@ -0,0 +1,604 @@
+#include "lava/lang/flattree.h"
+#include "lava/lang/parser.h"
+#include "lava/lang/tokenbuffer.h"
+#include <bit>
+#include <cassert>
+
+using namespace lava::lang;
+
+FlatTree::FlatTree(const Document &doc, const TokenBuffer &tokens)
+  : _tokens{&tokens}
+{
+  // Most nodes have a token and a child or two.
+  _nodes.reserve(tokens.size() / 2 + 1);
+  _refs.reserve(tokens.size() + 1);
+
+  auto &items = doc.items();
+  uint32_t n = add(FlatKind::Document, 0, items.size());
+  for (size_t i = 0; i < items.size(); ++i) {
+    set_child(n, i, flatten(*items[i]));
+  }
+  finish(n);
+}
+
+Token FlatTree::token(uint32_t n, size_t i) const {
+  uint32_t ref = token_refs(n)[i];
+  if (ref == None) {
+    return Token{};
+  }
+  return _tokens->token(ref);
+}
+
+uint64_t FlatTree::literal_bits(uint32_t n) const {
+  assert(kind(n) == FlatKind::Literal);
+  uint32_t refs = _nodes[n].refs;
+  return (uint64_t)_refs[refs + 1] | (uint64_t)_refs[refs + 2] << 32;
+}
+
+uint32_t FlatTree::add(FlatKind kind, size_t token_count,
+                       size_t child_count) {
+  uint32_t n = (uint32_t)_nodes.size();
+  _nodes.push_back(Node{
+    .kind = kind,
+    .literal_type = 0,
+    .refs = (uint32_t)_refs.size(),
+    .token_count = (uint32_t)token_count,
+    .child_count = (uint32_t)child_count,
+    .end = n + 1,
+  });
+  size_t words = token_count + child_count;
+  if (kind == FlatKind::Literal) {
+    words += 2;
+  }
+  _refs.resize(_refs.size() + words, None);
+  return n;
+}
+
+void FlatTree::set_token(uint32_t n, size_t i, const Token &token) {
+  size_t index = _tokens->find(token.start.offset);
+  assert(index < _tokens->size()
+         && _tokens->start(index) == token.start.offset
+         && "token is not in the buffer");
+  _refs[_nodes[n].refs + i] = (uint32_t)index;
+}
+
+void FlatTree::set_child(uint32_t n, size_t i, uint32_t child) {
+  const Node &node = _nodes[n];
+  _refs[node.refs + node.token_count + i] = child;
+}
+
+uint32_t FlatTree::flatten(const Expr *expr) {
+  if (!expr) {
+    return None;
+  }
+
+  uint32_t n;
+  switch (expr->expr_kind()) {
+  case ExprKind::Literal:
+    {
+      auto &literal = static_cast<const LiteralExpr&>(*expr);
+      n = add(FlatKind::Literal, 1, 0);
+      set_token(n, 0, literal.token());
+      uint64_t bits = 0;
+      switch (literal.type()) {
+      case LiteralType::Int:
+        bits = literal.int_value();
+        break;
+      case LiteralType::Float:
+        bits = std::bit_cast<uint32_t>(literal.float_value());
+        break;
+      case LiteralType::Double:
+        bits = std::bit_cast<uint64_t>(literal.double_value());
+        break;
+      case LiteralType::String:
+        // Read back from the token.
+        break;
+      }
+      _nodes[n].literal_type = (uint8_t)literal.type();
+      _refs[_nodes[n].refs + 1] = (uint32_t)bits;
+      _refs[_nodes[n].refs + 2] = (uint32_t)(bits >> 32);
+    }
+    break;
+
+  case ExprKind::Ident:
+    n = add(FlatKind::Ident, 1, 0);
+    set_token(n, 0, static_cast<const IdentExpr&>(*expr).token());
+    break;
+
+  case ExprKind::Prefix:
+    {
+      auto &prefix = static_cast<const PrefixExpr&>(*expr);
+      n = add(FlatKind::Prefix, 1, 1);
+      set_token(n, 0, prefix.op_token());
+      set_child(n, 0, flatten(prefix.expr()));
+    }
+    break;
+
+  case ExprKind::Postfix:
+    {
+      auto &postfix = static_cast<const PostfixExpr&>(*expr);
+      n = add(FlatKind::Postfix, 1, 1);
+      set_token(n, 0, postfix.op_token());
+      set_child(n, 0, flatten(postfix.expr()));
+    }
+    break;
+
+  case ExprKind::Binary:
+    {
+      auto &binary = static_cast<const BinaryExpr&>(*expr);
+      n = add(FlatKind::Binary, 1, 2);
+      set_token(n, 0, binary.op_token());
+      set_child(n, 0, flatten(binary.left()));
+      set_child(n, 1, flatten(binary.right()));
+    }
+    break;
+
+  case ExprKind::Paren:
+    {
+      auto &paren = static_cast<const ParenExpr&>(*expr);
+      n = add(FlatKind::Paren, 2, 1);
+      set_token(n, 0, paren.lparen());
+      set_token(n, 1, paren.rparen());
+      set_child(n, 0, flatten(paren.expr()));
+    }
+    break;
+
+  case ExprKind::Invoke:
+    {
+      auto &invoke = static_cast<const InvokeExpr&>(*expr);
+      auto &args = invoke.args();
+      n = add(FlatKind::Invoke, 2 + args.size(), 1 + args.size());
+      set_token(n, 0, invoke.lparen());
+      set_token(n, 1, invoke.rparen());
+      set_child(n, 0, flatten(invoke.expr()));
+      for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i].delimiter) {
+          set_token(n, 2 + i, *args[i].delimiter);
+        }
+        set_child(n, 1 + i, flatten(args[i].value.get()));
+      }
+    }
+    break;
+
+  case ExprKind::Scope:
+    return flatten(static_cast<const ScopeExpr&>(*expr));
+
+  case ExprKind::Return:
+    {
+      auto &return_ = static_cast<const ReturnExpr&>(*expr);
+      n = add(FlatKind::Return, 1, 1);
+      set_token(n, 0, return_.return_token());
+      set_child(n, 0, flatten(return_.expr()));
+    }
+    break;
+
+  case ExprKind::If:
+    {
+      auto &if_ = static_cast<const IfExpr&>(*expr);
+      auto &elses = if_.elses();
+      n = add(FlatKind::If, 1, 2 + elses.size());
+      set_token(n, 0, if_.if_token());
+      set_child(n, 0, flatten(if_.expr()));
+      set_child(n, 1, flatten(if_.scope()));
+      for (size_t i = 0; i < elses.size(); ++i) {
+        uint32_t else_ = add(FlatKind::Else, 2, 2);
+        set_token(else_, 0, elses[i].else_token());
+        if (elses[i].expr()) {
+          set_token(else_, 1, elses[i].if_token());
+        }
+        set_child(else_, 0, flatten(elses[i].expr()));
+        set_child(else_, 1, flatten(elses[i].scope()));
+        finish(else_);
+        set_child(n, 2 + i, else_);
+      }
+    }
+    break;
+
+  case ExprKind::While:
+    {
+      auto &while_ = static_cast<const WhileExpr&>(*expr);
+      n = add(FlatKind::While, 1, 2);
+      set_token(n, 0, while_.while_token());
+      set_child(n, 0, flatten(while_.expr()));
+      set_child(n, 1, flatten(while_.scope()));
+    }
+    break;
+
+  case ExprKind::Loop:
+    {
+      auto &loop = static_cast<const LoopExpr&>(*expr);
+      n = add(FlatKind::Loop, 1, 1);
+      set_token(n, 0, loop.loop_token());
+      set_child(n, 0, flatten(loop.scope()));
+    }
+    break;
+
+  case ExprKind::BreakContinue:
+    {
+      auto &break_ = static_cast<const BreakContinueExpr&>(*expr);
+      n = add(FlatKind::BreakContinue, 1, 1);
+      set_token(n, 0, break_.token());
+      set_child(n, 0, flatten(break_.expr()));
+    }
+    break;
+  }
+
+  finish(n);
+  return n;
+}
+
+uint32_t FlatTree::flatten(const ScopeExpr &scope) {
+  auto &exprs = scope.exprs();
+  uint32_t n = add(FlatKind::Scope, 2 + exprs.size(), exprs.size());
+  set_token(n, 0, scope.lbrace());
+  set_token(n, 1, scope.rbrace());
+  for (size_t i = 0; i < exprs.size(); ++i) {
+    if (exprs[i].delimiter) {
+      set_token(n, 2 + i, *exprs[i].delimiter);
+    }
+    set_child(n, i, flatten(exprs[i].value.get()));
+  }
+  finish(n);
+  return n;
+}
+
+uint32_t FlatTree::flatten(const VarDeclItem &item) {
+  auto &decls = item.decls();
+  uint32_t n = add(FlatKind::VarDeclItem, 1 + decls.size(),
+                   1 + decls.size());
+  set_token(n, 0, item.semi());
+  set_child(n, 0, flatten(item.type()));
+  for (size_t i = 0; i < decls.size(); ++i) {
+    auto &decl = decls[i].value;
+    if (decls[i].delimiter) {
+      set_token(n, 1 + i, *decls[i].delimiter);
+    }
+    uint32_t d = add(FlatKind::VarDecl, 2, 1);
+    set_token(d, 0, decl.name_token());
+    if (decl.init()) {
+      set_token(d, 1, decl.init()->eq());
+      set_child(d, 0, flatten(decl.init()->expr()));
+    }
+    finish(d);
+    set_child(n, 1 + i, d);
+  }
+  finish(n);
+  return n;
+}
+
+uint32_t FlatTree::flatten(const Item &item) {
+  uint32_t n;
+  switch (item.item_kind()) {
+  case ItemKind::Empty:
+    n = add(FlatKind::EmptyItem, 1, 0);
+    set_token(n, 0, static_cast<const EmptyItem&>(item).semi());
+    break;
+
+  case ItemKind::Expr:
+    {
+      auto &expr = static_cast<const ExprItem&>(item);
+      n = add(FlatKind::ExprItem, 1, 1);
+      set_token(n, 0, expr.semi());
+      set_child(n, 0, flatten(expr.expr()));
+    }
+    break;
+
+  case ItemKind::VarDecl:
+    return flatten(static_cast<const VarDeclItem&>(item));
+
+  case ItemKind::FunDecl:
+  case ItemKind::FunDef:
+    {
+      auto &fun = static_cast<const FunItemBase&>(item);
+      bool is_def = item.item_kind() == ItemKind::FunDef;
+      auto &args = fun.args();
+      size_t fixed_tokens = is_def ? 5 : 6;
+      n = add(is_def ? FlatKind::FunDefItem : FlatKind::FunDeclItem,
+              fixed_tokens + args.size(), args.size() + (is_def ? 2 : 1));
+      set_token(n, 0, fun.fun_token());
+      set_token(n, 1, fun.name_token());
+      set_token(n, 2, fun.arg_list().lparen());
+      set_token(n, 3, fun.arg_list().rparen());
+      if (fun.return_spec()) {
+        set_token(n, 4, fun.return_spec()->arrow());
+      }
+      if (!is_def) {
+        set_token(n, 5, static_cast<const FunDeclItem&>(item).semi());
+      }
+      for (size_t i = 0; i < args.size(); ++i) {
+        auto &arg = args[i].value;
+        if (args[i].delimiter) {
+          set_token(n, fixed_tokens + i, *args[i].delimiter);
+        }
+        uint32_t a = add(FlatKind::ArgDecl, 2, 2);
+        set_token(a, 0, arg.name_token());
+        set_child(a, 0, flatten(arg.type()));
+        if (arg.init()) {
+          set_token(a, 1, arg.init()->eq());
+          set_child(a, 1, flatten(arg.init()->expr()));
+        }
+        finish(a);
+        set_child(n, i, a);
+      }
+      set_child(n, args.size(), flatten(fun.return_type()));
+      if (is_def) {
+        auto &def = static_cast<const FunDefItem&>(item);
+        if (def.is_body_parsed()) {
+          set_child(n, args.size() + 1, flatten(def.body()));
+        } else {
+          auto body = Parser{*_tokens}.parse_body(def);
+          if (!body) {
+            throw ParseError{def.body_start(), "invalid fun body"};
+          }
+          set_child(n, args.size() + 1, flatten(*body));
+        }
+      }
+    }
+    break;
+
+  case ItemKind::StructDef:
+    {
+      auto &struct_ = static_cast<const StructDefItem&>(item);
+      auto &vars = struct_.vars();
+      n = add(FlatKind::StructDefItem, 4, vars.size());
+      set_token(n, 0, struct_.keyword());
+      set_token(n, 1, struct_.name_token());
+      set_token(n, 2, struct_.lbrace());
+      set_token(n, 3, struct_.rbrace());
+      for (size_t i = 0; i < vars.size(); ++i) {
+        set_child(n, i, flatten(vars[i]));
+      }
+    }
+    break;
+  }
+
+  finish(n);
+  return n;
+}
+
+// ------------------------------------------------------------------------- //
+
+std::unique_ptr<Document> FlatTree::expand() const {
+  std::vector<std::unique_ptr<Item>> items;
+  auto children = this->children(0);
+  items.reserve(children.size());
+  for (uint32_t child : children) {
+    items.emplace_back(expand_item(child));
+  }
+  return std::make_unique<Document>(std::move(items));
+}
+
+std::unique_ptr<Expr> FlatTree::expand_expr(uint32_t n) const {
+  if (n == None) {
+    return nullptr;
+  }
+
+  auto children = this->children(n);
+  switch (kind(n)) {
+  case FlatKind::Literal:
+    {
+      Token token = this->token(n, 0);
+      uint64_t bits = literal_bits(n);
+      switch ((LiteralType)node(n).literal_type) {
+      case LiteralType::Int:
+        return std::make_unique<LiteralExpr>(token, bits);
+      case LiteralType::Float:
+        return std::make_unique<LiteralExpr>(
+          token, std::bit_cast<float>((uint32_t)bits));
+      case LiteralType::Double:
+        return std::make_unique<LiteralExpr>(
+          token, std::bit_cast<double>(bits));
+      case LiteralType::String:
+        return std::make_unique<LiteralExpr>(token);
+      }
+    }
+    break;
+
+  case FlatKind::Ident:
+    return std::make_unique<IdentExpr>(token(n, 0));
+
+  case FlatKind::Prefix:
+    return std::make_unique<PrefixExpr>(token(n, 0),
+                                        expand_expr(children[0]));
+
+  case FlatKind::Postfix:
+    return std::make_unique<PostfixExpr>(token(n, 0),
+                                         expand_expr(children[0]));
+
+  case FlatKind::Binary:
+    return std::make_unique<BinaryExpr>(token(n, 0),
+                                        expand_expr(children[0]),
+                                        expand_expr(children[1]));
+
+  case FlatKind::Paren:
+    return std::make_unique<ParenExpr>(token(n, 0), token(n, 1),
+                                       expand_expr(children[0]));
+
+  case FlatKind::Invoke:
+    {
+      ExprsWithDelimiter args;
+      args.reserve(children.size() - 1);
+      for (size_t i = 1; i < children.size(); ++i) {
+        auto arg = expand_expr(children[i]);
+        if (token_refs(n)[1 + i] != None) {
+          args.emplace_back(ExprWithDelimiter{std::move(arg),
+                                              token(n, 1 + i)});
+        } else {
+          args.emplace_back(ExprWithDelimiter{std::move(arg)});
+        }
+      }
+      return std::make_unique<InvokeExpr>(expand_expr(children[0]),
+                                          token(n, 0), token(n, 1),
+                                          std::move(args));
+    }
+
+  case FlatKind::Scope:
+    return std::make_unique<ScopeExpr>(expand_scope(n));
+
+  case FlatKind::Return:
+    if (children[0] == None) {
+      return std::make_unique<ReturnExpr>(token(n, 0));
+    }
+    return std::make_unique<ReturnExpr>(token(n, 0),
+                                        expand_expr(children[0]));
+
+  case FlatKind::If:
+    {
+      std::vector<ElsePart> elses;
+      elses.reserve(children.size() - 2);
+      for (size_t i = 2; i < children.size(); ++i) {
+        uint32_t e = children[i];
+        auto else_children = this->children(e);
+        if (else_children[0] == None) {
+          elses.emplace_back(token(e, 0), expand_scope(else_children[1]));
+        } else {
+          elses.emplace_back(token(e, 0), token(e, 1),
+                             expand_expr(else_children[0]),
+                             expand_scope(else_children[1]));
+        }
+      }
+      return std::make_unique<IfExpr>(token(n, 0), expand_expr(children[0]),
+                                      expand_scope(children[1]),
+                                      std::move(elses));
+    }
+
+  case FlatKind::While:
+    return std::make_unique<WhileExpr>(token(n, 0), expand_expr(children[0]),
+                                       expand_scope(children[1]));
+
+  case FlatKind::Loop:
+    return std::make_unique<LoopExpr>(token(n, 0),
+                                      expand_scope(children[0]));
+
+  case FlatKind::BreakContinue:
+    if (children[0] == None) {
+      return std::make_unique<BreakContinueExpr>(token(n, 0));
+    }
+    return std::make_unique<BreakContinueExpr>(token(n, 0),
+                                               expand_expr(children[0]));
+
+  default:
+    break;
+  }
+
+  assert(false && "not an expression node");
+  return nullptr;
+}
+
+ScopeExpr FlatTree::expand_scope(uint32_t n) const {
+  assert(kind(n) == FlatKind::Scope);
+  auto children = this->children(n);
+  ExprsWithDelimiter exprs;
+  exprs.reserve(children.size());
+  for (size_t i = 0; i < children.size(); ++i) {
+    auto expr = expand_expr(children[i]);
+    if (token_refs(n)[2 + i] != None) {
+      exprs.emplace_back(ExprWithDelimiter{std::move(expr),
+                                           token(n, 2 + i)});
+    } else {
+      exprs.emplace_back(ExprWithDelimiter{std::move(expr)});
+    }
+  }
+  return ScopeExpr{token(n, 0), token(n, 1), std::move(exprs)};
+}
+
+std::optional<VarInit> FlatTree::expand_init(uint32_t n, size_t eq,
+                                             uint32_t init) const {
+  if (token_refs(n)[eq] == None) {
+    return std::nullopt;
+  }
+  return VarInit{token(n, eq), expand_expr(init)};
+}
+
+VarDeclItem FlatTree::expand_var_decl_item(uint32_t n) const {
+  assert(kind(n) == FlatKind::VarDeclItem);
+  auto children = this->children(n);
+  VarDeclsWithDelimiter decls;
+  decls.reserve(children.size() - 1);
+  for (size_t i = 1; i < children.size(); ++i) {
+    uint32_t d = children[i];
+    auto init = expand_init(d, 1, this->children(d)[0]);
+    VarDecl decl = init ? VarDecl{token(d, 0), *std::move(init)}
+                        : VarDecl{token(d, 0)};
+    if (token_refs(n)[i] != None) {
+      decls.emplace_back(VarDeclWithDelimiter{std::move(decl), token(n, i)});
+    } else {
+      decls.emplace_back(VarDeclWithDelimiter{std::move(decl)});
+    }
+  }
+  return VarDeclItem{expand_expr(children[0]), std::move(decls),
+                     token(n, 0)};
+}
+
+std::unique_ptr<Item> FlatTree::expand_item(uint32_t n) const {
+  auto children = this->children(n);
+  switch (kind(n)) {
+  case FlatKind::EmptyItem:
+    return std::make_unique<EmptyItem>(token(n, 0));
+
+  case FlatKind::ExprItem:
+    return std::make_unique<ExprItem>(expand_expr(children[0]), token(n, 0));
+
+  case FlatKind::VarDeclItem:
+    return std::make_unique<VarDeclItem>(expand_var_decl_item(n));
+
+  case FlatKind::FunDeclItem:
+  case FlatKind::FunDefItem:
+    {
+      bool is_def = kind(n) == FlatKind::FunDefItem;
+      size_t fixed_tokens = is_def ? 5 : 6;
+      size_t arg_count = children.size() - (is_def ? 2 : 1);
+
+      ArgDeclsWithDelimiter args;
+      args.reserve(arg_count);
+      for (size_t i = 0; i < arg_count; ++i) {
+        uint32_t a = children[i];
+        auto arg_children = this->children(a);
+        auto init = expand_init(a, 1, arg_children[1]);
+        auto type = expand_expr(arg_children[0]);
+        ArgDecl arg = init
+          ? ArgDecl{std::move(type), token(a, 0), *std::move(init)}
+          : ArgDecl{std::move(type), token(a, 0)};
+        size_t delimiter = fixed_tokens + i;
+        if (token_refs(n)[delimiter] != None) {
+          args.emplace_back(ArgDeclWithDelimiter{std::move(arg),
+                                                 token(n, delimiter)});
+        } else {
+          args.emplace_back(ArgDeclWithDelimiter{std::move(arg)});
+        }
+      }
+      ArgList arg_list{token(n, 2), token(n, 3), std::move(args)};
+
+      std::optional<ReturnSpec> ret;
+      if (token_refs(n)[4] != None) {
+        ret.emplace(token(n, 4), expand_expr(children[arg_count]));
+      }
+
+      if (is_def) {
+        return std::make_unique<FunDefItem>(
+          token(n, 0), token(n, 1), std::move(arg_list), std::move(ret),
+          expand_scope(children[arg_count + 1]));
+      }
+      return std::make_unique<FunDeclItem>(
+        token(n, 0), token(n, 1), std::move(arg_list), std::move(ret),
+        token(n, 5));
+    }
+
+  case FlatKind::StructDefItem:
+    {
+      std::vector<VarDeclItem> vars;
+      vars.reserve(children.size());
+      for (uint32_t child : children) {
+        vars.emplace_back(expand_var_decl_item(child));
+      }
+      return std::make_unique<StructDefItem>(
+        token(n, 0), token(n, 1), token(n, 2), token(n, 3), std::move(vars));
+    }
+
+  default:
+    break;
+  }
+
+  assert(false && "not an item node");
+  return nullptr;
+}
@@ -0,0 +1,235 @@
+#include "lava/lang/interner.h"
+#include "lava/util/hash.h"
+#include <bit>
+#include <cstring>
+
+using namespace lava::lang;
+
+namespace {
+
+constexpr size_t InitialSlots = 256;
+constexpr size_t InitialShardSlots = 64;
+
+} // anonymous namespace
+
+StringInterner::StringInterner()
+  : _slots(InitialSlots)
+{}
+
+auto StringInterner::probe(std::string_view str, uint64_t hash) const
+  -> const Slot &
+{
+  size_t mask = _slots.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    auto const &slot = _slots[i];
+    if (!slot.entry) {
+      return slot;
+    }
+    if (slot.hash == hash) {
+      auto const &entry = _entries[slot.entry - 1];
+      if (entry.size == str.size()
+          && std::memcmp(entry.data, str.data(), str.size()) == 0) {
+        return slot;
+      }
+    }
+  }
+}
+
+void StringInterner::grow() {
+  std::vector<Slot> slots(_slots.size() * 2);
+  size_t mask = slots.size() - 1;
+  for (auto const &slot : _slots) {
+    if (!slot.entry) {
+      continue;
+    }
+    size_t i = slot.hash & mask;
+    while (slots[i].entry) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = slot;
+  }
+  _slots = std::move(slots);
+}
+
+InternString StringInterner::intern(std::string_view str) {
+  uint64_t hash = hash_bytes(str);
+  auto &slot = const_cast<Slot&>(probe(str, hash));
+  if (slot.entry) {
+    return InternString{slot.entry - 1, str.size()};
+  }
+
+  const char *data = "";
+  if (!str.empty()) {
+    char *copy = static_cast<char*>(
+      lava_arena_alloc(&_arena.arena, 1, str.size())
+    );
+    std::memcpy(copy, str.data(), str.size());
+    data = copy;
+  }
+  size_t index = _entries.size();
+  _entries.push_back({data, str.size()});
+  slot.hash = hash;
+  slot.entry = (uint32_t)(index + 1);
+
+  // Keep the load factor at or under 3/4.
+  if (_entries.size() * 4 > _slots.size() * 3) {
+    grow();
+  }
+  return InternString{index, str.size()};
+}
+
+InternString StringInterner::find(std::string_view str) const {
+  auto const &slot = probe(str, hash_bytes(str));
+  if (!slot.entry) {
+    return InternString{};
+  }
+  return InternString{slot.entry - 1, str.size()};
+}
+
+ConcurrentStringInterner::Table::Table(size_t size)
+  : mask{size - 1}
+  , slots{new Slot[size]}
+{
+  for (size_t i = 0; i < size; ++i) {
+    slots[i].hash.store(0, std::memory_order_relaxed);
+    slots[i].entry.store(0, std::memory_order_relaxed);
+  }
+}
+
+ConcurrentStringInterner::Shard::Shard()
+  : owned_table{std::make_unique<Table>(InitialShardSlots)}
+{
+  table.store(owned_table.get(), std::memory_order_relaxed);
+  lava_arena_init(&arena);
+}
+
+ConcurrentStringInterner::Shard::~Shard() {
+  lava_arena_fini(&arena);
+}
+
+auto ConcurrentStringInterner::Shard::entry(uint32_t index) const
+  -> const Entry &
+{
+  // Segment k holds FirstSegment << k entries, starting at
+  // FirstSegment * (2^k - 1).
+  unsigned k = std::bit_width(index / FirstSegment + 1) - 1;
+  size_t first = FirstSegment * ((size_t{1} << k) - 1);
+  return segments[k].load(std::memory_order_acquire)[index - first];
+}
+
+ConcurrentStringInterner::ConcurrentStringInterner()
+  : _shards{new Shard[Shards]}
+{}
+
+ConcurrentStringInterner::~ConcurrentStringInterner() {}
+
+uint32_t ConcurrentStringInterner::lookup(const Shard &shard,
+                                          std::string_view str,
+                                          uint64_t hash) {
+  const Table *table = shard.table.load(std::memory_order_acquire);
+  for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+    auto const &slot = table->slots[i];
+    uint32_t entry = slot.entry.load(std::memory_order_acquire);
+    if (!entry) {
+      return 0;
+    }
+    if (slot.hash.load(std::memory_order_relaxed) == hash) {
+      auto const &e = shard.entry(entry - 1);
+      if (e.size == str.size()
+          && std::memcmp(e.data, str.data(), str.size()) == 0) {
+        return entry;
+      }
+    }
+  }
+}
+
+uint32_t ConcurrentStringInterner::insert(Shard &shard, std::string_view str,
+                                          uint64_t hash) {
+  std::lock_guard<std::mutex> lock{shard.mutex};
+  // Someone else may have added it since the unlocked lookup.
+  if (uint32_t entry = lookup(shard, str, hash)) {
+    return entry;
+  }
+
+  uint32_t index = shard.count.load(std::memory_order_relaxed);
+  unsigned k = std::bit_width(index / FirstSegment + 1) - 1;
+  Entry *segment = shard.segments[k].load(std::memory_order_relaxed);
+  if (!segment) {
+    size_t size = FirstSegment << k;
+    segment = static_cast<Entry*>(
+      lava_arena_alloc(&shard.arena, alignof(Entry), size * sizeof(Entry))
+    );
+    shard.segments[k].store(segment, std::memory_order_release);
+  }
+  const char *data = "";
+  if (!str.empty()) {
+    char *copy = static_cast<char*>(
+      lava_arena_alloc(&shard.arena, 1, str.size())
+    );
+    std::memcpy(copy, str.data(), str.size());
+    data = copy;
+  }
+  segment[index - FirstSegment * ((size_t{1} << k) - 1)] = {data, str.size()};
+  shard.count.store(index + 1, std::memory_order_relaxed);
+
+  // Keep the load factor at or under 3/4. The new table is filled before
+  // it is published; readers still on the old one just miss the newest
+  // strings and come here to find them.
+  Table *table = shard.table.load(std::memory_order_relaxed);
+  if ((size_t)(index + 1) * 4 > (table->mask + 1) * 3) {
+    auto grown = std::make_unique<Table>((table->mask + 1) * 2);
+    for (size_t i = 0; i <= table->mask; ++i) {
+      uint32_t entry = table->slots[i].entry.load(std::memory_order_relaxed);
+      if (!entry) {
+        continue;
+      }
+      uint64_t h = table->slots[i].hash.load(std::memory_order_relaxed);
+      size_t j = h & grown->mask;
+      while (grown->slots[j].entry.load(std::memory_order_relaxed)) {
+        j = (j + 1) & grown->mask;
+      }
+      grown->slots[j].hash.store(h, std::memory_order_relaxed);
+      grown->slots[j].entry.store(entry, std::memory_order_relaxed);
+    }
+    grown->previous = std::move(shard.owned_table);
+    shard.owned_table = std::move(grown);
+    table = shard.owned_table.get();
+    shard.table.store(table, std::memory_order_release);
+  }
+
+  size_t i = hash & table->mask;
+  while (table->slots[i].entry.load(std::memory_order_relaxed)) {
+    i = (i + 1) & table->mask;
+  }
+  table->slots[i].hash.store(hash, std::memory_order_relaxed);
+  table->slots[i].entry.store(index + 1, std::memory_order_release);
+  return index + 1;
+}
+
+InternString ConcurrentStringInterner::intern(std::string_view str) {
+  uint64_t hash = hash_bytes(str);
+  size_t s = hash >> (64 - ShardBits);
+  uint32_t entry = lookup(_shards[s], str, hash);
+  if (!entry) {
+    entry = insert(_shards[s], str, hash);
+  }
+  return InternString{((size_t)(entry - 1) << ShardBits) | s, str.size()};
+}
+
+InternString ConcurrentStringInterner::find(std::string_view str) const {
+  uint64_t hash = hash_bytes(str);
+  size_t s = hash >> (64 - ShardBits);
+  uint32_t entry = lookup(_shards[s], str, hash);
+  if (!entry) {
+    return InternString{};
+  }
+  return InternString{((size_t)(entry - 1) << ShardBits) | s, str.size()};
+}
+
+size_t ConcurrentStringInterner::size() const {
+  size_t size = 0;
+  for (size_t s = 0; s < Shards; ++s) {
+    size += _shards[s].count.load(std::memory_order_relaxed);
+  }
+  return size;
+}
@@ -1,5 +1,7 @@
 #include "lava/lang/iremit.h"
 #include "lava/lang/instr.h"
+#include "lava/util/scope_exit.h"
+#include <algorithm>
 #include <sstream>
 
 using namespace lava::lang;
@@ -36,11 +38,11 @@ std::string lava::lang::instr_to_string(const Instruction &instr) {
     break;
 
   case Op::LdStr:
-    ss << "$" << instr.ldstr.dest << " = LdStr " << instr.ldstr.offset
+    ss << "$" << instr.ldstr.dest << " = LdStr " << instr.ldstr.index
       << ", " << instr.ldstr.size;
 
   case Op::LdVar:
-    ss << "$" << instr.ldvar.dest << " = LdVar " << instr.ldvar.offset
+    ss << "$" << instr.ldvar.dest << " = LdVar " << instr.ldvar.index
       << ", " << instr.ldvar.size;
     break;
 
@@ -107,6 +109,65 @@ std::string lava::lang::instr_to_string(const Instruction &instr) {
   return std::move(ss).str();
 }
 
+bool lava::lang::operator==(const Instruction &a, const Instruction &b) {
+  if (a.op != b.op) {
+    return false;
+  }
+
+  switch (a.op) {
+  case Op::LdI32:
+    return a.ldi32.dest == b.ldi32.dest && a.ldi32.value == b.ldi32.value;
+
+  case Op::LdI64:
+    return a.ldi64.dest == b.ldi64.dest && a.ldi64.value == b.ldi64.value;
+
+  // Compared bitwise, so that a NaN constant equals itself.
+  case Op::LdF32:
+    return a.ldf32.dest == b.ldf32.dest
+      && memcmp(&a.ldf32.value, &b.ldf32.value, sizeof(float)) == 0;
+
+  case Op::LdF64:
+    return a.ldf64.dest == b.ldf64.dest
+      && memcmp(&a.ldf64.value, &b.ldf64.value, sizeof(double)) == 0;
+
+  case Op::LdStr:
+    return a.ldstr.dest == b.ldstr.dest && a.ldstr.index == b.ldstr.index
+      && a.ldstr.size == b.ldstr.size;
+
+  case Op::LdVar:
+    return a.ldvar.dest == b.ldvar.dest && a.ldvar.index == b.ldvar.index
+      && a.ldvar.size == b.ldvar.size;
+
+  case Op::Clz:
+  case Op::Ctz:
+  case Op::Popcount:
+  case Op::Compl:
+  case Op::Not:
+  case Op::Neg:
+    return a.unary.dest == b.unary.dest && a.unary.src == b.unary.src;
+
+  case Op::Call:
+    return a.call.fn == b.call.fn
+      && std::equal(a.call.args, a.call.args + a.call.arg_count,
+                    b.call.args, b.call.args + b.call.arg_count);
+
+  case Op::Ret:
+    return a.ret.value == b.ret.value;
+
+  case Op::Jmp:
+    return a.jmp.bb == b.jmp.bb;
+
+  case Op::JmpIf:
+    return a.jmpif.bb == b.jmpif.bb && a.jmpif.bb_else == b.jmpif.bb_else
+      && a.jmpif.cond == b.jmpif.cond;
+
+  default:
+    return a.binary.dest == b.binary.dest
+      && a.binary.src[0] == b.binary.src[0]
+      && a.binary.src[1] == b.binary.src[1];
+  }
+}
+
 Instruction::Instruction(Instruction &&other) {
   *this = std::move(other);
 }
@@ -129,7 +190,7 @@ IREmitter::IREmitter(SymbolTable &symtab)
   , _current_ns{&symtab.global_namespace()}
 {}
 
-void IREmitter::visit(const LiteralExpr &expr) {
+void IREmitter::post_visit(const LiteralExpr &expr) {
   switch (expr.type()) {
   case LiteralType::Int:
     _current_reg = _current_fn->next_register();
@@ -165,7 +226,7 @@ void IREmitter::visit(const LiteralExpr &expr) {
       _current_reg = _current_fn->next_register();
       _current_bb.instrs.emplace_back(LdStrArgs {
         .dest = _current_reg,
-        .offset = (unsigned)intern_string.offset,
+        .index = (unsigned)intern_string.index,
         .size = (unsigned)intern_string.size,
       });
     }
@@ -173,18 +234,21 @@ void IREmitter::visit(const LiteralExpr &expr) {
   }
 }
 
-void IREmitter::visit(const IdentExpr &expr) {
+void IREmitter::post_visit(const IdentExpr &expr) {
   _current_reg = _current_fn->next_register();
   auto intern_string = _symtab->intern(expr.value());
+  if (_deps && !_current_fn->args_namespace().has(intern_string)
+      && !_current_fn->locals_namespace().has(intern_string)) {
+    _deps->add(_current_fn->name(), intern_string);
+  }
   _current_bb.instrs.emplace_back(LdVarArgs {
     .dest = _current_reg,
-    .offset = (unsigned)intern_string.offset,
+    .index = (unsigned)intern_string.index,
     .size = (unsigned)intern_string.size,
   });
 }
 
-void IREmitter::visit(const PrefixExpr &expr) {
-  NodeVisitor::visit(expr);
+void IREmitter::post_visit(const PrefixExpr &expr) {
   auto expr_reg = _current_reg;
 
   Op op;
@@ -227,9 +291,7 @@ void IREmitter::visit(const PrefixExpr &expr) {
   });
 }
 
-void IREmitter::visit(const PostfixExpr &expr) {
-  NodeVisitor::visit(*expr.expr());
-
+void IREmitter::post_visit(const PostfixExpr &expr) {
   switch (expr.op()) {
   case TkComma:
   case TkDotDot:
@@ -241,10 +303,15 @@ void IREmitter::visit(const PostfixExpr &expr) {
   }
 }
 
-void IREmitter::visit(const BinaryExpr &expr) {
-  NodeVisitor::visit(*expr.left());
-  auto left_reg = _current_reg;
-  NodeVisitor::visit(*expr.right());
+void IREmitter::in_visit(const BinaryExpr &, size_t slot) {
+  if (slot == 0) {
+    _saved.push_back(_current_reg);
+  }
+}
+
+void IREmitter::post_visit(const BinaryExpr &expr) {
+  auto left_reg = _saved.back();
+  _saved.pop_back();
   auto right_reg = _current_reg;
 
   Op op;
@@ -318,15 +385,18 @@ void IREmitter::visit(const BinaryExpr &expr) {
   });
 }
 
-void IREmitter::visit(const InvokeExpr &expr) {
+void IREmitter::in_visit(const InvokeExpr &expr, size_t slot) {
+  if (slot < expr.args().size()) {
+    _saved.push_back(_current_reg);
+  }
+}
+
+void IREmitter::post_visit(const InvokeExpr &expr) {
   unsigned arg_count = (unsigned)expr.args().size();
   unsigned *args = new unsigned[arg_count];
+  std::copy(_saved.end() - arg_count, _saved.end(), args);
+  _saved.resize(_saved.size() - arg_count);
   try {
-    for (unsigned i = 0; i < arg_count; ++i) {
-      NodeVisitor::visit(*expr.args()[i].value);
-      args[i] = _current_reg;
-    }
-    NodeVisitor::visit(*expr.expr());
     _current_bb.instrs.emplace_back(CallArgs {
       .fn = _current_reg,
       .arg_count = arg_count,
@@ -338,13 +408,8 @@ void IREmitter::visit(const InvokeExpr &expr) {
   }
 }
 
-void IREmitter::visit(const ScopeExpr &expr) {
-  NodeVisitor::visit(expr);
-}
-
-void IREmitter::visit(const ReturnExpr &expr) {
+void IREmitter::post_visit(const ReturnExpr &expr) {
   if (expr.expr()) {
-    NodeVisitor::visit(*expr.expr());
     _current_bb.instrs.emplace_back(ReturnArgs {
       .value = _current_reg,
     });
@@ -353,114 +418,131 @@ void IREmitter::visit(const ReturnExpr &expr) {
       .value = (unsigned)-1,
     });
   }
-  _current_fn->push_basicblock(std::move(_current_bb));
-  _current_bb = BasicBlock{};
+  push_basicblock();
 }
 
-void IREmitter::visit(const IfExpr &expr) {
-  NodeVisitor::visit(*expr.expr());
-  auto if_bb_index = _current_fn->basicblocks().size();
-  _current_bb.instrs.emplace_back(JumpIfArgs {
-    .bb = (unsigned)_current_fn->basicblocks().size() + 1,
-    .bb_else = (unsigned)-1,
-    .cond = _current_reg,
-  });
-  _current_fn->push_basicblock(std::move(_current_bb));
-  _current_bb = BasicBlock{};
+// `_saved` holds the block with the pending conditional jump, whose else
+// target is the next condition or the end of the chain.
+void IREmitter::in_visit(const IfExpr &expr, size_t slot) {
+  if (slot % 2 == 0) {
+    // After a condition.
+    if (slot == 0) {
+      _saved.push_back(0);
+    }
+    _saved.back() = (unsigned)_current_fn->basicblocks().size();
+    _current_bb.instrs.emplace_back(JumpIfArgs {
+      .bb = (unsigned)_current_fn->basicblocks().size() + 1,
+      .bb_else = (unsigned)-1,
+      .cond = _current_reg,
+    });
+    push_basicblock();
+    return;
+  }
 
-  NodeVisitor::visit(expr.scope());
-
-  bool seen_plain_else = false;
-  for (auto const &else_ : expr.elses()) {
-    if (else_.expr()) {
-      _current_fn->basicblocks()[if_bb_index].instrs.back().jmpif.bb_else =
-        (unsigned)_current_fn->basicblocks().size() + 1;
-      _current_fn->push_basicblock(std::move(_current_bb));
-      _current_bb = BasicBlock{};
-      NodeVisitor::visit(*else_.expr());
-
-      if_bb_index = _current_fn->basicblocks().size();
-      _current_bb.instrs.emplace_back(JumpIfArgs {
-        .bb = (unsigned)_current_fn->basicblocks().size() + 1,
-        .bb_else = (unsigned)-1,
-        .cond = _current_reg,
-      });
-      _current_fn->push_basicblock(std::move(_current_bb));
-      _current_bb = BasicBlock{};
-    } else {
-      if (seen_plain_else) {
+  // After a scope; prepare for the next else, if any.
+  size_t next = (slot - 1) / 2;
+  if (next >= expr.elses().size()) {
+    return;
+  }
+  if (!expr.elses()[next].expr()) {
+    for (size_t i = 0; i < next; ++i) {
+      if (!expr.elses()[i].expr()) {
         throw std::runtime_error{"duplicate else block"};
-      } else {
-        seen_plain_else = true;
       }
-      _current_fn->basicblocks()[if_bb_index].instrs.back().jmpif.bb_else =
-        (unsigned)_current_fn->basicblocks().size() + 1;
-      _current_fn->push_basicblock(std::move(_current_bb));
-      _current_bb = BasicBlock{};
     }
-    NodeVisitor::visit(else_.scope());
   }
+  auto if_bb_index = _saved.back();
+  _current_fn->basicblocks()[if_bb_index].instrs.back().jmpif.bb_else =
+    (unsigned)_current_fn->basicblocks().size() + 1;
+  push_basicblock();
+}
 
+void IREmitter::post_visit(const IfExpr &) {
+  auto if_bb_index = _saved.back();
+  _saved.pop_back();
   if (_current_fn->basicblocks()[if_bb_index].instrs.back().jmpif.bb_else ==
     (unsigned)-1) {
     _current_fn->basicblocks()[if_bb_index].instrs.back().jmpif.bb_else =
       (unsigned)_current_fn->basicblocks().size() + 1;
-    _current_fn->push_basicblock(std::move(_current_bb));
-    _current_bb = BasicBlock{};
+    push_basicblock();
   }
 }
 
-void IREmitter::visit(const WhileExpr &expr) {
+// A while loop saves its start block, its conditional jump's block and the
+// enclosing loop's continue target.
+bool IREmitter::pre_visit(const WhileExpr &) {
   _current_bb.instrs.emplace_back(JumpArgs {
     .bb = (unsigned)_current_fn->basicblocks().size() + 1,
   });
-  _current_fn->push_basicblock(std::move(_current_bb));
-  _current_bb = BasicBlock{};
-  unsigned loop_to = (unsigned)_current_fn->basicblocks().size();
-  NodeVisitor::visit(*expr.expr());
-  unsigned bb_if = (unsigned)_current_fn->basicblocks().size();
+  push_basicblock();
+  _saved.push_back((unsigned)_current_fn->basicblocks().size());
+  return true;
+}
+
+void IREmitter::in_visit(const WhileExpr &, size_t slot) {
+  if (slot != 0) {
+    return;
+  }
+  unsigned loop_to = _saved.back();
+  _saved.push_back((unsigned)_current_fn->basicblocks().size());
   _current_bb.instrs.emplace_back(JumpIfArgs {
     .bb = (unsigned)_current_fn->basicblocks().size() + 1,
     .bb_else = (unsigned)-1,
     .cond = _current_reg,
   });
-  _current_fn->push_basicblock(std::move(_current_bb));
-  _current_bb = BasicBlock{};
+  push_basicblock();
 
-  auto prev_continue = _current_continue;
+  _saved.push_back(_current_continue);
   _current_continue = loop_to;
-  NodeVisitor::visit(expr.scope());
-  _current_continue = prev_continue;
+}
+
+void IREmitter::post_visit(const WhileExpr &) {
+  _current_continue = _saved.back();
+  _saved.pop_back();
+  unsigned bb_if = _saved.back();
+  _saved.pop_back();
+  unsigned loop_to = _saved.back();
+  _saved.pop_back();
+
   _current_bb.instrs.emplace_back(JumpArgs {
     .bb = loop_to,
   });
-  _current_fn->push_basicblock(std::move(_current_bb));
-  _current_bb = BasicBlock{};
+  push_basicblock();
   _current_fn->basicblocks()[bb_if].instrs.back().jmpif.bb_else =
     (unsigned)_current_fn->basicblocks().size();
   fix_breaks(loop_to, (unsigned)_current_fn->basicblocks().size());
 }
 
-void IREmitter::visit(const LoopExpr &expr) {
+bool IREmitter::pre_visit(const LoopExpr &) {
   _current_bb.instrs.emplace_back(JumpArgs {
     .bb = (unsigned)_current_fn->basicblocks().size() + 1,
   });
-  _current_fn->push_basicblock(std::move(_current_bb));
-  _current_bb = BasicBlock{};
+  push_basicblock();
   unsigned loop_to = (unsigned)_current_fn->basicblocks().size();
-  auto prev_continue = _current_continue;
+  _saved.push_back(loop_to);
+  _saved.push_back(_current_continue);
   _current_continue = loop_to;
-  NodeVisitor::visit(expr.scope());
-  _current_continue = prev_continue;
+  return true;
+}
+
+void IREmitter::post_visit(const LoopExpr &) {
+  _current_continue = _saved.back();
+  _saved.pop_back();
+  unsigned loop_to = _saved.back();
+  _saved.pop_back();
+
   _current_bb.instrs.emplace_back(JumpArgs {
     .bb = loop_to,
   });
-  _current_fn->push_basicblock(std::move(_current_bb));
-  _current_bb = BasicBlock{};
+  push_basicblock();
   fix_breaks(loop_to, (unsigned)_current_fn->basicblocks().size());
 }
 
-void IREmitter::visit(const BreakContinueExpr &expr) {
+bool IREmitter::pre_visit(const BreakContinueExpr &) {
+  return false;
+}
+
+void IREmitter::post_visit(const BreakContinueExpr &expr) {
   if (expr.is_break()) {
     _current_bb.instrs.emplace_back(JumpArgs {
       .bb = (unsigned)-1,
@@ -470,6 +552,10 @@ void IREmitter::visit(const BreakContinueExpr &expr) {
       .bb = _current_continue,
     });
   }
+  push_basicblock();
+}
+
+void IREmitter::push_basicblock() {
   _current_fn->push_basicblock(std::move(_current_bb));
   _current_bb = BasicBlock{};
 }
@@ -536,15 +622,26 @@ void IREmitter::visit(const FunDefItem &item) {
     throw std::runtime_error{"Undefined symbol"};
   }
 
-  auto *fn = dynamic_cast<Function*>(sym);
+  auto *fn = dyn_cast<Function>(sym);
   if (!fn) {
     throw std::runtime_error{"Symbol not a function"};
   }
 
-  _current_fn = fn;
+  _deps = &_current_ns->dependencies();
+  _deps->remove_user(fn->name());
+  LAVA_SCOPE_EXIT { _deps = nullptr; };
+  emit(item, *fn);
+}
+
+void IREmitter::emit(const FunDefItem &item, Function &fn) {
+  if (!item.is_body_parsed()) {
+    throw std::runtime_error{"Fun body not expanded"};
+  }
+  _current_fn = &fn;
   auto *prev_ns = _current_ns;
-  _current_ns = &fn->locals_namespace();
-  NodeVisitor::visit(item);
+  _current_ns = &fn.locals_namespace();
+  _saved.clear();
+  StaticVisitor::visit(item);
   if (_current_bb.instrs.empty()) {
     _current_bb.instrs.emplace_back(ReturnArgs {
       .value = (unsigned)-1,
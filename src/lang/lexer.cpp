@@ -1,11 +1,40 @@
 #include "lava/lang/lexer.h"
+#include "lava/lang/scan.h"
+#include <cstring>
 
 using namespace lava::lang;
 
-Lexer::Lexer(const SourceDoc &doc) noexcept
+Lexer::Lexer(const SourceDoc &doc, unsigned flags) noexcept
   : doc{&doc}
   , text{doc.content}
+  , base{0}
   , loc{}
+  , track_lines{!(flags & LF_OffsetsOnly)}
+{
+  if (!track_lines) {
+    loc.line = 0;
+    loc.column = 0;
+  }
+}
+
+Lexer::Lexer(const SourceDoc &doc, size_t begin, size_t end,
+             unsigned flags) noexcept
+  : Lexer{doc, flags}
+{
+  text = text.substr(0, end);
+  loc.offset = begin;
+  if (track_lines && begin > 0) {
+    loc = doc.resolve(loc);
+  }
+}
+
+Lexer::Lexer(const SourceDoc &doc, std::string_view window, size_t base,
+             SourceLoc start, unsigned flags) noexcept
+  : doc{&doc}
+  , text{window}
+  , base{base}
+  , loc{start}
+  , track_lines{!(flags & LF_OffsetsOnly)}
 {}
 
 Token Lexer::lex() {
@@ -35,10 +64,11 @@ Token Lexer::lex() {
     lex_number(token);
   } else if (c == '\'' || c == '"') {
     lex_string(token);
-  } else if ((lower >= 'a' && lower <= 'z') || lower == '_') {
+  } else if ((lower >= 'a' && lower <= 'z') || c == '_') {
     lex_ident(token);
     token.end = loc;
-    token.what = get_keyword(token.text());
+    token.what = get_keyword(
+      text.substr(token.start.offset - base, loc.offset - token.start.offset));
     return token;
   } else {
     lex_symbol_or_invalid(token);
@@ -49,123 +79,141 @@ Token Lexer::lex() {
 }
 
 int Lexer::getch(unsigned lookahead) const {
-  if (loc.offset + lookahead >= text.length()) {
+  size_t index = loc.offset - base + lookahead;
+  if (index >= text.length()) {
     return -1;
   }
-  return text[loc.offset + lookahead];
+  return text[index];
 }
 
 void Lexer::nextch() {
-  if (text[loc.offset] == '\n') {
-    loc.column = 1;
-    ++loc.line;
-  } else {
-    ++loc.column;
+  if (track_lines) {
+    if (text[loc.offset - base] == '\n') {
+      loc.column = 1;
+      ++loc.line;
+    } else {
+      ++loc.column;
+    }
   }
   ++loc.offset;
 }
 
-int Lexer::get_keyword(std::string_view word) {
-  switch (word[0]) {
-  case 'b':
-    if (word == "break") {
-      return TkBreak;
+void Lexer::advance_to(const char *p) {
+  const char *first = current();
+  if (track_lines) {
+    if (auto *newline = scan::find_last_newline(first, p)) {
+      loc.line += (uint32_t)scan::count_newlines(first, newline + 1);
+      loc.column = (uint32_t)(p - newline);
+    } else {
+      loc.column += (uint32_t)(p - first);
     }
-    break;
+  }
+  loc.offset = base + (p - text.data());
+}
 
-  case 'c':
-    if (word == "case") {
-      return TkCase;
-    }
-    if (word == "continue") {
-      return TkContinue;
-    }
-    break;
+// Advances to `p`, which must not be past a newline.
+void Lexer::advance_in_line(const char *p) {
+  if (track_lines) {
+    loc.column += (uint32_t)(p - current());
+  }
+  loc.offset = base + (p - text.data());
+}
 
-  case 'e':
-    if (word == "else") {
-      return TkElse;
-    }
-    if (word == "enum") {
-      return TkEnum;
-    }
-    break;
+namespace {
 
-  case 'f':
-    if (word == "fun") {
-      return TkFun;
-    }
-    if (word == "for") {
-      return TkFor;
-    }
-    break;
+// A perfect hash over the keywords in LAVA_KEYWORDS, built at compile time.
+// The hash only looks at the length and the first and last characters, so a
+// lookup costs one table load and one memcmp.
+struct KeywordTable {
+  static constexpr size_t Size = 64;
+  static constexpr size_t MaxLength = 15;
 
-  case 'i':
-    if (word == "if") {
-      return TkIf;
-    }
-    if (word == "in") {
-      return TkIn;
-    }
-    break;
+  struct Slot {
+    char text[MaxLength];
+    uint8_t length;
+    int what;
+  };
 
-  case 'l':
-    if (word == "loop") {
-      return TkLoop;
-    }
-    break;
+  Slot slots[Size]{};
+  unsigned first_mul = 0;
+  unsigned last_mul = 0;
 
-  case 'm':
-    if (word == "mut") {
-      return TkMut;
-    }
-    break;
+  constexpr size_t hash(size_t length, unsigned char first,
+                        unsigned char last) const {
+    return (length + first * first_mul + last * last_mul) & (Size - 1);
+  }
+};
 
-  case 'r':
-    if (word == "return") {
-      return TkReturn;
-    }
-    if (word == "ref") {
-      return TkRef;
-    }
-    break;
+struct KeywordName {
+  std::string_view name;
+  int what;
+};
 
-  case 's':
-    if (word == "switch") {
-      return TkSwitch;
-    }
-    if (word == "struct") {
-      return TkStruct;
-    }
-    break;
+constexpr KeywordName keyword_names[] = {
+#define X(Name) { #Name, Tk##Name },
+  LAVA_KEYWORDS(X)
+#undef X
+};
 
-  case 'u':
-    if (word == "union") {
-      return TkUnion;
-    }
-    break;
+constexpr char to_lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? (char)(c | 0x20) : c;
+}
 
-  case 'w':
-    if (word == "while") {
-      return TkWhile;
+consteval KeywordTable make_keyword_table() {
+  for (unsigned first_mul = 1; first_mul < KeywordTable::Size; ++first_mul) {
+    for (unsigned last_mul = 1; last_mul < KeywordTable::Size; ++last_mul) {
+      KeywordTable table{};
+      table.first_mul = first_mul;
+      table.last_mul = last_mul;
+      bool ok = true;
+      for (auto &kw : keyword_names) {
+        auto &slot = table.slots[table.hash(kw.name.size(),
+                                            to_lower(kw.name.front()),
+                                            to_lower(kw.name.back()))];
+        if (slot.length != 0 || kw.name.size() > KeywordTable::MaxLength) {
+          ok = false;
+          break;
+        }
+        for (size_t i = 0; i < kw.name.size(); ++i) {
+          slot.text[i] = to_lower(kw.name[i]);
+        }
+        slot.length = (uint8_t)kw.name.size();
+        slot.what = kw.what;
+      }
+      if (ok) {
+        return table;
+      }
     }
-    break;
   }
+  throw "no perfect hash for the keyword set; grow KeywordTable::Size";
+}
+
+constexpr KeywordTable keyword_table = make_keyword_table();
+
+} // anonymous namespace
 
+int Lexer::get_keyword(std::string_view word) {
+  if (word.size() > KeywordTable::MaxLength) {
+    return TkIdent;
+  }
+  auto &slot = keyword_table.slots[keyword_table.hash(
+    word.size(), (unsigned char)word.front(), (unsigned char)word.back())];
+  if (slot.length == word.size()
+      && std::memcmp(slot.text, word.data(), word.size()) == 0) {
+    return slot.what;
+  }
   return TkIdent;
 }
 
 void Lexer::lex_whitespace(Token &token) {
   token.what = TkWhitespace;
-  while (true) {
-    nextch();
-    int c = getch();
-    switch (c) {
-    case ' ': case '\t': case '\r': case '\n':
-      continue;
-    default:
-      return;
-    }
+  nextch();
+  // Single spaces between tokens are the common case; don't bother with the
+  // bulk scanner for them.
+  switch (getch()) {
+  case ' ': case '\t': case '\r': case '\n':
+    advance_to(scan::skip_whitespace(current(), text_end()));
+    break;
   }
 }
 
@@ -173,18 +221,9 @@ void Lexer::lex_line_comment(Token &token) {
   token.what = TkLineComment;
   nextch();
   nextch();
-  while (true) {
-    int c = getch();
-    switch (c) {
-    case -1:
-      return;
-    case '\n':
-      nextch();
-      return;
-    default:
-      nextch();
-      break;
-    }
+  advance_in_line(scan::find_byte(current(), text_end(), '\n'));
+  if (getch() == '\n') {
+    nextch();
   }
 }
 
@@ -192,21 +231,12 @@ void Lexer::lex_block_comment(Token &token) {
   token.what = TkBlockComment;
   nextch();
   nextch();
-  int c = getch();
-  int c1 = getch(1);
-  while (true) {
-    if (c == '*' && c1 == '/') {
-      nextch();
-      nextch();
-      return;
-    } else if (c == -1) {
-      // TODO error
-      return;
-    } else {
-      nextch();
-      c = c1;
-      c1 = getch(1);
-    }
+  const char *end = scan::find_block_comment_end(current(), text_end());
+  if (end == text_end()) {
+    // TODO error
+    advance_to(end);
+  } else {
+    advance_to(end + 2);
   }
 }
 
@@ -320,20 +350,14 @@ void Lexer::lex_decimal_part(Token &token) {
 
 void Lexer::lex_string(Token &token) {
   token.what = TkStringLiteral;
-  int close = getch();
+  char close = (char)getch();
   nextch();
-  int c = getch();
-  while (true) {
-    if (c == -1) {
-      // TODO error
-      return;
-    } else if (c == close) {
-      nextch();
-      return;
-    } else {
-      nextch();
-      c = getch();
-    }
+  const char *end = scan::find_byte(current(), text_end(), close);
+  if (end == text_end()) {
+    // TODO error
+    advance_to(end);
+  } else {
+    advance_to(end + 1);
   }
 }
 
@@ -341,15 +365,7 @@ void Lexer::lex_ident(Token &token) {
   // Assigned in keyword handling.
   // token.what = TkIdent;
   nextch();
-  while (true) {
-    int c = getch();
-    int cl = c | 0x20;
-    if ((cl >= 'a' && cl <= 'z') || (cl >= '0' && cl <= '9') || cl == '_') {
-      nextch();
-    } else {
-      return;
-    }
-  }
+  advance_in_line(scan::skip_ident(current(), text_end()));
 }
 
 void Lexer::lex_symbol_or_invalid(Token &token) {
@@ -0,0 +1,69 @@
+#include "lava/lang/mappedfile.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+
+#ifdef _WIN32
+# include <fstream>
+# include <iterator>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+using namespace lava::lang;
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+#ifdef _WIN32
+  std::ifstream ifs{path, std::ios::in | std::ios::binary};
+  if (!ifs) {
+    return;
+  }
+  _buffer.assign(std::istreambuf_iterator<char>{ifs}, {});
+  _data = _buffer.data();
+  _size = _buffer.size();
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *map = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                       fd, 0);
+    if (map != MAP_FAILED) {
+      _map = map;
+      _data = static_cast<const char*>(map);
+      _size = (size_t)st.st_size;
+    }
+  }
+  ::close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (_map) {
+    ::munmap(_map, _size);
+  }
+#endif
+}
+
+std::filesystem::path
+lava::lang::temp_path_for(const std::filesystem::path &path) {
+  static const uint64_t run = [] {
+    std::random_device device;
+    return (uint64_t)device() << 32 | device();
+  }();
+  static std::atomic<unsigned> counter{0};
+
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), ".tmp-%016llx-%u",
+                (unsigned long long)run, counter++);
+  auto temp = path;
+  temp += suffix;
+  return temp;
+}
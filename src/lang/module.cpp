@@ -0,0 +1,873 @@
+#include "lava/lang/module.h"
+#include "lava/lang/mappedfile.h"
+#include "lava/util/hash.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+using namespace lava::lang;
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char Magic[8] = {'l', 'a', 'v', 'a', 'm', 'o', 'd', '\0'};
+constexpr uint32_t Version = 2;
+// An absent string or type.
+constexpr uint32_t None = UINT32_MAX;
+
+// Followed by the instructions, types, members, symbols, blocks, call
+// arguments, string offsets and string bytes, in that order, so every
+// array is naturally aligned.
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t pointer_size;
+  // Symbols directly in the saved namespace.
+  uint32_t root_count;
+  uint32_t string_count;
+  uint32_t string_bytes;
+  uint32_t type_count;
+  uint32_t member_count;
+  uint32_t symbol_count;
+  uint32_t block_count;
+  uint32_t instr_count;
+  uint32_t call_arg_count;
+  uint32_t reserved;
+  // Hash of everything after the header.
+  uint64_t checksum;
+};
+
+// Operands by op:
+//   LdI32, LdI64, LdF32, LdF64: a = dest, wide = value bits.
+//   LdStr, LdVar: a = dest, b = string.
+//   Unary ops: a = dest, b = src.
+//   Call: a = fn, b = argument count, c = first call argument.
+//   Ret: a = value. Jmp: a = block.
+//   JmpIf: a = block, b = else block, c = condition.
+//   Everything else: a = dest, b and c = srcs.
+struct InstrRecord {
+  uint32_t op;
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+  uint64_t wide;
+};
+
+// Pointer: a = pointed at. Array: a = element, b = length.
+// Struct: a = layout, fields are members. Function: a = return type, args
+// are members.
+struct TypeRecord {
+  uint8_t kind;
+  uint8_t reserved[3];
+  uint32_t a;
+  uint32_t b;
+  uint32_t first_member;
+  uint32_t member_count;
+};
+
+// Flags bit 0 marks a cold struct field.
+struct MemberRecord {
+  uint32_t name;
+  uint32_t type;
+  uint32_t flags;
+};
+
+// Flags bit 0 marks a newtype alias.
+struct SymbolRecord {
+  uint8_t kind;
+  uint8_t flags;
+  uint8_t reserved[2];
+  uint32_t name;
+  uint32_t type;
+  uint32_t child_count;
+  uint32_t first_block;
+  uint32_t block_count;
+  uint32_t registers;
+};
+
+struct BlockRecord {
+  uint32_t first_instr;
+  uint32_t instr_count;
+};
+
+static_assert(sizeof(Header) % alignof(InstrRecord) == 0);
+static_assert(sizeof(InstrRecord) == 24 && sizeof(TypeRecord) == 20);
+static_assert(sizeof(MemberRecord) == 12 && sizeof(SymbolRecord) == 28);
+
+uint64_t payload_size(const Header &header) {
+  return (uint64_t)header.instr_count * sizeof(InstrRecord)
+       + (uint64_t)header.type_count * sizeof(TypeRecord)
+       + (uint64_t)header.member_count * sizeof(MemberRecord)
+       + (uint64_t)header.symbol_count * sizeof(SymbolRecord)
+       + (uint64_t)header.block_count * sizeof(BlockRecord)
+       + (uint64_t)header.call_arg_count * sizeof(uint32_t)
+       + ((uint64_t)header.string_count + 1) * sizeof(uint32_t)
+       + header.string_bytes;
+}
+
+constexpr size_t BuiltinTypes = 19;
+
+// The types every table has, which get the first ids.
+std::array<const Type*, BuiltinTypes>
+builtin_types(const SymbolTable &symtab) {
+  return {
+    &symtab.never_type(),
+    &symtab.any_type(),
+    &symtab.void_type(),
+    &symtab.bool_type(),
+    &symtab.null_pointer_type(),
+    &symtab.int_type(1, true),
+    &symtab.int_type(1, false),
+    &symtab.int_type(2, true),
+    &symtab.int_type(2, false),
+    &symtab.int_type(4, true),
+    &symtab.int_type(4, false),
+    &symtab.int_type(8, true),
+    &symtab.int_type(8, false),
+    &symtab.int_type(16, true),
+    &symtab.int_type(16, false),
+    &symtab.int_type(32, true),
+    &symtab.int_type(32, false),
+    &symtab.float_type(4),
+    &symtab.float_type(8),
+  };
+}
+
+bool is_unary(Op op) {
+  switch (op) {
+  case Op::Clz:
+  case Op::Ctz:
+  case Op::Popcount:
+  case Op::Compl:
+  case Op::Not:
+  case Op::Neg:
+    return true;
+  default:
+    return false;
+  }
+}
+
+struct Writer {
+  const SymbolTable *symtab;
+  std::unordered_map<const Type*, uint32_t> type_ids;
+  // Keyed by interner index.
+  std::unordered_map<size_t, uint32_t> string_ids;
+  std::vector<InstrRecord> instrs;
+  std::vector<TypeRecord> types;
+  std::vector<MemberRecord> members;
+  std::vector<SymbolRecord> symbols;
+  std::vector<BlockRecord> blocks;
+  std::vector<uint32_t> call_args;
+  std::vector<uint32_t> string_offsets{0};
+  std::string string_bytes;
+  bool ok = true;
+
+  explicit Writer(const SymbolTable &symtab) : symtab{&symtab} {
+    auto builtins = builtin_types(symtab);
+    for (uint32_t i = 0; i < BuiltinTypes; ++i) {
+      type_ids.emplace(builtins[i], i);
+    }
+  }
+
+  uint32_t string(InternString str) {
+    auto it = string_ids.find(str.index);
+    if (it != string_ids.end()) {
+      return it->second;
+    }
+    uint32_t id = (uint32_t)(string_offsets.size() - 1);
+    string_bytes.append(symtab->get_string(str));
+    string_offsets.push_back((uint32_t)string_bytes.size());
+    string_ids.emplace(str.index, id);
+    return id;
+  }
+
+  // Anonymous names are stored as None.
+  uint32_t name(InternString str) {
+    return str ? string(str) : None;
+  }
+
+  uint32_t type(const Type *type) {
+    auto it = type_ids.find(type);
+    if (it != type_ids.end()) {
+      return it->second;
+    }
+
+    TypeRecord record{};
+    record.kind = (uint8_t)type->kind();
+    switch (type->kind()) {
+    case TypeKind::Pointer: {
+      auto pointer = static_cast<const PointerType*>(type);
+      record.a = this->type(pointer->pointed_at);
+      break;
+    }
+
+    case TypeKind::Array: {
+      auto array = static_cast<const ArrayType*>(type);
+      record.a = this->type(array->element_type);
+      record.b = array->array_length;
+      break;
+    }
+
+    case TypeKind::Struct: {
+      auto struct_type = static_cast<const StructType*>(type);
+      record.a = (uint32_t)struct_type->layout;
+      std::vector<MemberRecord> fields_out;
+      for (auto const &field : struct_type->fields) {
+        fields_out.push_back({
+          name(field.name), this->type(field.type), field.cold ? 1u : 0u
+        });
+      }
+      record.first_member = (uint32_t)members.size();
+      record.member_count = (uint32_t)fields_out.size();
+      members.insert(members.end(), fields_out.begin(), fields_out.end());
+      break;
+    }
+
+    case TypeKind::Function: {
+      auto fn = static_cast<const FunctionType*>(type);
+      record.a = this->type(fn->return_type);
+      std::vector<MemberRecord> args_out;
+      for (auto const &arg : fn->arg_types) {
+        args_out.push_back({name(arg.name), this->type(arg.type), 0});
+      }
+      record.first_member = (uint32_t)members.size();
+      record.member_count = (uint32_t)args_out.size();
+      members.insert(members.end(), args_out.begin(), args_out.end());
+      break;
+    }
+
+    default:
+      // Every other type is built in.
+      ok = false;
+      return None;
+    }
+
+    uint32_t id = (uint32_t)(BuiltinTypes + types.size());
+    types.push_back(record);
+    type_ids.emplace(type, id);
+    return id;
+  }
+
+  InstrRecord instr(const Instruction &instr) {
+    InstrRecord record{};
+    record.op = (uint32_t)instr.op;
+    switch (instr.op) {
+    case Op::LdI32:
+      record.a = instr.ldi32.dest;
+      record.wide = instr.ldi32.value;
+      break;
+
+    case Op::LdI64:
+      record.a = instr.ldi64.dest;
+      record.wide = instr.ldi64.value;
+      break;
+
+    case Op::LdF32: {
+      uint32_t bits;
+      std::memcpy(&bits, &instr.ldf32.value, sizeof(bits));
+      record.a = instr.ldf32.dest;
+      record.wide = bits;
+      break;
+    }
+
+    case Op::LdF64:
+      record.a = instr.ldf64.dest;
+      std::memcpy(&record.wide, &instr.ldf64.value, sizeof(record.wide));
+      break;
+
+    case Op::LdStr:
+      record.a = instr.ldstr.dest;
+      record.b = string(InternString{instr.ldstr.index, instr.ldstr.size});
+      break;
+
+    case Op::LdVar:
+      record.a = instr.ldvar.dest;
+      record.b = string(InternString{instr.ldvar.index, instr.ldvar.size});
+      break;
+
+    case Op::Call:
+      record.a = instr.call.fn;
+      record.b = instr.call.arg_count;
+      record.c = (uint32_t)call_args.size();
+      call_args.insert(call_args.end(), instr.call.args,
+                       instr.call.args + instr.call.arg_count);
+      break;
+
+    case Op::Ret:
+      record.a = instr.ret.value;
+      break;
+
+    case Op::Jmp:
+      record.a = instr.jmp.bb;
+      break;
+
+    case Op::JmpIf:
+      record.a = instr.jmpif.bb;
+      record.b = instr.jmpif.bb_else;
+      record.c = instr.jmpif.cond;
+      break;
+
+    default:
+      if (is_unary(instr.op)) {
+        record.a = instr.unary.dest;
+        record.b = instr.unary.src;
+      } else {
+        record.a = instr.binary.dest;
+        record.b = instr.binary.src[0];
+        record.c = instr.binary.src[1];
+      }
+      break;
+    }
+    return record;
+  }
+
+  void symbol(const Symbol &symbol) {
+    SymbolRecord record{};
+    record.kind = (uint8_t)symbol.kind();
+    record.name = name(symbol.name());
+    record.type = None;
+    const Namespace *children = nullptr;
+
+    if (auto *ns = lava::dyn_cast<Namespace>(&symbol)) {
+      children = ns;
+    } else if (auto *alias = lava::dyn_cast<TypeAlias>(&symbol)) {
+      record.type = type(alias->type);
+      record.flags = alias->is_newtype;
+    } else if (auto *var = lava::dyn_cast<Variable>(&symbol)) {
+      record.type = type(var->type());
+    } else if (auto *fn = lava::dyn_cast<Function>(&symbol)) {
+      record.type = type(fn->type());
+      record.registers = fn->register_count();
+      record.first_block = (uint32_t)blocks.size();
+      record.block_count = (uint32_t)fn->basicblocks().size();
+      for (auto const &bb : fn->basicblocks()) {
+        blocks.push_back({
+          (uint32_t)instrs.size(),
+          (uint32_t)bb.instrs.size(),
+        });
+        for (auto const &i : bb.instrs) {
+          instrs.push_back(instr(i));
+        }
+      }
+      children = &fn->locals_namespace();
+    }
+
+    record.child_count = children ? (uint32_t)children->size() : 0;
+    symbols.push_back(record);
+    if (children) {
+      for (size_t i = 0; i < children->size(); ++i) {
+        this->symbol(*(*children)[i]);
+      }
+    }
+  }
+};
+
+// A view of records in the mapped file. Each is copied out on access, so
+// the file needs no particular alignment.
+template<class T>
+struct Records {
+  const char *data = nullptr;
+  size_t count = 0;
+
+  size_t size() const { return count; }
+
+  T operator[](size_t index) const {
+    T record;
+    std::memcpy(&record, data + index * sizeof(T), sizeof(T));
+    return record;
+  }
+};
+
+template<class T>
+Records<T> take(const char *&p, size_t count) {
+  Records<T> records{p, count};
+  p += count * sizeof(T);
+  return records;
+}
+
+// True if [first, first + count) is within [0, size).
+bool in_range(uint32_t first, uint32_t count, size_t size) {
+  return (uint64_t)first + count <= size;
+}
+
+struct Loader {
+  SymbolTable *symtab;
+  Records<InstrRecord> instrs;
+  Records<TypeRecord> type_records;
+  Records<MemberRecord> members;
+  Records<SymbolRecord> symbols;
+  Records<BlockRecord> blocks;
+  Records<uint32_t> call_args;
+  std::vector<InternString> strings;
+  std::vector<const Type*> types;
+  bool ok = true;
+
+  explicit Loader(SymbolTable &symtab) : symtab{&symtab} {}
+
+  InternString string(uint32_t id) {
+    if (id >= strings.size()) {
+      ok = false;
+      return InternString{};
+    }
+    return strings[id];
+  }
+
+  InternString name(uint32_t id) {
+    return id == None ? InternString{} : string(id);
+  }
+
+  const Type *type(uint32_t id) {
+    if (id >= types.size()) {
+      ok = false;
+      return nullptr;
+    }
+    return types[id];
+  }
+
+  const DataType *data_type(uint32_t id) {
+    auto *data = lava::dyn_cast<DataType>(type(id));
+    if (!data) {
+      ok = false;
+    }
+    return data;
+  }
+
+  const FunctionType *function_type(uint32_t id) {
+    auto *fn = type(id);
+    if (!fn || fn->kind() != TypeKind::Function) {
+      ok = false;
+      return nullptr;
+    }
+    return static_cast<const FunctionType*>(fn);
+  }
+
+  // Types may only refer to earlier ones, so this builds them in order.
+  bool load_types() {
+    auto builtins = builtin_types(*symtab);
+    types.assign(builtins.begin(), builtins.end());
+    for (size_t i = 0; i < type_records.size(); ++i) {
+      auto record = type_records[i];
+      switch ((TypeKind)record.kind) {
+      case TypeKind::Pointer: {
+        auto *pointed_at = type(record.a);
+        if (!ok) {
+          return false;
+        }
+        types.push_back(&symtab->pointer_type(PointerType{pointed_at}));
+        break;
+      }
+
+      case TypeKind::Array: {
+        auto *element = data_type(record.a);
+        if (!ok) {
+          return false;
+        }
+        types.push_back(&symtab->array_type(ArrayType{element, record.b}));
+        break;
+      }
+
+      case TypeKind::Struct: {
+        if (!in_range(record.first_member, record.member_count,
+                      members.size())) {
+          return false;
+        }
+        if (record.a > (uint32_t)StructLayout::Compact) {
+          return false;
+        }
+        StructType::FieldVector fields;
+        for (uint32_t m = 0; m < record.member_count; ++m) {
+          auto member = members[record.first_member + m];
+          fields.emplace_back(name(member.name), data_type(member.type),
+                              (member.flags & 1) != 0);
+        }
+        if (!ok) {
+          return false;
+        }
+        types.push_back(&symtab->struct_type(
+          StructType{std::move(fields), (StructLayout)record.a}
+        ));
+        break;
+      }
+
+      case TypeKind::Function: {
+        if (!in_range(record.first_member, record.member_count,
+                      members.size())) {
+          return false;
+        }
+        auto *return_type = data_type(record.a);
+        FunctionType::ArgVector args;
+        for (uint32_t m = 0; m < record.member_count; ++m) {
+          auto member = members[record.first_member + m];
+          args.emplace_back(name(member.name), data_type(member.type));
+        }
+        if (!ok) {
+          return false;
+        }
+        types.push_back(&symtab->function_type(
+          FunctionType{return_type, std::move(args)}
+        ));
+        break;
+      }
+
+      default:
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Checks the operands against the function being loaded, since nothing
+  // that runs the IR later checks them.
+  bool load_instr(const InstrRecord &record, const SymbolRecord &fn,
+                  BasicBlock &bb) {
+    if (record.op > (uint32_t)Op::JmpIf) {
+      return false;
+    }
+    auto reg = [&](uint32_t r) {
+      if (r >= fn.registers) {
+        ok = false;
+      }
+      return r;
+    };
+    auto block = [&](uint32_t b) {
+      if (b >= fn.block_count) {
+        ok = false;
+      }
+      return b;
+    };
+    Op op = (Op)record.op;
+    switch (op) {
+    case Op::LdI32:
+      bb.instrs.emplace_back(LdI32Args{
+        .dest = reg(record.a),
+        .value = (uint32_t)record.wide,
+      });
+      break;
+
+    case Op::LdI64:
+      bb.instrs.emplace_back(LdI64Args{
+        .dest = reg(record.a),
+        .value = record.wide,
+      });
+      break;
+
+    case Op::LdF32: {
+      uint32_t bits = (uint32_t)record.wide;
+      float value;
+      std::memcpy(&value, &bits, sizeof(value));
+      bb.instrs.emplace_back(LdF32Args{.dest = reg(record.a), .value = value});
+      break;
+    }
+
+    case Op::LdF64: {
+      double value;
+      std::memcpy(&value, &record.wide, sizeof(value));
+      bb.instrs.emplace_back(LdF64Args{.dest = reg(record.a), .value = value});
+      break;
+    }
+
+    case Op::LdStr: {
+      auto str = string(record.b);
+      bb.instrs.emplace_back(LdStrArgs{
+        .dest = reg(record.a),
+        .index = (unsigned)str.index,
+        .size = (unsigned)str.size,
+      });
+      break;
+    }
+
+    case Op::LdVar: {
+      auto str = string(record.b);
+      bb.instrs.emplace_back(LdVarArgs{
+        .dest = reg(record.a),
+        .index = (unsigned)str.index,
+        .size = (unsigned)str.size,
+      });
+      break;
+    }
+
+    case Op::Call: {
+      if (!in_range(record.c, record.b, call_args.size())) {
+        return false;
+      }
+      for (uint32_t i = 0; i < record.b; ++i) {
+        reg(call_args[record.c + i]);
+      }
+      if (!ok) {
+        return false;
+      }
+      // Owned, and freed, by the instruction.
+      Instruction instr{CallArgs{
+        .fn = reg(record.a),
+        .arg_count = record.b,
+        .args = new unsigned[record.b],
+      }};
+      for (uint32_t i = 0; i < record.b; ++i) {
+        instr.call.args[i] = call_args[record.c + i];
+      }
+      bb.instrs.emplace_back(std::move(instr));
+      break;
+    }
+
+    case Op::Ret:
+      // All ones returns nothing.
+      bb.instrs.emplace_back(ReturnArgs{
+        .value = record.a == None ? None : reg(record.a),
+      });
+      break;
+
+    case Op::Jmp:
+      bb.instrs.emplace_back(JumpArgs{.bb = block(record.a)});
+      break;
+
+    case Op::JmpIf:
+      bb.instrs.emplace_back(JumpIfArgs{
+        .bb = block(record.a),
+        .bb_else = block(record.b),
+        .cond = reg(record.c),
+      });
+      break;
+
+    default:
+      if (is_unary(op)) {
+        bb.instrs.emplace_back(op, UnaryArgs{
+          .dest = reg(record.a),
+          .src = reg(record.b),
+        });
+      } else {
+        bb.instrs.emplace_back(op, BinaryArgs{
+          .dest = reg(record.a),
+          .src = { reg(record.b), reg(record.c) },
+        });
+      }
+      break;
+    }
+    return ok;
+  }
+
+  bool load_body(const SymbolRecord &record, Function &fn) {
+    if (!in_range(record.first_block, record.block_count, blocks.size())) {
+      return false;
+    }
+    fn.set_register_count(record.registers);
+    for (uint32_t b = 0; b < record.block_count; ++b) {
+      auto block = blocks[record.first_block + b];
+      if (!in_range(block.first_instr, block.instr_count, instrs.size())) {
+        return false;
+      }
+      BasicBlock bb;
+      bb.instrs.reserve(block.instr_count);
+      for (uint32_t i = 0; i < block.instr_count; ++i) {
+        if (!load_instr(instrs[block.first_instr + i], record, bb)) {
+          return false;
+        }
+      }
+      fn.push_basicblock(std::move(bb));
+    }
+    return true;
+  }
+
+  // Rebuilds the preorder symbol list with an explicit stack of the
+  // namespaces still being filled.
+  bool load_symbols(Namespace &root, uint32_t root_count) {
+    struct Open {
+      Namespace *ns;
+      uint32_t remaining;
+    };
+    std::vector<Open> open{{&root, root_count}};
+    size_t next = 0;
+    while (!open.empty()) {
+      if (open.back().remaining == 0) {
+        open.pop_back();
+        continue;
+      }
+      --open.back().remaining;
+      if (next >= symbols.size()) {
+        return false;
+      }
+      auto record = symbols[next++];
+      Namespace &parent = *open.back().ns;
+      auto name = this->name(record.name);
+
+      std::unique_ptr<Symbol> symbol;
+      Namespace *children = nullptr;
+      switch ((SymbolKind)record.kind) {
+      case SymbolKind::Namespace: {
+        auto ns = std::make_unique<Namespace>(name, parent);
+        children = ns.get();
+        symbol = std::move(ns);
+        break;
+      }
+
+      case SymbolKind::TypeAlias: {
+        auto *type = this->type(record.type);
+        symbol = std::make_unique<TypeAlias>(name, type, record.flags & 1);
+        break;
+      }
+
+      case SymbolKind::Variable: {
+        auto *type = data_type(record.type);
+        symbol = std::make_unique<Variable>(name, type);
+        break;
+      }
+
+      case SymbolKind::Function: {
+        auto *type = function_type(record.type);
+        if (!ok) {
+          return false;
+        }
+        auto fn = std::make_unique<Function>(name, type, parent);
+        if (!load_body(record, *fn)) {
+          return false;
+        }
+        children = &fn->locals_namespace();
+        symbol = std::move(fn);
+        break;
+      }
+
+      default:
+        return false;
+      }
+
+      if (!ok || (!children && record.child_count != 0)
+          || !parent.add(std::move(symbol))) {
+        return false;
+      }
+      if (children) {
+        open.push_back({children, record.child_count});
+      }
+    }
+    return next == symbols.size();
+  }
+};
+
+} // anonymous namespace
+
+bool lava::lang::save_module(const SymbolTable &symtab, const Namespace &ns,
+                             const fs::path &path) {
+  Writer writer{symtab};
+  size_t first = 0;
+  if (&ns == &symtab.global_namespace()) {
+    first = std::min(symtab.builtin_symbol_count(), ns.size());
+  }
+  for (size_t i = first; i < ns.size(); ++i) {
+    writer.symbol(*ns[i]);
+  }
+  if (!writer.ok || writer.string_bytes.size() > UINT32_MAX
+      || writer.instrs.size() > UINT32_MAX
+      || writer.call_args.size() > UINT32_MAX) {
+    return false;
+  }
+
+  Header header{};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.pointer_size = PointerType::TargetPointerSize;
+  header.root_count = (uint32_t)(ns.size() - first);
+  header.string_count = (uint32_t)(writer.string_offsets.size() - 1);
+  header.string_bytes = (uint32_t)writer.string_bytes.size();
+  header.type_count = (uint32_t)writer.types.size();
+  header.member_count = (uint32_t)writer.members.size();
+  header.symbol_count = (uint32_t)writer.symbols.size();
+  header.block_count = (uint32_t)writer.blocks.size();
+  header.instr_count = (uint32_t)writer.instrs.size();
+  header.call_arg_count = (uint32_t)writer.call_args.size();
+
+  std::string payload;
+  payload.reserve(payload_size(header));
+  auto append = [&](auto const &array) {
+    payload.append(reinterpret_cast<const char*>(array.data()),
+                   array.size() * sizeof(array[0]));
+  };
+  append(writer.instrs);
+  append(writer.types);
+  append(writer.members);
+  append(writer.symbols);
+  append(writer.blocks);
+  append(writer.call_args);
+  append(writer.string_offsets);
+  payload.append(writer.string_bytes);
+  header.checksum = hash_bytes(payload);
+
+  // Write to a private name and rename, so that a reader never sees a
+  // partial module.
+  auto temp = temp_path_for(path);
+  {
+    std::ofstream ofs{temp, std::ios::out | std::ios::binary
+                            | std::ios::trunc};
+    if (!ofs) {
+      return false;
+    }
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    ofs.write(payload.data(), (std::streamsize)payload.size());
+    if (!ofs) {
+      std::error_code ec;
+      ofs.close();
+      fs::remove(temp, ec);
+      return false;
+    }
+  }
+  std::error_code ec;
+  fs::rename(temp, path, ec);
+  if (ec) {
+    fs::remove(temp, ec);
+    return false;
+  }
+  return true;
+}
+
+Namespace *lava::lang::load_module(SymbolTable &symtab, InternString name,
+                                   const fs::path &path) {
+  MappedFile file{path};
+  if (file.size() < sizeof(Header)) {
+    return nullptr;
+  }
+
+  Header header;
+  std::memcpy(&header, file.data(), sizeof(Header));
+  if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+      || header.version != Version
+      || header.pointer_size != PointerType::TargetPointerSize
+      || file.size() - sizeof(Header) != payload_size(header)) {
+    return nullptr;
+  }
+  const char *p = file.data() + sizeof(Header);
+  if (hash_bytes({p, (size_t)payload_size(header)}) != header.checksum) {
+    return nullptr;
+  }
+
+  Loader loader{symtab};
+  loader.instrs = take<InstrRecord>(p, header.instr_count);
+  loader.type_records = take<TypeRecord>(p, header.type_count);
+  loader.members = take<MemberRecord>(p, header.member_count);
+  loader.symbols = take<SymbolRecord>(p, header.symbol_count);
+  loader.blocks = take<BlockRecord>(p, header.block_count);
+  loader.call_args = take<uint32_t>(p, header.call_arg_count);
+  auto offsets = take<uint32_t>(p, header.string_count + (size_t)1);
+  const char *bytes = p;
+
+  if (offsets[0] != 0 || offsets[header.string_count] != header.string_bytes) {
+    return nullptr;
+  }
+  loader.strings.reserve(header.string_count);
+  for (size_t i = 0; i < header.string_count; ++i) {
+    uint32_t start = offsets[i];
+    uint32_t end = offsets[i + 1];
+    if (end < start) {
+      return nullptr;
+    }
+    loader.strings.push_back(symtab.intern({bytes + start, end - start}));
+  }
+
+  if (!loader.load_types()) {
+    return nullptr;
+  }
+  auto &global = symtab.global_namespace();
+  auto module = std::make_unique<Namespace>(name, global);
+  if (!loader.load_symbols(*module, header.root_count)) {
+    return nullptr;
+  }
+  return static_cast<Namespace*>(global.add(std::move(module)));
+}
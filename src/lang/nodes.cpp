@@ -4,6 +4,50 @@
 
 using namespace lava::lang;
 
+namespace {
+
+void shift(std::unique_ptr<Expr> &expr, ptrdiff_t delta) {
+  if (expr) {
+    expr->shift(delta);
+  }
+}
+
+template<class T>
+void shift(std::optional<T> &value, ptrdiff_t delta) {
+  if (value) {
+    value->shift(delta);
+  }
+}
+
+template<class T>
+void shift(T &value, ptrdiff_t delta) {
+  value.shift(delta);
+}
+
+template<class T>
+void shift(std::vector<WithDelimiter<T>> &values, ptrdiff_t delta) {
+  for (auto &value : values) {
+    shift(value.value, delta);
+    shift(value.delimiter, delta);
+  }
+}
+
+using ExprStack = std::vector<std::unique_ptr<Expr>>;
+
+void release(std::unique_ptr<Expr> &expr, ExprStack &out) {
+  if (expr) {
+    out.push_back(std::move(expr));
+  }
+}
+
+void release(ExprsWithDelimiter &exprs, ExprStack &out) {
+  for (auto &expr : exprs) {
+    release(expr.value, out);
+  }
+}
+
+} // anonymous namespace
+
 // ------------------------------------------------------------------------- //
 
 Node::~Node() {}
@@ -30,12 +74,37 @@ SourceLoc Document::end() const {
   return _items.back()->end();
 }
 
+void Document::shift(ptrdiff_t delta) {
+  for (auto &item : _items) {
+    item->shift(delta);
+  }
+}
+
 // ------------------------------------------------------------------------- //
 
 NodeKind Expr::node_kind() const {
   return NodeKind::Expr;
 }
 
+void Expr::release_children(std::vector<std::unique_ptr<Expr>> &) {}
+
+void Expr::release_children(ScopeExpr &scope,
+                            std::vector<std::unique_ptr<Expr>> &out) {
+  static_cast<Expr&>(scope).release_children(out);
+}
+
+void Expr::drop_children() noexcept {
+  std::vector<std::unique_ptr<Expr>> stack;
+  release_children(stack);
+  while (!stack.empty()) {
+    auto expr = std::move(stack.back());
+    stack.pop_back();
+    // Once its children are on the stack, `expr` is a leaf and frees
+    // without recursing.
+    expr->release_children(stack);
+  }
+}
+
 // ------------------------------------------------------------------------- //
 
 LiteralExpr::~LiteralExpr() {}
@@ -52,6 +121,10 @@ ExprKind LiteralExpr::expr_kind() const {
   return ExprKind::Literal;
 }
 
+void LiteralExpr::shift(ptrdiff_t delta) {
+  _token.shift(delta);
+}
+
 // ------------------------------------------------------------------------- //
 
 IdentExpr::~IdentExpr() {}
@@ -68,9 +141,15 @@ ExprKind IdentExpr::expr_kind() const {
   return ExprKind::Ident;
 }
 
+void IdentExpr::shift(ptrdiff_t delta) {
+  _token.shift(delta);
+}
+
 // ------------------------------------------------------------------------- //
 
-PrefixExpr::~PrefixExpr() {}
+PrefixExpr::~PrefixExpr() {
+  drop_children();
+}
 
 SourceLoc PrefixExpr::start() const {
   return _op.start;
@@ -84,9 +163,20 @@ ExprKind PrefixExpr::expr_kind() const {
   return ExprKind::Prefix;
 }
 
+void PrefixExpr::shift(ptrdiff_t delta) {
+  _op.shift(delta);
+  ::shift(_expr, delta);
+}
+
+void PrefixExpr::release_children(ExprStack &out) {
+  release(_expr, out);
+}
+
 // ------------------------------------------------------------------------- //
 
-PostfixExpr::~PostfixExpr() {}
+PostfixExpr::~PostfixExpr() {
+  drop_children();
+}
 
 SourceLoc PostfixExpr::start() const {
   return _expr->start();
@@ -100,9 +190,20 @@ ExprKind PostfixExpr::expr_kind() const {
   return ExprKind::Postfix;
 }
 
+void PostfixExpr::shift(ptrdiff_t delta) {
+  _op.shift(delta);
+  ::shift(_expr, delta);
+}
+
+void PostfixExpr::release_children(ExprStack &out) {
+  release(_expr, out);
+}
+
 // ------------------------------------------------------------------------- //
 
-BinaryExpr::~BinaryExpr() {}
+BinaryExpr::~BinaryExpr() {
+  drop_children();
+}
 
 SourceLoc BinaryExpr::start() const {
   return _left->start();
@@ -116,9 +217,22 @@ ExprKind BinaryExpr::expr_kind() const {
   return ExprKind::Binary;
 }
 
+void BinaryExpr::shift(ptrdiff_t delta) {
+  _op.shift(delta);
+  ::shift(_left, delta);
+  ::shift(_right, delta);
+}
+
+void BinaryExpr::release_children(ExprStack &out) {
+  release(_left, out);
+  release(_right, out);
+}
+
 // ------------------------------------------------------------------------- //
 
-ParenExpr::~ParenExpr() {}
+ParenExpr::~ParenExpr() {
+  drop_children();
+}
 
 SourceLoc ParenExpr::start() const {
   return _left.start;
@@ -132,9 +246,21 @@ ExprKind ParenExpr::expr_kind() const {
   return ExprKind::Paren;
 }
 
+void ParenExpr::shift(ptrdiff_t delta) {
+  _left.shift(delta);
+  _right.shift(delta);
+  ::shift(_expr, delta);
+}
+
+void ParenExpr::release_children(ExprStack &out) {
+  release(_expr, out);
+}
+
 // ------------------------------------------------------------------------- //
 
-InvokeExpr::~InvokeExpr() {}
+InvokeExpr::~InvokeExpr() {
+  drop_children();
+}
 
 SourceLoc InvokeExpr::start() const {
   return _expr->start();
@@ -148,6 +274,18 @@ ExprKind InvokeExpr::expr_kind() const {
   return ExprKind::Invoke;
 }
 
+void InvokeExpr::shift(ptrdiff_t delta) {
+  ::shift(_expr, delta);
+  _lparen.shift(delta);
+  _rparen.shift(delta);
+  ::shift(_args, delta);
+}
+
+void InvokeExpr::release_children(ExprStack &out) {
+  release(_expr, out);
+  release(_args, out);
+}
+
 auto InvokeExpr::bracket_kind() const -> BracketKind {
   switch (_lparen.what) {
   case TkLeftParen:
@@ -163,7 +301,9 @@ auto InvokeExpr::bracket_kind() const -> BracketKind {
 
 // ------------------------------------------------------------------------- //
 
-ScopeExpr::~ScopeExpr() {}
+ScopeExpr::~ScopeExpr() {
+  drop_children();
+}
 
 SourceLoc ScopeExpr::start() const {
   return _lbrace.start;
@@ -177,9 +317,21 @@ ExprKind ScopeExpr::expr_kind() const {
   return ExprKind::Scope;
 }
 
+void ScopeExpr::shift(ptrdiff_t delta) {
+  _lbrace.shift(delta);
+  _rbrace.shift(delta);
+  ::shift(_exprs, delta);
+}
+
+void ScopeExpr::release_children(ExprStack &out) {
+  release(_exprs, out);
+}
+
 // ------------------------------------------------------------------------- //
 
-ReturnExpr::~ReturnExpr() {}
+ReturnExpr::~ReturnExpr() {
+  drop_children();
+}
 
 SourceLoc ReturnExpr::start() const {
   return _return.start;
@@ -193,9 +345,20 @@ ExprKind ReturnExpr::expr_kind() const {
   return ExprKind::Return;
 }
 
+void ReturnExpr::shift(ptrdiff_t delta) {
+  _return.shift(delta);
+  ::shift(_expr, delta);
+}
+
+void ReturnExpr::release_children(ExprStack &out) {
+  release(_expr, out);
+}
+
 // ------------------------------------------------------------------------- //
 
-IfExpr::~IfExpr() {}
+IfExpr::~IfExpr() {
+  drop_children();
+}
 
 SourceLoc IfExpr::start() const {
   return _if.start;
@@ -213,9 +376,38 @@ ExprKind IfExpr::expr_kind() const {
   return ExprKind::If;
 }
 
+void IfExpr::shift(ptrdiff_t delta) {
+  _if.shift(delta);
+  ::shift(_expr, delta);
+  _scope.shift(delta);
+  for (auto &else_ : _elses) {
+    else_.shift(delta);
+  }
+}
+
+void IfExpr::release_children(ExprStack &out) {
+  release(_expr, out);
+  Expr::release_children(_scope, out);
+  for (auto &else_ : _elses) {
+    release(else_._expr, out);
+    Expr::release_children(else_._scope, out);
+  }
+}
+
+void ElsePart::shift(ptrdiff_t delta) {
+  _else.shift(delta);
+  if (_expr) {
+    _if.shift(delta);
+    _expr->shift(delta);
+  }
+  _scope.shift(delta);
+}
+
 // ------------------------------------------------------------------------- //
 
-WhileExpr::~WhileExpr() {}
+WhileExpr::~WhileExpr() {
+  drop_children();
+}
 
 SourceLoc WhileExpr::start() const {
   return _while.start;
@@ -229,9 +421,22 @@ ExprKind WhileExpr::expr_kind() const {
   return ExprKind::While;
 }
 
+void WhileExpr::shift(ptrdiff_t delta) {
+  _while.shift(delta);
+  ::shift(_expr, delta);
+  _scope.shift(delta);
+}
+
+void WhileExpr::release_children(ExprStack &out) {
+  release(_expr, out);
+  Expr::release_children(_scope, out);
+}
+
 // ------------------------------------------------------------------------- //
 
-LoopExpr::~LoopExpr() {}
+LoopExpr::~LoopExpr() {
+  drop_children();
+}
 
 
 SourceLoc LoopExpr::start() const {
@@ -246,9 +451,20 @@ ExprKind LoopExpr::expr_kind() const {
   return ExprKind::Loop;
 }
 
+void LoopExpr::shift(ptrdiff_t delta) {
+  _loop.shift(delta);
+  _scope.shift(delta);
+}
+
+void LoopExpr::release_children(ExprStack &out) {
+  Expr::release_children(_scope, out);
+}
+
 // ------------------------------------------------------------------------- //
 
-BreakContinueExpr::~BreakContinueExpr() {}
+BreakContinueExpr::~BreakContinueExpr() {
+  drop_children();
+}
 
 SourceLoc BreakContinueExpr::start() const {
   return _break_or_continue.start;
@@ -262,6 +478,15 @@ ExprKind BreakContinueExpr::expr_kind() const {
   return ExprKind::BreakContinue;
 }
 
+void BreakContinueExpr::shift(ptrdiff_t delta) {
+  _break_or_continue.shift(delta);
+  ::shift(_expr, delta);
+}
+
+void BreakContinueExpr::release_children(ExprStack &out) {
+  release(_expr, out);
+}
+
 // ------------------------------------------------------------------------- //
 
 NodeKind Item::node_kind() const {
@@ -284,6 +509,10 @@ ItemKind EmptyItem::item_kind() const {
   return ItemKind::Empty;
 }
 
+void EmptyItem::shift(ptrdiff_t delta) {
+  _semi.shift(delta);
+}
+
 // ------------------------------------------------------------------------- //
 
 ExprItem::~ExprItem() {}
@@ -300,6 +529,11 @@ ItemKind ExprItem::item_kind() const {
   return ItemKind::Expr;
 }
 
+void ExprItem::shift(ptrdiff_t delta) {
+  ::shift(_expr, delta);
+  _semi.shift(delta);
+}
+
 // ------------------------------------------------------------------------- //
 
 VarDeclItem::~VarDeclItem() {}
@@ -316,6 +550,22 @@ ItemKind VarDeclItem::item_kind() const {
   return ItemKind::VarDecl;
 }
 
+void VarDeclItem::shift(ptrdiff_t delta) {
+  ::shift(_type, delta);
+  ::shift(_decls, delta);
+  _semi.shift(delta);
+}
+
+void VarInit::shift(ptrdiff_t delta) {
+  _eq.shift(delta);
+  ::shift(_expr, delta);
+}
+
+void VarDecl::shift(ptrdiff_t delta) {
+  _name.shift(delta);
+  ::shift(_init, delta);
+}
+
 // ------------------------------------------------------------------------- //
 
 FunItemBase::~FunItemBase() {}
@@ -324,6 +574,30 @@ SourceLoc FunItemBase::start() const {
   return _fun.start;
 }
 
+void FunItemBase::shift(ptrdiff_t delta) {
+  _fun.shift(delta);
+  _name.shift(delta);
+  _args.shift(delta);
+  ::shift(_return, delta);
+}
+
+void ArgDecl::shift(ptrdiff_t delta) {
+  ::shift(_type, delta);
+  _name.shift(delta);
+  ::shift(_init, delta);
+}
+
+void ArgList::shift(ptrdiff_t delta) {
+  _lparen.shift(delta);
+  _rparen.shift(delta);
+  ::shift(_args, delta);
+}
+
+void ReturnSpec::shift(ptrdiff_t delta) {
+  _arrow.shift(delta);
+  ::shift(_type, delta);
+}
+
 // ------------------------------------------------------------------------- //
 
 FunDeclItem::~FunDeclItem() {}
@@ -336,18 +610,37 @@ ItemKind FunDeclItem::item_kind() const {
   return ItemKind::FunDecl;
 }
 
+void FunDeclItem::shift(ptrdiff_t delta) {
+  FunItemBase::shift(delta);
+  _semi.shift(delta);
+}
+
 // ------------------------------------------------------------------------- //
 
 FunDefItem::~FunDefItem() {}
 
 SourceLoc FunDefItem::end() const {
-  return _body.end();
+  return _body ? _body->end() : _rbrace.end;
 }
 
 ItemKind FunDefItem::item_kind() const {
   return ItemKind::FunDef;
 }
 
+void FunDefItem::shift(ptrdiff_t delta) {
+  FunItemBase::shift(delta);
+  if (_body) {
+    _body->shift(delta);
+  } else {
+    _lbrace.shift(delta);
+    _rbrace.shift(delta);
+  }
+}
+
+SourceLoc FunDefItem::body_start() const {
+  return _body ? _body->start() : _lbrace.start;
+}
+
 // ------------------------------------------------------------------------- //
 
 StructDefItem::~StructDefItem() {}
@@ -363,3 +656,13 @@ SourceLoc StructDefItem::end() const {
 ItemKind StructDefItem::item_kind() const {
   return ItemKind::StructDef;
 }
+
+void StructDefItem::shift(ptrdiff_t delta) {
+  _struct_or_union.shift(delta);
+  _name.shift(delta);
+  _lbrace.shift(delta);
+  _rbrace.shift(delta);
+  for (auto &var : _vars) {
+    var.shift(delta);
+  }
+}
@@ -0,0 +1,283 @@
+#include "lava/lang/parsecache.h"
+#include "lava/lang/mappedfile.h"
+#include "lava/lang/parser.h"
+#include "lava/util/hash.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+using namespace lava::lang;
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char Magic[8] = {'l', 'a', 'v', 'a', 'p', 'c', '\0', '\0'};
+constexpr uint32_t Version = 1;
+
+// Followed by the token starts, token lengths, tree refs, tree nodes and
+// token kinds, in that order, so every array is naturally aligned.
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t node_size;
+  uint64_t content_size;
+  // A second hash of the content, with a different seed from the one in
+  // the file name.
+  uint64_t content_check;
+  uint64_t token_count;
+  uint64_t node_count;
+  uint64_t ref_count;
+  // Hash of everything after the header.
+  uint64_t checksum;
+};
+
+static_assert(std::is_trivially_copyable_v<FlatTree::Node>);
+static_assert(sizeof(Header) % alignof(FlatTree::Node) == 0);
+
+uint64_t content_check(const SourceDoc &doc) {
+  return lava::hash_bytes(doc.content, 1);
+}
+
+size_t payload_size(const Header &header) {
+  return header.token_count * (2 * sizeof(uint32_t) + 1)
+       + header.ref_count * sizeof(uint32_t)
+       + header.node_count * sizeof(FlatTree::Node);
+}
+
+template<class T>
+std::vector<T> read_array(const char *&p, size_t count) {
+  std::vector<T> array(count);
+  std::memcpy(array.data(), p, count * sizeof(T));
+  p += count * sizeof(T);
+  return array;
+}
+
+template<class T>
+void write_array(std::ofstream &ofs, const std::vector<T> &array) {
+  ofs.write(reinterpret_cast<const char*>(array.data()),
+            (std::streamsize)(array.size() * sizeof(T)));
+}
+
+// Checks that every reference stays in bounds, so a stale or damaged entry
+// that passes the checksum still can't send `expand` out of range.
+bool is_valid_tree(const std::vector<FlatTree::Node> &nodes,
+                   const std::vector<uint32_t> &refs, size_t token_count) {
+  if (nodes.empty() || nodes[0].kind != FlatKind::Document) {
+    return false;
+  }
+  for (size_t n = 0; n < nodes.size(); ++n) {
+    auto const &node = nodes[n];
+    if (node.kind > FlatKind::StructDefItem || node.end <= n
+        || node.end > nodes.size()) {
+      return false;
+    }
+    size_t words = (size_t)node.token_count + node.child_count;
+    if (node.kind == FlatKind::Literal) {
+      words += 2;
+    }
+    if (node.refs > refs.size() || words > refs.size() - node.refs) {
+      return false;
+    }
+    for (size_t i = 0; i < node.token_count; ++i) {
+      uint32_t ref = refs[node.refs + i];
+      if (ref != FlatTree::None && ref >= token_count) {
+        return false;
+      }
+    }
+    for (size_t i = 0; i < node.child_count; ++i) {
+      uint32_t ref = refs[node.refs + node.token_count + i];
+      if (ref != FlatTree::None && (ref <= n || ref >= node.end)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+ParseCache::ParseCache(fs::path dir, uint64_t max_bytes)
+  : _dir{std::move(dir)}
+  , _max_bytes{max_bytes}
+{
+  std::error_code ec;
+  fs::create_directories(_dir, ec);
+}
+
+fs::path ParseCache::entry_path(const SourceDoc &doc) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.lavacache",
+           (unsigned long long)hash_bytes(doc.content));
+  return _dir / name;
+}
+
+auto ParseCache::parse(const SourceDoc &doc, Diagnostics *diagnostics)
+  -> Result
+{
+  Result result = load(doc);
+  if (result.tokens) {
+    return result;
+  }
+
+  result.tokens = std::make_unique<TokenBuffer>(doc);
+  result._document = Parser{*result.tokens, 0, diagnostics}.parse_document();
+  if (result._document) {
+    result.tree = std::make_unique<FlatTree>(*result._document,
+                                             *result.tokens);
+    store(doc, *result.tokens, *result.tree);
+  }
+  return result;
+}
+
+auto ParseCache::load(const SourceDoc &doc) const -> Result {
+  Result result;
+  auto path = entry_path(doc);
+  MappedFile file{path};
+  if (file.size() < sizeof(Header)) {
+    return result;
+  }
+
+  Header header;
+  std::memcpy(&header, file.data(), sizeof(Header));
+  if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+      || header.version != Version
+      || header.node_size != sizeof(FlatTree::Node)
+      || header.content_size != doc.content.size()
+      || header.token_count == 0
+      || header.token_count > UINT32_MAX
+      || header.node_count > UINT32_MAX
+      || header.ref_count > UINT32_MAX
+      || file.size() - sizeof(Header) != payload_size(header)) {
+    return result;
+  }
+  const char *p = file.data() + sizeof(Header);
+  if (hash_bytes({p, payload_size(header)}) != header.checksum
+      || content_check(doc) != header.content_check) {
+    return result;
+  }
+
+  auto starts = read_array<uint32_t>(p, header.token_count);
+  auto lengths = read_array<uint32_t>(p, header.token_count);
+  auto refs = read_array<uint32_t>(p, header.ref_count);
+  auto nodes = read_array<FlatTree::Node>(p, header.node_count);
+  auto kinds = read_array<uint8_t>(p, header.token_count);
+  for (size_t i = 0; i < starts.size(); ++i) {
+    if ((size_t)starts[i] + lengths[i] > doc.content.size()) {
+      return result;
+    }
+  }
+  if (!is_valid_tree(nodes, refs, header.token_count)) {
+    return result;
+  }
+
+  auto tokens = std::unique_ptr<TokenBuffer>{new TokenBuffer{
+    doc, std::move(kinds), std::move(starts), std::move(lengths)
+  }};
+  result.tree = std::unique_ptr<FlatTree>{new FlatTree{
+    *tokens, std::move(nodes), std::move(refs)
+  }};
+  result.tokens = std::move(tokens);
+  result.hit = true;
+
+  // Entries are evicted least recently used first.
+  std::error_code ec;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  return result;
+}
+
+bool ParseCache::store(const SourceDoc &doc, const TokenBuffer &tokens,
+                       const FlatTree &tree) {
+  Header header;
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.node_size = sizeof(FlatTree::Node);
+  header.content_size = doc.content.size();
+  header.content_check = content_check(doc);
+  header.token_count = tokens.size();
+  header.node_count = tree._nodes.size();
+  header.ref_count = tree._refs.size();
+
+  // Hash the payload as it will be laid out in the file.
+  std::string payload;
+  payload.reserve(payload_size(header));
+  auto append = [&](auto const &array) {
+    payload.append(reinterpret_cast<const char*>(array.data()),
+                   array.size() * sizeof(array[0]));
+  };
+  append(tokens._starts);
+  append(tokens._lengths);
+  append(tree._refs);
+  append(tree._nodes);
+  append(tokens._kinds);
+  header.checksum = hash_bytes(payload);
+
+  // Write to a private name and rename, so that a reader never sees a
+  // partial entry.
+  auto path = entry_path(doc);
+  auto temp = temp_path_for(path);
+  {
+    std::ofstream ofs{temp, std::ios::out | std::ios::binary
+                            | std::ios::trunc};
+    if (!ofs) {
+      return false;
+    }
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    ofs.write(payload.data(), (std::streamsize)payload.size());
+    if (!ofs) {
+      std::error_code ec;
+      ofs.close();
+      fs::remove(temp, ec);
+      return false;
+    }
+  }
+  std::error_code ec;
+  fs::rename(temp, path, ec);
+  if (ec) {
+    fs::remove(temp, ec);
+    return false;
+  }
+
+  evict(_max_bytes);
+  return true;
+}
+
+void ParseCache::evict(uint64_t max_bytes) {
+  struct Entry {
+    fs::file_time_type time;
+    uint64_t size;
+    fs::path path;
+  };
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+
+  std::error_code ec;
+  for (auto const &file : fs::directory_iterator{_dir, ec}) {
+    if (file.path().extension() != ".lavacache") {
+      continue;
+    }
+    std::error_code file_ec;
+    auto size = file.file_size(file_ec);
+    auto time = file.last_write_time(file_ec);
+    if (file_ec) {
+      continue;
+    }
+    entries.push_back({time, size, file.path()});
+    total += size;
+  }
+  if (total <= max_bytes) {
+    return;
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.time < b.time; });
+  for (auto const &entry : entries) {
+    if (total <= max_bytes) {
+      break;
+    }
+    if (fs::remove(entry.path, ec)) {
+      total -= entry.size;
+    }
+  }
+}
@@ -1,28 +1,80 @@
 #include "lava/lang/parser.h"
 #include "lava/lang/lexer.h"
-#include <cstdio>
+#include "lava/lang/visitor.h"
+#include "lava/util/hash.h"
+#include "lava/util/scope_exit.h"
+#include "lava/util/thread_pool.h"
+#include <algorithm>
 #include <charconv>
 #include <cassert>
+#include <unordered_map>
 
 using namespace lava::lang;
 
 static const unsigned CallPrec = 17;
 
-#define ERROR(err) \
-  fprintf(stderr, "%s:%d:%d: error: %s (found %.*s)\n", \
-          token.doc->name.c_str(), \
-          token.start.line, token.start.column, err, \
-          (int)get_token_name(token.what).size(), \
-          get_token_name(token.what).data())
+#define ERROR(err) do { \
+  if (diagnostics) { \
+    diagnostics->error(token, err); \
+  } \
+} while (0)
 
 
-Parser::Parser(Lexer &lexer) noexcept
+Parser::Parser(Lexer &lexer, Diagnostics *diagnostics) noexcept
   : lexer{&lexer}
+  , tokens{nullptr}
+  , index{0}
+  , span_end{0}
+  , span_parent{0}
+  , reuse{nullptr}
+  , lazy_bodies{false}
+  , diagnostics{diagnostics}
 {
   next();
 }
 
+Parser::Parser(const TokenBuffer &tokens, int flags,
+               Diagnostics *diagnostics) noexcept
+  : lexer{nullptr}
+  , tokens{&tokens}
+  , index{tokens.skip_trivia(0)}
+  , token{tokens.token(index)}
+  , span_end{0}
+  , span_parent{0}
+  , reuse{nullptr}
+  , lazy_bodies{(flags & PF_LazyBodies) != 0}
+  , diagnostics{diagnostics}
+{}
+
+int Parser::peek(unsigned n) const {
+  assert(tokens && "lookahead requires a token buffer");
+  size_t i = index;
+  while (n-- && tokens->kind(i) != TkEof) {
+    i = tokens->skip_trivia(i + 1);
+  }
+  return tokens->kind(i);
+}
+
+size_t Parser::mark() const {
+  assert(tokens && "backtracking requires a token buffer");
+  return index;
+}
+
+void Parser::reset(size_t mark) {
+  assert(tokens && "backtracking requires a token buffer");
+  index = mark;
+  token = tokens->token(index);
+}
+
 void Parser::next() {
+  if (tokens) {
+    if (token.what != TkEof) {
+      span_end = index + 1;
+      index = tokens->skip_trivia(index + 1);
+      token = tokens->token(index);
+    }
+    return;
+  }
   do {
     token = lexer->lex();
   } while (token.what == TkWhitespace
@@ -50,7 +102,314 @@ std::unique_ptr<Document> Parser::parse_document() {
   return std::make_unique<Document>(std::move(items));
 }
 
+std::unique_ptr<Document>
+Parser::parse_document(ThreadPool &pool, size_t min_chunk_tokens) {
+  assert(tokens && "parallel parsing requires a token buffer");
+
+  // Where each item ends if the input is valid: at a `;` outside of braces
+  // or at the `}` that closes a function or struct body.
+  std::vector<size_t> ends{span_end};
+  int depth = 0;
+  int head = TkEof;
+  for (size_t i = index; tokens->kind(i) != TkEof;
+       i = tokens->skip_trivia(i + 1)) {
+    int kind = tokens->kind(i);
+    if (head == TkEof) {
+      head = kind;
+    }
+    bool end = false;
+    if (kind == TkLeftBrace) {
+      ++depth;
+    } else if (kind == TkRightBrace) {
+      end = --depth == 0
+        && (head == TkFun || head == TkStruct || head == TkUnion);
+    } else if (kind == TkSemi) {
+      end = depth == 0;
+    }
+    if (end) {
+      ends.push_back(i + 1);
+      head = TkEof;
+    }
+  }
+
+  const size_t total = ends.back() - ends.front();
+  size_t count = std::min<size_t>(
+    total / std::max<size_t>(min_chunk_tokens, 1), pool.concurrency() * 4);
+  if (count < 2 || depth != 0 || head != TkEof) {
+    return parse_document();
+  }
+
+  // Chunks are runs of whole items, given as indices into `ends`.
+  std::vector<size_t> bounds{0};
+  for (size_t i = 1; i < count; ++i) {
+    auto it = std::lower_bound(ends.begin() + bounds.back() + 1, ends.end(),
+                               ends.front() + total * i / count);
+    if (it >= ends.end() - 1) {
+      break;
+    }
+    bounds.push_back(it - ends.begin());
+  }
+  bounds.push_back(ends.size() - 1);
+
+  struct Chunk {
+    std::vector<std::unique_ptr<Item>> items;
+    bool ok;
+  };
+  std::vector<Chunk> chunks(bounds.size() - 1);
+  pool.parallel_for(chunks.size(), [&](size_t i) {
+    Parser parser{*tokens, lazy_bodies ? PF_LazyBodies : 0};
+    chunks[i].ok = parser.parse_items(ends[bounds[i]], ends[bounds[i + 1]],
+                                      chunks[i].items);
+  });
+
+  std::vector<std::unique_ptr<Item>> items;
+  items.reserve(ends.size() - 1);
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (!chunks[i].ok) {
+      // The input is invalid or the scan was wrong; either way, parsing on
+      // from the last good boundary gives the right result and errors.
+      span_end = ends[bounds[i]];
+      index = tokens->skip_trivia(span_end);
+      token = tokens->token(index);
+      auto rest = parse_document();
+      if (!rest) {
+        return nullptr;
+      }
+      for (auto &item : rest->take_items()) {
+        items.emplace_back(std::move(item));
+      }
+      return std::make_unique<Document>(std::move(items));
+    }
+    for (auto &item : chunks[i].items) {
+      items.emplace_back(std::move(item));
+    }
+  }
+
+  // Leave the parser at the end, as the sequential parse does.
+  span_end = ends.back();
+  index = tokens->skip_trivia(span_end);
+  token = tokens->token(index);
+  return std::make_unique<Document>(std::move(items));
+}
+
+// Parses the items between two item boundaries. Returns false on an error
+// or if the last item does not end at `last`.
+bool Parser::parse_items(size_t first, size_t last,
+                         std::vector<std::unique_ptr<Item>> &items) {
+  span_end = first;
+  index = tokens->skip_trivia(first);
+  token = tokens->token(index);
+  while (span_end < last && token.what != TkEof) {
+    auto item = parse_item();
+    if (!item) {
+      return false;
+    }
+    items.emplace_back(std::move(item));
+  }
+  return span_end == last;
+}
+
+// Old nodes that can be moved into the new tree during a reparse.
+struct Parser::Reuse {
+  struct Scope {
+    ScopeExpr *scope;
+    ptrdiff_t delta;
+  };
+
+  std::vector<std::unique_ptr<Item>> &items;
+  // The replaced tokens, in old indices.
+  size_t damage_begin;
+  size_t damage_end;
+  ptrdiff_t token_delta;
+  ptrdiff_t byte_delta;
+
+  // Scopes of the old items before `collected` are in `scopes`, keyed by
+  // their first token in the new buffer. `collected_end` is where the last
+  // of those items ended, in old indices.
+  size_t collected;
+  size_t collected_end;
+  std::unordered_map<size_t, Scope> scopes;
+
+  // Where an old token is now. Tokens inside the damage map to its start.
+  size_t map(size_t old) const {
+    if (old < damage_begin) {
+      return old;
+    } else if (old < damage_end) {
+      return damage_begin;
+    }
+    return (size_t)((ptrdiff_t)old + token_delta);
+  }
+
+  // Adds the scopes of every old item that starts at or before `index`. A
+  // scope at `index` can only come from one of those.
+  void collect(size_t index);
+
+  struct Collector;
+};
+
+// Finds the outermost scopes that do not touch the damage.
+struct Parser::Reuse::Collector : NodeVisitor {
+  using NodeVisitor::visit;
+
+  Reuse *reuse;
+  // The first token of each enclosing item or scope.
+  std::vector<size_t> parents;
+
+  void visit(const ScopeExpr &scope) override;
+
+  // Skipped bodies are left alone; they are shifted with their item.
+  void visit(const FunDefItem &item) override {
+    if (item.is_body_parsed()) {
+      visit(item.body());
+    }
+  }
+};
+
+void Parser::Reuse::collect(size_t index) {
+  while (collected < items.size()) {
+    const Item &item = *items[collected];
+    size_t start = collected_end + item.span().offset;
+    if (map(start) > index) {
+      break;
+    }
+    Collector collector;
+    collector.reuse = this;
+    collector.parents.push_back(start);
+    collector.visit(item);
+    collected_end = start + item.span().width;
+    ++collected;
+  }
+}
+
+void Parser::Reuse::Collector::visit(const ScopeExpr &scope) {
+  const SyntaxSpan &span = scope.span();
+  size_t start = parents.back() + span.offset;
+  size_t end = start + span.width;
+  // The old document is consumed by the reparse, so its scopes can be moved
+  // out when the parser reaches them.
+  auto *old = const_cast<ScopeExpr*>(&scope);
+  if (end < reuse->damage_begin) {
+    reuse->scopes.emplace(start, Scope{old, 0});
+  } else if (start > reuse->damage_end) {
+    reuse->scopes.emplace(reuse->map(start),
+                          Scope{old, reuse->byte_delta});
+  } else {
+    parents.push_back(start);
+    NodeVisitor::visit(scope);
+    parents.pop_back();
+  }
+}
+
+std::unique_ptr<Document>
+Parser::reparse_document(Document &old, const TokenBuffer::Splice &splice,
+                         const TextEdit &edit) {
+  assert(tokens && "reparsing requires a token buffer");
+  auto old_items = old.take_items();
+
+  Reuse state{
+    old_items,
+    splice.first,
+    splice.first + splice.removed,
+    (ptrdiff_t)splice.inserted - (ptrdiff_t)splice.removed,
+    (ptrdiff_t)edit.inserted.size() - (ptrdiff_t)edit.removed,
+    0,
+    0,
+    {},
+  };
+
+  std::vector<std::unique_ptr<Item>> items;
+  items.reserve(old_items.size());
+
+  // Items that end before the damage with a token to spare saw exactly the
+  // same tokens, and nothing before them moved.
+  size_t old_end = 0;
+  size_t i = 0;
+  for (; i < old_items.size(); ++i) {
+    const SyntaxSpan &span = old_items[i]->span();
+    size_t end = old_end + span.offset + span.width;
+    if (end >= state.damage_begin) {
+      break;
+    }
+    items.emplace_back(std::move(old_items[i]));
+    old_end = end;
+  }
+  state.collected = i;
+  state.collected_end = old_end;
+
+  span_end = old_end;
+  index = tokens->skip_trivia(old_end);
+  token = tokens->token(index);
+  reuse = &state;
+  LAVA_SCOPE_EXIT { reuse = nullptr; };
+
+  while (token.what != TkEof) {
+    // Skip old items the parser has passed or that overlap the damage.
+    while (i < old_items.size()) {
+      const SyntaxSpan &span = old_items[i]->span();
+      size_t start = old_end + span.offset;
+      if (start > state.damage_end && state.map(start) >= index) {
+        break;
+      }
+      old_end = start + span.width;
+      ++i;
+    }
+
+    // Once an old item after the damage starts where the parser is, it and
+    // everything after it parse the same as before, only moved.
+    if (i < old_items.size()
+        && state.map(old_end + old_items[i]->span().offset) == index) {
+      SyntaxSpan span = old_items[i]->span();
+      SyntaxSpan new_span = make_span(span_end, index, index + span.width);
+      if (new_span.fingerprint == span.fingerprint) {
+        old_items[i]->set_span(new_span);
+        for (; i < old_items.size(); ++i) {
+          if (state.byte_delta) {
+            old_items[i]->shift(state.byte_delta);
+          }
+          items.emplace_back(std::move(old_items[i]));
+        }
+        break;
+      }
+    }
+
+    auto item = parse_item();
+    if (!item) {
+      return nullptr;
+    }
+    items.emplace_back(std::move(item));
+  }
+
+  return std::make_unique<Document>(std::move(items));
+}
+
 std::unique_ptr<Item> Parser::parse_item() {
+  if (!tokens) {
+    return parse_item_contents();
+  }
+  size_t prev_end = span_end;
+  size_t start = index;
+  span_parent = start;
+  auto item = parse_item_contents();
+  if (item) {
+    item->set_span(make_span(prev_end, start, span_end));
+  }
+  return item;
+}
+
+SyntaxSpan Parser::make_span(size_t parent, size_t first, size_t last) const {
+  SyntaxSpan span;
+  span.offset = (uint32_t)(first - parent);
+  span.width = (uint32_t)(last - first);
+  if (last > first) {
+    size_t begin = tokens->start(first);
+    std::string_view text = tokens->doc().content;
+    span.fingerprint = hash_bytes(
+      text.substr(begin, tokens->end(last - 1) - begin));
+  }
+  return span;
+}
+
+std::unique_ptr<Item> Parser::parse_item_contents() {
   switch (token.what) {
   case TkFun:
     return parse_fun_item();
@@ -168,6 +527,28 @@ std::unique_ptr<FunItemBase> Parser::parse_fun_item() {
   if (token.what == TkSemi) {
     return std::make_unique<FunDeclItem>(
       fun, name, *std::move(args), std::move(ret), take());
+  } else if (token.what == TkLeftBrace && lazy_bodies) {
+    // Only braces change the nesting depth; the rest of the body is checked
+    // when it is parsed.
+    Token lbrace = token;
+    size_t i = index;
+    size_t depth = 1;
+    while (depth) {
+      int kind = tokens->kind(++i);
+      if (kind == TkLeftBrace) {
+        ++depth;
+      } else if (kind == TkRightBrace) {
+        --depth;
+      } else if (kind == TkEof) {
+        reset(i);
+        ERROR("missing '}'");
+        return nullptr;
+      }
+    }
+    reset(i);
+    Token rbrace = take();
+    return std::make_unique<FunDefItem>(
+      fun, name, *std::move(args), std::move(ret), lbrace, rbrace);
   } else if (token.what == TkLeftBrace) {
     auto body = parse_scope_expr();
     if (!body) {
@@ -182,6 +563,40 @@ std::unique_ptr<FunItemBase> Parser::parse_fun_item() {
   }
 }
 
+bool Parser::expand_body(FunDefItem &item) {
+  if (item.is_body_parsed()) {
+    return true;
+  }
+  auto body = parse_body(item);
+  if (!body) {
+    return false;
+  }
+  item.set_body(*std::move(body));
+  return true;
+}
+
+std::optional<ScopeExpr> Parser::parse_body(const FunDefItem &item) {
+  assert(tokens && "lazy bodies require a token buffer");
+  span_parent = tokens->find(item.start().offset);
+  index = tokens->find(item.body_start().offset);
+  token = tokens->token(index);
+  auto body = parse_scope_expr();
+  if (!body) {
+    ERROR("invalid fun body");
+  }
+  return body;
+}
+
+bool Parser::expand_bodies(Document &doc) {
+  bool ok = true;
+  for (auto const &item : doc.items()) {
+    if (item->item_kind() == ItemKind::FunDef) {
+      ok &= expand_body(static_cast<FunDefItem&>(*item));
+    }
+  }
+  return ok;
+}
+
 std::optional<ArgList> Parser::parse_arg_list() {
   if (token.what != TkLeftParen) {
     return std::nullopt;
@@ -347,6 +762,17 @@ std::unique_ptr<Expr> Parser::parse_expr(int flags, unsigned prec) {
 
 std::optional<ScopeExpr> Parser::parse_scope_expr() {
   assert(token.what == TkLeftBrace);
+  if (reuse) {
+    if (auto scope = reuse_scope_expr()) {
+      return scope;
+    }
+  }
+
+  size_t parent = span_parent;
+  size_t start = index;
+  span_parent = start;
+  LAVA_SCOPE_EXIT { span_parent = parent; };
+
   Token lbrace = take();
 
   ExprsWithDelimiter exprs;
@@ -366,7 +792,40 @@ std::optional<ScopeExpr> Parser::parse_scope_expr() {
     ERROR("missing '}'");
     return std::nullopt;
   }
-  return ScopeExpr{lbrace, take(), std::move(exprs)};
+  ScopeExpr scope{lbrace, take(), std::move(exprs)};
+  if (tokens) {
+    scope.set_span(make_span(parent, start, span_end));
+  }
+  return scope;
+}
+
+std::optional<ScopeExpr> Parser::reuse_scope_expr() {
+  reuse->collect(index);
+  auto it = reuse->scopes.find(index);
+  if (it == reuse->scopes.end()) {
+    return std::nullopt;
+  }
+  ScopeExpr &old = *it->second.scope;
+  ptrdiff_t delta = it->second.delta;
+  reuse->scopes.erase(it);
+
+  SyntaxSpan span = old.span();
+  SyntaxSpan new_span = make_span(span_parent, index, index + span.width);
+  if (new_span.fingerprint != span.fingerprint) {
+    return std::nullopt;
+  }
+
+  ScopeExpr scope{std::move(old)};
+  if (delta) {
+    scope.shift(delta);
+  }
+  scope.set_span(new_span);
+
+  // Continue after the closing brace.
+  index += span.width - 1;
+  token = tokens->token(index);
+  next();
+  return scope;
 }
 
 std::unique_ptr<InvokeExpr>
@@ -480,10 +939,7 @@ std::unique_ptr<Expr> Parser::parse_primary() {
     break;
 
   case TkStringLiteral:
-    {
-      auto text = token.text();
-      expr = std::make_unique<LiteralExpr>(take(), text);
-    }
+    expr = std::make_unique<LiteralExpr>(take());
     break;
 
   case TkIdent:
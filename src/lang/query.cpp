@@ -0,0 +1,288 @@
+#include "lava/lang/query.h"
+#include "lava/lang/firstpass.h"
+#include "lava/lang/iremit.h"
+#include "lava/lang/parser.h"
+#include "lava/util/hash.h"
+#include "lava/util/scope_exit.h"
+#include <stdexcept>
+
+using namespace lava::lang;
+
+namespace {
+
+// The first name in a type such as `a` or `a.b.c`, which is the part
+// looked up through the scope chain, or empty.
+std::string_view leading_name(const Expr *expr) {
+  while (expr && expr->expr_kind() == ExprKind::Binary) {
+    auto binary = static_cast<const BinaryExpr*>(expr);
+    if (binary->op() != TkDot) {
+      return {};
+    }
+    expr = binary->left();
+  }
+  if (expr && expr->expr_kind() == ExprKind::Ident) {
+    return static_cast<const IdentExpr*>(expr)->value();
+  }
+  return {};
+}
+
+bool same_ir(const std::unique_ptr<Function> &a,
+             const std::unique_ptr<Function> &b) {
+  if (!a || !b) {
+    return a == b;
+  }
+  if (a->type() != b->type() || a->register_count() != b->register_count()) {
+    return false;
+  }
+  auto const &a_bbs = a->basicblocks();
+  auto const &b_bbs = b->basicblocks();
+  if (a_bbs.size() != b_bbs.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a_bbs.size(); ++i) {
+    if (a_bbs[i].instrs != b_bbs[i].instrs) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+QueryEngine::QueryEngine(SymbolTable &symtab, std::string name,
+                         std::string content, Diagnostics *diagnostics)
+  : _symtab{&symtab}
+  , _diagnostics{diagnostics}
+  , _doc{.name = std::move(name), .content = std::move(content)}
+  , _tokens{_doc}
+  , _document{Parser{_tokens, 0, diagnostics}.parse_document()}
+{}
+
+QueryEngine::~QueryEngine() {}
+
+void QueryEngine::edit(const TextEdit &edit) {
+  _doc.apply(edit);
+  auto splice = _tokens.relex(edit);
+  Parser parser{_tokens, 0, _diagnostics};
+  if (_document) {
+    _document = parser.reparse_document(*_document, splice, edit);
+  } else {
+    _document = parser.parse_document();
+  }
+  _document_changed = ++_revision;
+}
+
+void QueryEngine::scope_changed() {
+  _scope_changed = ++_revision;
+}
+
+template<class T, class Compute, class Equal>
+const T &QueryEngine::fetch(QueryKey key, Memo<T> &memo, Compute compute,
+                            Equal equal) {
+  if (!_frames.empty() && _frames.back().tracked) {
+    _frames.back().deps.push_back(key);
+  }
+  if (memo.valid && memo.verified_at == _revision) {
+    return memo.value;
+  }
+  if (memo.running) {
+    throw std::runtime_error{"Query depends on itself"};
+  }
+  if (memo.valid && !deps_changed_since(memo.deps, memo.verified_at)) {
+    memo.verified_at = _revision;
+    return memo.value;
+  }
+
+  memo.running = true;
+  _frames.push_back(Frame{{}, true});
+  LAVA_SCOPE_EXIT {
+    _frames.pop_back();
+    memo.running = false;
+  };
+  ++_executions[(size_t)key.kind];
+  T value = compute();
+  // Early cutoff: an equal result keeps its old change revision.
+  if (!memo.valid || !equal(memo.value, value)) {
+    memo.value = std::move(value);
+    memo.changed_at = _revision;
+  }
+  memo.deps = std::move(_frames.back().deps);
+  memo.verified_at = _revision;
+  memo.valid = true;
+  return memo.value;
+}
+
+uint64_t QueryEngine::refresh(QueryKey key) {
+  _frames.push_back(Frame{{}, false});
+  LAVA_SCOPE_EXIT { _frames.pop_back(); };
+
+  switch (key.kind) {
+  case QueryKind::Document:
+    return _document_changed;
+  case QueryKind::Scope:
+    return _scope_changed;
+  case QueryKind::Items:
+    items();
+    return _items.changed_at;
+  case QueryKind::Item:
+    item(key.name);
+    return _item[key.name].changed_at;
+  case QueryKind::ItemTokens:
+    item_tokens(key.name);
+    return _item_tokens[key.name].changed_at;
+  case QueryKind::ItemHeader:
+    item_header(key.name);
+    return _item_header[key.name].changed_at;
+  case QueryKind::Resolve:
+    resolve(key.name);
+    return _resolve[key.name].changed_at;
+  case QueryKind::Signature:
+    signature(key.name);
+    return _signature[key.name].changed_at;
+  case QueryKind::FunctionIr:
+    function_ir(key.name);
+    return _function_ir[key.name].changed_at;
+  }
+  return _revision;
+}
+
+bool QueryEngine::deps_changed_since(const std::vector<QueryKey> &deps,
+                                     uint64_t revision) {
+  for (auto const &dep : deps) {
+    if (refresh(dep) > revision) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void QueryEngine::read_input(QueryKind kind) {
+  if (!_frames.empty() && _frames.back().tracked) {
+    _frames.back().deps.push_back(QueryKey{kind, InternString{}});
+  }
+}
+
+const FunItemBase *QueryEngine::item_untracked(InternString name) {
+  _frames.push_back(Frame{{}, false});
+  LAVA_SCOPE_EXIT { _frames.pop_back(); };
+  return item(name);
+}
+
+uint64_t QueryEngine::fingerprint(size_t begin, size_t end) const {
+  uint64_t hash = 0;
+  for (size_t i = _tokens.skip_trivia(_tokens.find(begin));
+       _tokens.start(i) < end && _tokens.kind(i) != TkEof;
+       i = _tokens.skip_trivia(i + 1)) {
+    hash = hash_bytes(_tokens.text(i), hash ^ (uint64_t)_tokens.kind(i));
+  }
+  return hash;
+}
+
+auto QueryEngine::items() -> const ItemMap & {
+  return fetch(QueryKey{QueryKind::Items, {}}, _items, [&] {
+    read_input(QueryKind::Document);
+    ItemMap map;
+    if (!_document) {
+      return map;
+    }
+    for (auto const &item : _document->items()) {
+      auto kind = item->item_kind();
+      if (kind != ItemKind::FunDecl && kind != ItemKind::FunDef) {
+        continue;
+      }
+      auto fun = static_cast<const FunItemBase*>(item.get());
+      auto name = _symtab->intern(fun->name());
+      ItemRef ref{fun, fun->span().fingerprint};
+      auto [it, inserted] = map.items.emplace(name, ref);
+      if (inserted) {
+        map.names.push_back(name);
+      } else if (kind == ItemKind::FunDef) {
+        if (it->second.item->item_kind() == ItemKind::FunDef) {
+          throw std::runtime_error{"Duplicate function definition"};
+        }
+        it->second = ref;
+      }
+    }
+    return map;
+  });
+}
+
+const FunItemBase *QueryEngine::item(InternString name) {
+  return fetch(QueryKey{QueryKind::Item, name}, _item[name], [&] {
+    auto const &items = this->items().items;
+    auto it = items.find(name);
+    return it == items.end() ? ItemRef{} : it->second;
+  }).item;
+}
+
+uint64_t QueryEngine::item_tokens(InternString name) {
+  return fetch(QueryKey{QueryKind::ItemTokens, name}, _item_tokens[name],
+               [&]() -> uint64_t {
+    auto *item = this->item(name);
+    if (!item) {
+      return 0;
+    }
+    return fingerprint(item->start().offset, item->end().offset);
+  });
+}
+
+uint64_t QueryEngine::item_header(InternString name) {
+  return fetch(QueryKey{QueryKind::ItemHeader, name}, _item_header[name],
+               [&]() -> uint64_t {
+    auto *item = this->item(name);
+    if (!item) {
+      return 0;
+    }
+    size_t end = item->end().offset;
+    if (item->item_kind() == ItemKind::FunDef) {
+      end = static_cast<const FunDefItem*>(item)->body_start().offset;
+    }
+    return fingerprint(item->start().offset, end);
+  });
+}
+
+Symbol *QueryEngine::resolve(InternString name) {
+  return fetch(QueryKey{QueryKind::Resolve, name}, _resolve[name], [&] {
+    read_input(QueryKind::Scope);
+    return _symtab->global_namespace().getrec(name);
+  });
+}
+
+const FunctionType *QueryEngine::signature(InternString name) {
+  return fetch(QueryKey{QueryKind::Signature, name}, _signature[name],
+               [&]() -> const FunctionType* {
+    item_header(name);
+    auto *item = item_untracked(name);
+    if (!item) {
+      return nullptr;
+    }
+    auto depend = [&](const Expr *type) {
+      auto first = leading_name(type);
+      if (!first.empty()) {
+        resolve(_symtab->intern(first));
+      }
+    };
+    depend(item->return_type());
+    for (auto const &arg : item->args()) {
+      depend(arg.value.type());
+    }
+    FirstPass fp{*_symtab};
+    return &fp.get_function_type(*item);
+  });
+}
+
+const Function *QueryEngine::function_ir(InternString name) {
+  return fetch(QueryKey{QueryKind::FunctionIr, name}, _function_ir[name],
+               [&]() -> std::unique_ptr<Function> {
+    auto *type = signature(name);
+    item_tokens(name);
+    auto *item = item_untracked(name);
+    if (!type || item->item_kind() != ItemKind::FunDef) {
+      return nullptr;
+    }
+    auto fn = std::make_unique<Function>(name, type,
+                                         _symtab->global_namespace());
+    IREmitter{*_symtab}.emit(static_cast<const FunDefItem&>(*item), *fn);
+    return fn;
+  }, same_ir).get();
+}
@@ -0,0 +1,298 @@
+#include "lava/lava.h"
+#include "lava/lang/scan.h"
+#include <bit>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) \
+  || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define LAVA_SCAN_SSE2 1
+# include <emmintrin.h>
+#endif
+
+#if defined(LAVA_SCAN_SSE2) && (defined(__GNUC__) || defined(__clang__))
+# define LAVA_SCAN_AVX2 1
+# define LAVA_TARGET_AVX2 __attribute__((target("avx2")))
+# include <immintrin.h>
+#endif
+
+using namespace lava::lang;
+
+namespace {
+
+inline bool is_space(unsigned char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline bool is_ident(unsigned char c) {
+  unsigned char lower = c | 0x20;
+  return (unsigned char)(lower - 'a') < 26
+      || (unsigned char)(c - '0') < 10
+      || c == '_';
+}
+
+// Each character class provides a scalar test and a vector test that returns
+// 0xFF in each byte lane that belongs to the class.
+
+struct SpaceClass {
+  static bool scalar(unsigned char c) { return is_space(c); }
+
+#ifdef LAVA_SCAN_SSE2
+  static __m128i sse2(__m128i v) {
+    __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i tab   = _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'));
+    __m128i cr    = _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'));
+    __m128i lf    = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    return _mm_or_si128(_mm_or_si128(space, tab), _mm_or_si128(cr, lf));
+  }
+#endif
+
+#ifdef LAVA_SCAN_AVX2
+  LAVA_TARGET_AVX2 static __m256i avx2(__m256i v) {
+    __m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i tab   = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'));
+    __m256i cr    = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'));
+    __m256i lf    = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    return _mm256_or_si256(_mm256_or_si256(space, tab),
+                           _mm256_or_si256(cr, lf));
+  }
+#endif
+};
+
+struct IdentClass {
+  static bool scalar(unsigned char c) { return is_ident(c); }
+
+#ifdef LAVA_SCAN_SSE2
+  // Unsigned range checks via `min(x - lo, hi - lo) == x - lo`.
+  static __m128i sse2(__m128i v) {
+    __m128i alpha = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)),
+                                 _mm_set1_epi8('a'));
+    alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(25)), alpha);
+    __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+  }
+#endif
+
+#ifdef LAVA_SCAN_AVX2
+  LAVA_TARGET_AVX2 static __m256i avx2(__m256i v) {
+    __m256i alpha = _mm256_sub_epi8(
+      _mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(25)),
+                              alpha);
+    __m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)),
+                              digit);
+    __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+  }
+#endif
+};
+
+#ifdef LAVA_SCAN_AVX2
+const bool has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+template<class Class>
+const char *skip_scalar(const char *first, const char *last) {
+  while (first != last && Class::scalar((unsigned char)*first)) {
+    ++first;
+  }
+  return first;
+}
+
+#ifdef LAVA_SCAN_SSE2
+template<class Class>
+const char *skip_sse2(const char *first, const char *last) {
+  while (last - first >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    unsigned mask = ~(unsigned)_mm_movemask_epi8(Class::sse2(v)) & 0xFFFF;
+    if (mask) {
+      return first + std::countr_zero(mask);
+    }
+    first += 16;
+  }
+  return skip_scalar<Class>(first, last);
+}
+#endif
+
+#ifdef LAVA_SCAN_AVX2
+template<class Class>
+LAVA_TARGET_AVX2 const char *skip_avx2(const char *first, const char *last) {
+  while (last - first >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+    uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(Class::avx2(v));
+    if (mask) {
+      return first + std::countr_zero(mask);
+    }
+    first += 32;
+  }
+  return skip_sse2<Class>(first, last);
+}
+#endif
+
+template<class Class>
+const char *skip(const char *first, const char *last) {
+#if defined(LAVA_SCAN_AVX2)
+  // Most runs are short; only pay for the wider loads on long ones.
+  if (has_avx2 && last - first >= 64) {
+    const char *p = skip_sse2<Class>(first, first + 16);
+    if (p != first + 16) {
+      return p;
+    }
+    return skip_avx2<Class>(p, last);
+  }
+#endif
+#if defined(LAVA_SCAN_SSE2)
+  return skip_sse2<Class>(first, last);
+#else
+  return skip_scalar<Class>(first, last);
+#endif
+}
+
+#ifdef LAVA_SCAN_AVX2
+LAVA_TARGET_AVX2
+const char *find_byte_avx2(const char *first, const char *last, char c) {
+  __m256i needle = _mm256_set1_epi8(c);
+  while (last - first >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(v, needle));
+    if (mask) {
+      return first + std::countr_zero(mask);
+    }
+    first += 32;
+  }
+  while (first != last && *first != c) {
+    ++first;
+  }
+  return first;
+}
+
+LAVA_TARGET_AVX2
+size_t count_newlines_avx2(const char *first, const char *last) {
+  __m256i lf = _mm256_set1_epi8('\n');
+  size_t count = 0;
+  while (last - first >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+    count += std::popcount(
+      (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, lf)));
+    first += 32;
+  }
+  while (first != last) {
+    count += *first++ == '\n';
+  }
+  return count;
+}
+#endif
+
+} // anonymous namespace
+
+const char *scan::skip_whitespace(const char *first, const char *last) {
+  return skip<SpaceClass>(first, last);
+}
+
+const char *scan::skip_ident(const char *first, const char *last) {
+  return skip<IdentClass>(first, last);
+}
+
+const char *scan::find_byte(const char *first, const char *last, char c) {
+#ifdef LAVA_SCAN_AVX2
+  if (has_avx2 && last - first >= 64) {
+    return find_byte_avx2(first, last, c);
+  }
+#endif
+#ifdef LAVA_SCAN_SSE2
+  __m128i needle = _mm_set1_epi8(c);
+  while (last - first >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+    if (mask) {
+      return first + std::countr_zero(mask);
+    }
+    first += 16;
+  }
+#endif
+  while (first != last && *first != c) {
+    ++first;
+  }
+  return first;
+}
+
+const char *scan::find_block_comment_end(const char *first,
+                                         const char *last) {
+  while (true) {
+    first = find_byte(first, last, '*');
+    if (last - first < 2) {
+      return last;
+    }
+    if (first[1] == '/') {
+      return first;
+    }
+    ++first;
+  }
+}
+
+size_t scan::count_newlines(const char *first, const char *last) {
+#ifdef LAVA_SCAN_AVX2
+  if (has_avx2 && last - first >= 64) {
+    return count_newlines_avx2(first, last);
+  }
+#endif
+  size_t count = 0;
+#ifdef LAVA_SCAN_SSE2
+  __m128i lf = _mm_set1_epi8('\n');
+  while (last - first >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    count += std::popcount(
+      (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf)));
+    first += 16;
+  }
+#endif
+  while (first != last) {
+    count += *first++ == '\n';
+  }
+  return count;
+}
+
+const char *scan::find_last_newline(const char *first, const char *last) {
+#ifdef LAVA_SCAN_SSE2
+  __m128i lf = _mm_set1_epi8('\n');
+  while (last - first >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(last - 16));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+    if (mask) {
+      return last - 16 + (31 - std::countl_zero(mask));
+    }
+    last -= 16;
+  }
+#endif
+  while (last != first) {
+    if (*--last == '\n') {
+      return last;
+    }
+  }
+  return nullptr;
+}
+
+void scan::append_line_starts(const char *first, const char *last,
+                              std::vector<size_t> &starts) {
+  const char *p = first;
+#ifdef LAVA_SCAN_SSE2
+  __m128i lf = _mm_set1_epi8('\n');
+  while (last - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+    while (mask) {
+      starts.push_back((size_t)(p - first) + std::countr_zero(mask) + 1);
+      mask &= mask - 1;
+    }
+    p += 16;
+  }
+#endif
+  for (; p != last; ++p) {
+    if (*p == '\n') {
+      starts.push_back((size_t)(p - first) + 1);
+    }
+  }
+}
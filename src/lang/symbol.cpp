@@ -1,20 +1,87 @@
 #include "lava/lava.h"
 #include "lava/lang/symbol.h"
+#include <algorithm>
+#include <numeric>
 #include <stdexcept>
 
 using namespace lava::lang;
 
 Symbol::~Symbol() {}
 
+void DependencyGraph::add(InternString user, InternString name) {
+  auto &uses = _uses[user];
+  if (std::find(uses.begin(), uses.end(), name) != uses.end()) {
+    return;
+  }
+  uses.push_back(name);
+  _users[name].push_back(user);
+}
+
+void DependencyGraph::remove_user(InternString user) {
+  auto it = _uses.find(user);
+  if (it == _uses.end()) {
+    return;
+  }
+  for (auto name : it->second) {
+    auto users = _users.find(name);
+    std::erase(users->second, user);
+    if (users->second.empty()) {
+      _users.erase(users);
+    }
+  }
+  _uses.erase(it);
+}
+
+const std::vector<InternString> *
+DependencyGraph::users(InternString name) const {
+  auto it = _users.find(name);
+  return it == _users.end() ? nullptr : &it->second;
+}
+
 Namespace::~Namespace() {}
 
+std::unique_ptr<Symbol> Namespace::replace(std::unique_ptr<Symbol> value) {
+  auto *old = _symbols.find(value->name());
+  if (!old) {
+    add(std::move(value));
+    return nullptr;
+  }
+  auto it = std::find_if(
+    _symbols_ordered.begin(), _symbols_ordered.end(),
+    [old](auto const &symbol) { return symbol.get() == old; }
+  );
+  _symbols.assign(value->name(), value.get());
+  it->swap(value);
+  changed();
+  return value;
+}
+
+std::unique_ptr<Symbol> Namespace::remove(InternString name) {
+  auto *old = _symbols.find(name);
+  if (!old) {
+    return nullptr;
+  }
+  auto it = std::find_if(
+    _symbols_ordered.begin(), _symbols_ordered.end(),
+    [old](auto const &symbol) { return symbol.get() == old; }
+  );
+  auto removed = std::move(*it);
+  _symbols_ordered.erase(it);
+  _symbols.clear();
+  for (auto const &symbol : _symbols_ordered) {
+    _symbols.insert(symbol->name(), symbol.get());
+  }
+  changed();
+  return removed;
+}
+
 Symbol *Namespace::get(const SymbolPath &path) {
   if (path.empty()) {
     return nullptr;
   }
   Symbol *symbol = get(path[0]);
   for (size_t i = 1; i < path.size(); ++i) {
-    auto *ns = dynamic_cast<Namespace*>(symbol);
+    auto *ns = dyn_cast<Namespace>(symbol);
     if (ns) {
       symbol = ns->get(path[i]);
       if (!symbol) {
@@ -27,42 +94,74 @@ Symbol *Namespace::get(const SymbolPath &path) {
   return symbol;
 }
 
+// Only the namespace the lookup started from gets a cache entry, so that
+// one deep lookup doesn't evict the results of others.
 Symbol *Namespace::getrec(InternString name) {
-  auto *symbol = get(name);
-  if (!symbol) {
-    if (!_using.empty()) {
-      for (auto *using_ns : _using) {
-        auto *symbol = using_ns->get(name);
-        if (symbol) {
-          return symbol;
-        }
-      }
-    }
-    if (_parent) {
-      return _parent->getrec(name);
-    }
+  Symbol *symbol;
+  if (!_cache) {
+    symbol = get_or_using(name);
+    return symbol || !_parent ? symbol : _parent->getrec(name);
+  }
+  if (!_cache->find(this, name, symbol)) {
+    symbol = getrec_uncached(name);
+    _cache->insert(this, name, symbol);
   }
   return symbol;
 }
 
-Symbol *Namespace::getrec(const SymbolPath &path) {
-  auto *symbol = get(path);
-  if (!symbol) {
-    if (!_using.empty()) {
-      for (auto *using_ns : _using) {
-        auto *symbol = using_ns->get(path);
-        if (symbol) {
-          return symbol;
-        }
-      }
-    }
-    if (_parent) {
-      return _parent->getrec(path);
+Symbol *Namespace::getrec_uncached(InternString name) {
+  auto *symbol = get_or_using(name);
+  if (!symbol && _parent) {
+    return _parent->getrec_uncached(name);
+  }
+  return symbol;
+}
+
+Symbol *Namespace::get_or_using(InternString name) {
+  if (auto *symbol = get(name)) {
+    return symbol;
+  }
+  for (auto *using_ns : _using) {
+    if (auto *symbol = using_ns->get(name)) {
+      return symbol;
     }
   }
+  return nullptr;
+}
+
+Symbol *Namespace::getrec(const SymbolPath &path) {
+  Symbol *symbol;
+  if (!_cache) {
+    symbol = get_or_using(path);
+    return symbol || !_parent ? symbol : _parent->getrec(path);
+  }
+  if (!_cache->find(this, path, symbol)) {
+    symbol = getrec_uncached(path);
+    _cache->insert(this, path, symbol);
+  }
   return symbol;
 }
 
+Symbol *Namespace::getrec_uncached(const SymbolPath &path) {
+  auto *symbol = get_or_using(path);
+  if (!symbol && _parent) {
+    return _parent->getrec_uncached(path);
+  }
+  return symbol;
+}
+
+Symbol *Namespace::get_or_using(const SymbolPath &path) {
+  if (auto *symbol = get(path)) {
+    return symbol;
+  }
+  for (auto *using_ns : _using) {
+    if (auto *symbol = using_ns->get(path)) {
+      return symbol;
+    }
+  }
+  return nullptr;
+}
+
 Type::~Type() {}
 
 bool Type::operator==(const Type &other) const {
@@ -99,7 +198,7 @@ TypeKind NeverType::kind() const {
   return TypeKind::Never;
 }
 
-size_t NeverType::hash() const {
+size_t NeverType::compute_hash() const {
   return 0x80000001;
 }
 
@@ -109,7 +208,7 @@ TypeKind AnyType::kind() const {
   return TypeKind::Any;
 }
 
-size_t AnyType::hash() const {
+size_t AnyType::compute_hash() const {
   return 0x80000002;
 }
 
@@ -119,7 +218,7 @@ TypeKind VoidType::kind() const {
   return TypeKind::Void;
 }
 
-size_t VoidType::hash() const {
+size_t VoidType::compute_hash() const {
   return 0x80000003;
 }
 
@@ -128,7 +227,7 @@ TypeKind BoolType::kind() const {
   return TypeKind::Bool;
 }
 
-size_t BoolType::hash() const {
+size_t BoolType::compute_hash() const {
   return 0x8000000B;
 }
 
@@ -138,7 +237,7 @@ TypeKind IntType::kind() const {
   return TypeKind::Int;
 }
 
-size_t IntType::hash() const {
+size_t IntType::compute_hash() const {
   size_t hash = 0x80000004;
   boost::hash_combine(hash, size);
   boost::hash_combine(hash, is_signed);
@@ -155,7 +254,7 @@ TypeKind FloatType::kind() const {
   return TypeKind::Float;
 }
 
-size_t FloatType::hash() const {
+size_t FloatType::compute_hash() const {
   size_t hash = 0x80000005;
   boost::hash_combine(hash, size);
   return hash;
@@ -173,7 +272,7 @@ TypeKind PointerType::kind() const {
   return TypeKind::Pointer;
 }
 
-size_t PointerType::hash() const {
+size_t PointerType::compute_hash() const {
   size_t hash = 0x80000006;
   if (pointed_at) {
     boost::hash_combine(hash, pointed_at->hash());
@@ -182,7 +281,7 @@ size_t PointerType::hash() const {
 }
 
 bool PointerType::operator==(const PointerType &other) const {
-  return *pointed_at == *other.pointed_at;
+  return pointed_at == other.pointed_at;
 }
 
 NullPointerType::~NullPointerType() {}
@@ -203,7 +302,9 @@ ArrayType::ArrayType(const DataType *element_type, unsigned array_length)
   }
   , element_type{element_type}
   , array_length{array_length}
-{}
+{
+  _hash = compute_hash();
+}
 
 ArrayType::~ArrayType() {}
 
@@ -211,7 +312,7 @@ TypeKind ArrayType::kind() const {
   return TypeKind::Array;
 }
 
-size_t ArrayType::hash() const {
+size_t ArrayType::compute_hash() const {
   size_t hash = 0x80000007;
   boost::hash_combine(hash, element_type->hash());
   boost::hash_combine(hash, array_length);
@@ -220,7 +321,7 @@ size_t ArrayType::hash() const {
 
 bool ArrayType::operator==(const ArrayType &other) const {
   return array_length == other.array_length &&
-    *element_type == *other.element_type;
+    element_type == other.element_type;
 }
 
 unsigned StructType::get_align(const FieldVector &fields) {
@@ -233,11 +334,94 @@ unsigned StructType::get_align(const FieldVector &fields) {
   return maxalign;
 }
 
-unsigned StructType::align_fields(FieldVector &fields) {
+namespace {
+
+// Free space between fields.
+struct Hole {
+  unsigned offset;
+  unsigned size;
+};
+
+// Returns the size.
+unsigned compact_fields(StructType::FieldVector &fields) {
+  StructType::OrderVector placement(fields.size());
+  std::iota(placement.begin(), placement.end(), 0u);
+  std::stable_sort(
+    placement.begin(), placement.end(),
+    [&](unsigned a, unsigned b) {
+      auto const &fa = fields[a];
+      auto const &fb = fields[b];
+      if (fa.cold != fb.cold) {
+        return fb.cold;
+      }
+      if (fa.type->align != fb.type->align) {
+        return fa.type->align > fb.type->align;
+      }
+      return fa.type->size > fb.type->size;
+    }
+  );
+
+  // By offset. Sorting by alignment first leaves few holes: only after a
+  // field whose size isn't a multiple of its alignment, or where the cold
+  // fields start.
+  boost::container::small_vector<Hole, 4> holes;
+  unsigned end = 0;
+  for (auto i : placement) {
+    unsigned size = fields[i].type->size;
+    unsigned align = std::max(fields[i].type->align, 1u);
+    auto hole = holes.begin();
+    for (; hole != holes.end(); ++hole) {
+      unsigned offset = LAVA_ALIGN_CEIL(hole->offset, align);
+      if (offset + size <= hole->offset + hole->size) {
+        break;
+      }
+    }
+    if (hole == holes.end()) {
+      unsigned offset = LAVA_ALIGN_CEIL(end, align);
+      if (offset > end) {
+        holes.push_back({end, offset - end});
+      }
+      fields[i].offset = offset;
+      end = offset + size;
+      continue;
+    }
+
+    // Split the hole around the field.
+    unsigned offset = LAVA_ALIGN_CEIL(hole->offset, align);
+    Hole after{offset + size, hole->offset + hole->size - (offset + size)};
+    fields[i].offset = offset;
+    hole->size = offset - hole->offset;
+    if (after.size) {
+      hole = holes.insert(hole + 1, after) - 1;
+    }
+    if (!hole->size) {
+      holes.erase(hole);
+    }
+  }
+  return end;
+}
+
+} // anonymous namespace
+
+unsigned StructType::align_fields(FieldVector &fields, StructLayout layout,
+                                  OrderVector &order) {
+  order.resize(fields.size());
+  std::iota(order.begin(), order.end(), 0u);
   if (fields.empty()) {
     return 0;
   }
 
+  if (layout == StructLayout::Compact) {
+    unsigned size = compact_fields(fields);
+    std::stable_sort(
+      order.begin(), order.end(),
+      [&](unsigned a, unsigned b) {
+        return fields[a].offset < fields[b].offset;
+      }
+    );
+    return size;
+  }
+
   unsigned offset = 0;
   for (size_t i = 0; i < fields.size(); ++i) {
     offset = LAVA_ALIGN_CEIL(offset, fields[i].type->align);
@@ -253,24 +437,29 @@ TypeKind StructType::kind() const {
   return TypeKind::Struct;
 }
 
-size_t StructType::hash() const {
+size_t StructType::compute_hash() const {
   size_t hash = 0x80000009;
+  boost::hash_combine(hash, (unsigned)layout);
   for (auto const &field : fields) {
     boost::hash_combine(hash, field.name);
     boost::hash_combine(hash, field.type->hash());
+    boost::hash_combine(hash, field.cold);
   }
   return hash;
 }
 
 bool StructType::operator==(const StructType &other) const {
-  if (fields.size() != other.fields.size()) {
+  if (fields.size() != other.fields.size() || layout != other.layout) {
     return false;
   }
   for (size_t i = 0; i < fields.size(); ++i) {
     if (fields[i].name != other.fields[i].name) {
       return false;
     }
-    if (*fields[i].type != *other.fields[i].type) {
+    if (fields[i].type != other.fields[i].type) {
+      return false;
+    }
+    if (fields[i].cold != other.fields[i].cold) {
       return false;
     }
   }
@@ -283,7 +472,7 @@ TypeKind FunctionType::kind() const {
   return TypeKind::Function;
 }
 
-size_t FunctionType::hash() const {
+size_t FunctionType::compute_hash() const {
   size_t hash = 0x8000000A;
   boost::hash_combine(hash, return_type->hash());
   for (auto const &arg : arg_types) {
@@ -297,7 +486,7 @@ bool FunctionType::operator==(const FunctionType &other) const {
   if (arg_types.size() != other.arg_types.size()) {
     return false;
   }
-  if (*return_type != *other.return_type) {
+  if (return_type != other.return_type) {
     return false;
   }
   for (size_t i = 0; i < arg_types.size(); ++i) {
@@ -313,7 +502,7 @@ bool FunctionType::are_types_same(const FunctionType &other) const {
   if (arg_types.size() != other.arg_types.size()) {
     return false;
   }
-  if (*return_type != *other.return_type) {
+  if (return_type != other.return_type) {
     return false;
   }
   for (size_t i = 0; i < arg_types.size(); ++i) {
@@ -324,6 +513,65 @@ bool FunctionType::are_types_same(const FunctionType &other) const {
   return true;
 }
 
+namespace {
+
+// Type hashes come from hash_combine over small integers, so their low
+// bits cluster; mix them before picking a slot.
+size_t slot_index(size_t hash, size_t mask) {
+  return lava::hash_mix(hash) & mask;
+}
+
+} // anonymous namespace
+
+TypeTable::TypeTable()
+  : _slots(64)
+{}
+
+TypeTable::~TypeTable() {
+  for (auto *type : _types) {
+    type->~Type();
+  }
+}
+
+const Type *TypeTable::find(const Type &type) const {
+  size_t mask = _slots.size() - 1;
+  for (size_t i = slot_index(type.hash(), mask);; i = (i + 1) & mask) {
+    auto const &slot = _slots[i];
+    if (!slot.type) {
+      return nullptr;
+    }
+    if (slot.hash == type.hash() && *slot.type == type) {
+      return slot.type;
+    }
+  }
+}
+
+void TypeTable::insert(Type *type) {
+  _types.push_back(type);
+  // Keep the load factor at or under 1/2.
+  if (_types.size() * 2 > _slots.size()) {
+    std::vector<Slot> slots(_slots.size() * 2);
+    size_t mask = slots.size() - 1;
+    for (auto const &slot : _slots) {
+      if (!slot.type) {
+        continue;
+      }
+      size_t i = slot_index(slot.hash, mask);
+      while (slots[i].type) {
+        i = (i + 1) & mask;
+      }
+      slots[i] = slot;
+    }
+    _slots = std::move(slots);
+  }
+  size_t mask = _slots.size() - 1;
+  size_t i = slot_index(type->hash(), mask);
+  while (_slots[i].type) {
+    i = (i + 1) & mask;
+  }
+  _slots[i] = {type->hash(), type};
+}
+
 void Function::add_args() {
   for (auto const &arg : _type->arg_types) {
     _args_ns.add(std::make_unique<Variable>(arg.name, arg.type));
@@ -332,10 +580,11 @@ void Function::add_args() {
 
 Function::Function(InternString name, const FunctionType *type,
                    Namespace &current_ns)
-  : Symbol{name}
+  : Symbol{SymbolKind::Function, name}
   , _type{type}
-  , _args_ns{current_ns}
+  , _args_ns{current_ns, Namespace::FunctionScope{}}
   , _locals_ns{_args_ns}
+  , _registers{0}
 {
   add_args();
 }
@@ -421,13 +670,15 @@ void SymbolTable::add_base_types() {
     intern("uint"),
     &int_type(PointerType::TargetPointerSize, false)
   ));
+  _builtin_symbols = _global_ns.size();
 }
 
-SymbolTable::SymbolTable()
-  : _the_string{}
-  , _string_map{}
+SymbolTable::SymbolTable(ConcurrentStringInterner *shared_strings)
+  : _strings{}
+  , _shared_strings{shared_strings}
   , _anon_index{0}
   , _global_ns{}
+  , _builtin_symbols{0}
   , _never_type{}
   , _any_type{}
   , _void_type{}
@@ -451,22 +702,6 @@ SymbolTable::SymbolTable()
   add_base_types();
 }
 
-InternString SymbolTable::intern(std::string_view str) {
-  auto it = _string_map.find(str);
-  if (it == _string_map.end()) {
-    InternString istr{ _the_string.size(), str.size() };
-    _the_string.append(str);
-    _string_map.emplace(str, istr);
-    return istr;
-  } else {
-    return it->second;
-  }
-}
-
-std::string_view SymbolTable::get_string(InternString str) {
-  return std::string_view(_the_string).substr(str.offset, str.size);
-}
-
 InternString SymbolTable::get_anon_name() {
   std::string name{"_$_"};
   size_t index = _anon_index;
@@ -503,18 +738,18 @@ SymbolTable::float_type(unsigned size) const {
 
 const PointerType &
 SymbolTable::pointer_type(PointerType &&pointer_type) const {
-  return *_pointer_types.emplace(std::move(pointer_type)).first;
+  return _types.intern(std::move(pointer_type));
 }
 
 const ArrayType &SymbolTable::array_type(ArrayType &&array_type) const {
-  return *_array_types.emplace(std::move(array_type)).first;
+  return _types.intern(std::move(array_type));
 }
 
 const StructType &SymbolTable::struct_type(StructType &&struct_type) const {
-  return *_struct_types.emplace(std::move(struct_type)).first;
+  return _types.intern(std::move(struct_type));
 }
 
 const FunctionType &
 SymbolTable::function_type(FunctionType &&function_type) const {
-  return *_function_types.emplace(std::move(function_type)).first;
+  return _types.intern(std::move(function_type));
 }
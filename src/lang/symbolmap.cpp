@@ -0,0 +1,48 @@
+#include "lava/lang/symbolmap.h"
+
+using namespace lava::lang;
+
+namespace {
+
+constexpr size_t InitialGroups = 2;
+
+} // anonymous namespace
+
+bool SymbolMap::insert(InternString key, Symbol *value) {
+  if (find(key)) {
+    return false;
+  }
+  // Keep the load factor at or under 7/8.
+  if ((_size + 1) * 8 > _ctrl.size() * 7) {
+    grow();
+  }
+
+  uint64_t h = hash(key);
+  size_t mask = group_mask();
+  size_t group = (h >> 7) & mask;
+  for (size_t step = 1;; group = (group + step++) & mask) {
+    if (uint64_t empty = load_group(group) & HighBits) {
+      size_t i = group * GroupSize + std::countr_zero(empty) / 8;
+      _ctrl[i] = h & 0x7F;
+      _slots[i] = {key, value};
+      ++_size;
+      return true;
+    }
+  }
+}
+
+void SymbolMap::grow() {
+  size_t groups = _ctrl.empty() ? InitialGroups
+                                : 2 * _ctrl.size() / GroupSize;
+  auto ctrl = std::move(_ctrl);
+  auto slots = std::move(_slots);
+  _ctrl.assign(groups * GroupSize, Empty);
+  _slots.resize(groups * GroupSize);
+  _size = 0;
+
+  for (size_t i = 0; i < ctrl.size(); ++i) {
+    if (ctrl[i] != Empty) {
+      insert(slots[i].key, slots[i].value);
+    }
+  }
+}
@@ -1,5 +1,9 @@
 #include <string_view>
+#include <algorithm>
 #include "lava/lang/token.h"
+#include "lava/lang/scan.h"
+
+using namespace lava::lang;
 
 std::string_view lava::lang::get_token_name(int what) {
   switch (what) {
@@ -9,3 +13,46 @@ std::string_view lava::lang::get_token_name(int what) {
 #undef X
   }
 }
+
+SourceLoc SourceDoc::resolve(SourceLoc loc) const {
+  if (line_starts.empty()) {
+    line_starts.push_back(0);
+    scan::append_line_starts(content.data(),
+                             content.data() + content.size(),
+                             line_starts);
+  }
+  auto it = std::upper_bound(line_starts.begin(), line_starts.end(),
+                             loc.offset);
+  loc.line = (uint32_t)(it - line_starts.begin());
+  loc.column = (uint32_t)(loc.offset - *(it - 1) + 1);
+  return loc;
+}
+
+void SourceDoc::apply(const TextEdit &edit) {
+  content.replace(edit.offset, edit.removed, edit.inserted);
+  if (line_starts.empty()) {
+    return;
+  }
+
+  // A line starts after each newline, so the starts owned by the removed
+  // text are those in (offset, offset + removed].
+  auto first = std::upper_bound(line_starts.begin(), line_starts.end(),
+                                edit.offset);
+  auto last = std::upper_bound(first, line_starts.end(),
+                               edit.offset + edit.removed);
+  size_t index = first - line_starts.begin();
+  line_starts.erase(first, last);
+  for (auto it = line_starts.begin() + index; it != line_starts.end(); ++it) {
+    *it = *it - edit.removed + edit.inserted.size();
+  }
+
+  std::vector<size_t> inserted;
+  scan::append_line_starts(edit.inserted.data(),
+                           edit.inserted.data() + edit.inserted.size(),
+                           inserted);
+  for (auto &start : inserted) {
+    start += edit.offset;
+  }
+  line_starts.insert(line_starts.begin() + index,
+                     inserted.begin(), inserted.end());
+}
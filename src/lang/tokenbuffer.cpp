@@ -0,0 +1,274 @@
+#include "lava/lang/tokenbuffer.h"
+#include "lava/lang/lexer.h"
+#include "lava/lang/scan.h"
+#include "lava/util/thread_pool.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+using namespace lava::lang;
+
+namespace {
+  enum {
+#define X(Name) TokenCount##Name,
+    LAVA_TOKENS
+#undef X
+    TokenCount
+  };
+}
+static_assert(TokenCount < 0x7F, "token kinds must fit in 7 bits");
+
+TokenBuffer::TokenBuffer(const SourceDoc &doc)
+  : _doc{&doc}
+{
+  lex(0, doc.content.size());
+}
+
+TokenBuffer::TokenBuffer(const SourceDoc &doc, size_t begin, size_t end)
+  : _doc{&doc}
+{
+  lex(begin, end);
+}
+
+TokenBuffer::TokenBuffer(const SourceDoc &doc, ThreadPool &pool,
+                         size_t min_chunk_size)
+  : _doc{&doc}
+{
+  const size_t size = doc.content.size();
+  assert(size <= UINT32_MAX && "document too large for a token buffer");
+  size_t count = std::min<size_t>(size / std::max<size_t>(min_chunk_size, 1),
+                                  pool.concurrency() * 4);
+  if (count < 2) {
+    lex(0, size);
+    return;
+  }
+
+  // Chunks start after a newline that is followed by something other than
+  // whitespace, so that ordinary whitespace and line comments end exactly
+  // at the boundary.
+  const char *text = doc.content.data();
+  std::vector<size_t> bounds{0};
+  for (size_t i = 1; i < count; ++i) {
+    const char *p = text + std::max(size * i / count, bounds.back());
+    while (true) {
+      p = scan::find_byte(p, text + size, '\n');
+      if (p == text + size) {
+        break;
+      }
+      ++p;
+      if (p != text + size && *p != ' ' && *p != '\t' && *p != '\r'
+          && *p != '\n') {
+        break;
+      }
+    }
+    if ((size_t)(p - text) >= size) {
+      break;
+    }
+    bounds.push_back(p - text);
+  }
+  bounds.push_back(size);
+  count = bounds.size() - 1;
+
+  struct Chunk {
+    std::vector<uint8_t> kinds;
+    std::vector<uint32_t> starts;
+    std::vector<uint32_t> lengths;
+    // Where the token after the last one in this chunk starts.
+    size_t end;
+  };
+  std::vector<Chunk> chunks(count);
+
+  // Each chunk keeps going past its nominal end until a token starts at or
+  // after the next boundary.
+  pool.parallel_for(count, [&](size_t i) {
+    Chunk &chunk = chunks[i];
+    size_t estimate = (bounds[i + 1] - bounds[i]) / 4 + 1;
+    chunk.kinds.reserve(estimate);
+    chunk.starts.reserve(estimate);
+    chunk.lengths.reserve(estimate);
+    Lexer lexer{doc, bounds[i], size, Lexer::LF_OffsetsOnly};
+    while (true) {
+      Token token = lexer.lex();
+      if (token.what != TkEof && token.start.offset >= bounds[i + 1]) {
+        chunk.end = token.start.offset;
+        break;
+      }
+      chunk.kinds.push_back(pack_kind(token.what));
+      chunk.starts.push_back((uint32_t)token.start.offset);
+      chunk.lengths.push_back((uint32_t)(token.end.offset
+                                         - token.start.offset));
+      if (token.what == TkEof) {
+        chunk.end = size;
+        break;
+      }
+    }
+  });
+
+  size_t total = 0;
+  for (auto &chunk : chunks) {
+    total += chunk.kinds.size();
+  }
+  _kinds.reserve(total);
+  _starts.reserve(total);
+  _lengths.reserve(total);
+
+  // `pos` is where the next token really starts. The lexer keeps no state
+  // between tokens, so once `pos` is the start of a speculative token, the
+  // rest of that chunk is correct.
+  size_t pos = 0;
+  for (auto &chunk : chunks) {
+    if (pos >= chunk.end) {
+      // A previous token covered this whole chunk.
+      continue;
+    }
+    auto it = std::lower_bound(chunk.starts.begin(), chunk.starts.end(),
+                               (uint32_t)pos);
+    while (it == chunk.starts.end() || *it != pos) {
+      // `pos` is inside a speculative token; relex until we are back on a
+      // token boundary the chunk agrees with.
+      Lexer lexer{doc, pos, size, Lexer::LF_OffsetsOnly};
+      Token token = lexer.lex();
+      _kinds.push_back(pack_kind(token.what));
+      _starts.push_back((uint32_t)token.start.offset);
+      _lengths.push_back((uint32_t)(token.end.offset - token.start.offset));
+      pos = token.end.offset;
+      if (token.what == TkEof) {
+        return;
+      }
+      if (pos >= chunk.end) {
+        break;
+      }
+      it = std::lower_bound(it, chunk.starts.end(), (uint32_t)pos);
+    }
+    if (pos >= chunk.end) {
+      continue;
+    }
+
+    size_t first = it - chunk.starts.begin();
+    _kinds.insert(_kinds.end(), chunk.kinds.begin() + first,
+                  chunk.kinds.end());
+    _starts.insert(_starts.end(), chunk.starts.begin() + first,
+                   chunk.starts.end());
+    _lengths.insert(_lengths.end(), chunk.lengths.begin() + first,
+                    chunk.lengths.end());
+    pos = chunk.end;
+  }
+}
+
+uint8_t TokenBuffer::pack_kind(int what) {
+  uint8_t kind = what == TkInvalid ? InvalidKind : (uint8_t)what;
+  if (what == TkWhitespace || what == TkLineComment
+      || what == TkBlockComment) {
+    kind |= TriviaBit;
+  }
+  return kind;
+}
+
+size_t TokenBuffer::find(size_t offset) const {
+  return std::lower_bound(_starts.begin(), _starts.end(), offset)
+         - _starts.begin();
+}
+
+Token TokenBuffer::token(size_t i) const {
+  Token token;
+  token.doc = _doc;
+  token.start.offset = _starts[i];
+  token.start.line = 0;
+  token.start.column = 0;
+  token.end = token.start;
+  token.end.offset = end(i);
+  token.what = kind(i);
+  return token;
+}
+
+void TokenBuffer::lex(size_t begin, size_t end) {
+  assert(end <= UINT32_MAX && "document too large for a token buffer");
+
+  // Most tokens are a few bytes long; this avoids regrowing for typical
+  // input without overcommitting for comment-heavy files.
+  size_t estimate = (end - begin) / 4 + 1;
+  _kinds.reserve(estimate);
+  _starts.reserve(estimate);
+  _lengths.reserve(estimate);
+
+  Lexer lexer{*_doc, begin, end, Lexer::LF_OffsetsOnly};
+  while (true) {
+    Token token = lexer.lex();
+    _kinds.push_back(pack_kind(token.what));
+    _starts.push_back((uint32_t)token.start.offset);
+    _lengths.push_back((uint32_t)(token.end.offset - token.start.offset));
+    if (token.what == TkEof) {
+      break;
+    }
+  }
+}
+
+TokenBuffer::Splice TokenBuffer::relex(const TextEdit &edit) {
+  const size_t old_end = _starts.back();
+  const size_t new_end = old_end - edit.removed + edit.inserted.size();
+  const size_t edit_end = edit.offset + edit.removed;
+  assert(edit_end <= old_end && "edit is outside of the buffer");
+  assert(new_end <= UINT32_MAX && "document too large for a token buffer");
+
+  // The first token whose lexing may have read an edited byte, i.e. the
+  // first with end + MaxLookahead > offset. Token ends are the next token's
+  // start, so search the starts.
+  size_t first = 0;
+  if (edit.offset >= Lexer::MaxLookahead) {
+    auto it = std::upper_bound(_starts.begin(), _starts.end(),
+                               (uint32_t)(edit.offset - Lexer::MaxLookahead));
+    if (it != _starts.begin()) {
+      first = std::min((size_t)(it - _starts.begin()) - 1, size() - 1);
+    }
+  }
+
+  std::vector<uint8_t> kinds;
+  std::vector<uint32_t> starts;
+  std::vector<uint32_t> lengths;
+
+  // Old tokens at or after `old` are candidates for resynchronisation.
+  size_t old = first;
+  const ptrdiff_t delta = (ptrdiff_t)edit.inserted.size()
+                        - (ptrdiff_t)edit.removed;
+
+  Lexer lexer{*_doc, _starts[first], new_end, Lexer::LF_OffsetsOnly};
+  while (true) {
+    Token token = lexer.lex();
+    size_t start = token.start.offset;
+    if (start >= edit.offset + edit.inserted.size()) {
+      size_t old_start = (size_t)((ptrdiff_t)start - delta);
+      while (old < size() && _starts[old] < old_start) {
+        ++old;
+      }
+      if (old < size() && _starts[old] == old_start
+          && old_start >= edit_end) {
+        break;
+      }
+    }
+    kinds.push_back(pack_kind(token.what));
+    starts.push_back((uint32_t)start);
+    lengths.push_back((uint32_t)(token.end.offset - start));
+  }
+
+  for (size_t i = old; i < size(); ++i) {
+    _starts[i] = (uint32_t)((ptrdiff_t)_starts[i] + delta);
+  }
+
+  Splice splice{first, old - first, kinds.size()};
+  auto replace = [&](auto &array, auto &with) {
+    if (with.size() <= splice.removed) {
+      std::copy(with.begin(), with.end(), array.begin() + first);
+      array.erase(array.begin() + first + with.size(),
+                  array.begin() + old);
+    } else {
+      std::copy(with.begin(), with.begin() + splice.removed,
+                array.begin() + first);
+      array.insert(array.begin() + old,
+                   with.begin() + splice.removed, with.end());
+    }
+  };
+  replace(_kinds, kinds);
+  replace(_starts, starts);
+  replace(_lengths, lengths);
+  return splice;
+}
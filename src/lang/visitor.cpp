@@ -171,7 +171,9 @@ void NodeVisitor::visit(const FunDefItem &item) {
   if (item.return_type()) {
     visit(*item.return_type());
   }
-  visit(item.body());
+  if (item.is_body_parsed()) {
+    visit(item.body());
+  }
 }
 
 void NodeVisitor::visit(const StructDefItem &item) {
@@ -0,0 +1,79 @@
+#include <fmt/format.h>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lava/lang/interner.h"
+
+using namespace lava::lang;
+
+// The baseline: the single-threaded interner behind one lock.
+struct LockedInterner {
+  std::mutex mutex;
+  StringInterner strings;
+
+  InternString intern(std::string_view str) {
+    std::lock_guard<std::mutex> lock{mutex};
+    return strings.intern(str);
+  }
+};
+
+// Each thread interns every name `rounds` times, starting at a different
+// place, so the first round races to insert and the rest are lookups.
+template<typename Interner>
+double run(unsigned threads, const std::vector<std::string> &names,
+           int rounds) {
+  Interner interner;
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      size_t offset = names.size() / threads * t;
+      for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < names.size(); ++i) {
+          interner.intern(names[(i + offset) % names.size()]);
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 3) {
+    fmt::print(stderr, "Usage: bench-interner [names] [rounds]\n");
+    return 1;
+  }
+  int count = argc >= 2 ? std::atoi(argv[1]) : 100000;
+  int rounds = argc >= 3 ? std::atoi(argv[2]) : 10;
+  if (count <= 0 || rounds <= 0) {
+    fmt::print(stderr, "Counts must be positive.\n");
+    return 1;
+  }
+
+  std::vector<std::string> names;
+  names.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    names.push_back(fmt::format("identifier_{}", i));
+  }
+
+  fmt::print("{} names x {} rounds per thread, million interns per second\n",
+             count, rounds);
+  fmt::print("threads     locked concurrent\n");
+  for (unsigned threads = 1; threads <= 32; threads *= 2) {
+    double ops = (double)threads * count * rounds / 1e6;
+    double locked = run<LockedInterner>(threads, names, rounds);
+    double concurrent = run<ConcurrentStringInterner>(threads, names, rounds);
+    fmt::print("{:7} {:10.1f} {:10.1f}\n", threads, ops / locked,
+               ops / concurrent);
+  }
+
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include <fmt/format.h>
+#include <fstream>
+#include <optional>
+#include <chrono>
+#include <cstdlib>
+#include "lava/lang/lexer.h"
+#include "lava/lang/tokenbuffer.h"
+#include "lava/util/thread_pool.h"
+
+std::optional<std::string> read_file(const char *filename) {
+  constexpr size_t buf_size = 4096;
+  std::ifstream ifs{filename, std::ios::in | std::ios::binary};
+
+  if (!ifs) {
+    return std::nullopt;
+  }
+
+  std::string content;
+  char buf[buf_size];
+  while (ifs.read(buf, buf_size)) {
+    content.append(buf, ifs.gcount());
+  }
+  content.append(buf, ifs.gcount());
+  return content;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 4) {
+    fmt::print(stderr,
+               "Usage: bench-lexer <filename> [iterations] [threads]\n");
+    return 1;
+  }
+  auto content = read_file(argv[1]);
+  if (!content.has_value()) {
+    fmt::print(stderr, "Open file error.\n");
+    return 1;
+  }
+  int iterations = argc >= 3 ? std::atoi(argv[2]) : 10;
+  if (iterations <= 0) {
+    iterations = 1;
+  }
+  lava::lang::SourceDoc doc{
+    argv[1], std::move(content).value()
+  };
+
+  // With a thread count, time building a token buffer in parallel instead
+  // of pulling tokens from a lexer.
+  int threads = argc == 4 ? std::atoi(argv[3]) : 0;
+  std::optional<lava::ThreadPool> pool;
+  if (threads > 0) {
+    pool.emplace(threads - 1);
+  }
+
+  size_t tokens = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    if (pool) {
+      lava::lang::TokenBuffer buffer{doc, *pool};
+      tokens += buffer.size() - 1;
+      continue;
+    }
+    lava::lang::Lexer lexer{doc};
+    while (lexer.lex().what != lava::lang::TkEof) {
+      ++tokens;
+    }
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  double mb = (double)doc.content.size() * iterations / (1024 * 1024);
+  fmt::print("{} bytes x {}: {} tokens, {:.3f}s, {:.1f} MB/s\n",
+             doc.content.size(), iterations, tokens / iterations,
+             elapsed.count(), mb / elapsed.count());
+
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <fmt/format.h>
+#include <fstream>
+#include <optional>
+#include <chrono>
+#include <cstdlib>
+#include "lava/lang/parser.h"
+#include "lava/lang/tokenbuffer.h"
+#include "lava/lang/visitor.h"
+
+using namespace lava::lang;
+
+std::optional<std::string> read_file(const char *filename) {
+  constexpr size_t buf_size = 4096;
+  std::ifstream ifs{filename, std::ios::in | std::ios::binary};
+
+  if (!ifs) {
+    return std::nullopt;
+  }
+
+  std::string content;
+  char buf[buf_size];
+  while (ifs.read(buf, buf_size)) {
+    content.append(buf, ifs.gcount());
+  }
+  content.append(buf, ifs.gcount());
+  return content;
+}
+
+// Both counters do the same work per node, so the difference between them
+// is the cost of dispatch.
+struct DynamicCounter : NodeVisitor {
+  using NodeVisitor::visit;
+
+  size_t exprs = 0;
+
+  void visit(const Expr &expr) override {
+    ++exprs;
+    NodeVisitor::visit(expr);
+  }
+};
+
+struct StaticCounter : StaticVisitor<StaticCounter> {
+  using StaticVisitor::visit;
+
+  size_t exprs = 0;
+
+  void visit(const Expr &expr) {
+    ++exprs;
+    StaticVisitor::visit(expr);
+  }
+};
+
+template<typename F>
+double time(int iterations, F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    f();
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    fmt::print(stderr, "Usage: bench-visitor <filename> [iterations]\n");
+    return 1;
+  }
+  auto content = read_file(argv[1]);
+  if (!content.has_value()) {
+    fmt::print(stderr, "Open file error.\n");
+    return 1;
+  }
+  int iterations = argc == 3 ? std::atoi(argv[2]) : 10;
+  if (iterations <= 0) {
+    iterations = 1;
+  }
+  SourceDoc doc{
+    argv[1], std::move(content).value()
+  };
+
+  TokenBuffer tokens{doc};
+  Diagnostics diagnostics;
+  Parser parser{tokens, 0, &diagnostics};
+  auto document = parser.parse_document();
+  if (!document) {
+    diagnostics.print(stderr);
+    return 1;
+  }
+
+  size_t dynamic_exprs = 0;
+  double dynamic_time = time(iterations, [&] {
+    DynamicCounter counter;
+    counter.visit(*document);
+    dynamic_exprs = counter.exprs;
+  });
+
+  size_t static_exprs = 0;
+  double static_time = time(iterations, [&] {
+    StaticCounter counter;
+    counter.visit(*document);
+    static_exprs = counter.exprs;
+  });
+
+  if (dynamic_exprs != static_exprs) {
+    fmt::print(stderr, "Visitors disagree: {} vs {} expressions.\n",
+               dynamic_exprs, static_exprs);
+    return 1;
+  }
+
+  fmt::print("{} exprs x {}: NodeVisitor {:.3f}s, StaticVisitor {:.3f}s "
+             "({:.2f}x)\n",
+             static_exprs, iterations, dynamic_time, static_time,
+             dynamic_time / static_time);
+
+  return 0;
+}
@@ -1,6 +1,7 @@
 #include "lava/lava.h"
 #include "lava/util/scope_exit.h"
 #include "rope/rope.h" 
+#include "lava/data/rope.h"
 
 #include <catch2/catch_test_macros.hpp>
 
@@ -90,3 +91,16 @@ TEST_CASE("Librope additions", "[rope]") {
   }
 }
 
+TEST_CASE("Rope chunks", "[rope]") {
+  lava::data::Rope rope{std::string_view{g_bigTextBlock}};
+  rope.insert(10, "inserted text that splits a node");
+
+  std::string text;
+  size_t chunks = 0;
+  for (auto it = rope.chunks_begin(); it != rope.chunks_end(); ++it) {
+    text.append(*it);
+    ++chunks;
+  }
+  REQUIRE(chunks > 1);
+  REQUIRE(text == rope.substr(0));
+}
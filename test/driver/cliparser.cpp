@@ -1,6 +1,7 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_tostring.hpp>
 #include "lava/driver/cliparser.h"
+#include "lava/driver/options.h"
 
 using namespace lava::driver;
 using namespace std::string_view_literals;
@@ -100,3 +101,40 @@ TEST_CASE("CLI Parser", "[cli]") {
   TestParser parser{sizeof(argv) / sizeof(argv[0]), argv};
   REQUIRE(parser() == 0);
 }
+
+TEST_CASE("Cache dir option", "[cli]") {
+  const char *const argv[] = {
+    "appname",
+    "--cache-dir", "cache",
+    "main.lava",
+  };
+  auto result = Options::from_args(sizeof(argv) / sizeof(argv[0]), argv);
+  auto *opts = std::get_if<Options>(&result);
+  REQUIRE(opts);
+  REQUIRE(opts->cache_dir == "cache");
+  REQUIRE(opts->sources.size() == 1);
+  REQUIRE(opts->sources[0] == "main.lava");
+
+  const char *const argv_eq[] = {"appname", "--cache-dir=other/cache"};
+  result = Options::from_args(2, argv_eq);
+  opts = std::get_if<Options>(&result);
+  REQUIRE(opts);
+  REQUIRE(opts->cache_dir == "other/cache");
+}
+
+TEST_CASE("Cache dir option without a directory", "[cli]") {
+  const char *const argv[] = {"appname", "--cache-dir"};
+  auto result = Options::from_args(2, argv);
+  REQUIRE(std::holds_alternative<int>(result));
+  REQUIRE(std::get<int>(result) != 0);
+
+  const char *const argv_empty[] = {"appname", "--cache-dir="};
+  result = Options::from_args(2, argv_empty);
+  REQUIRE(std::holds_alternative<int>(result));
+
+  const char *const argv_twice[] = {
+    "appname", "--cache-dir", "a", "--cache-dir", "b"
+  };
+  result = Options::from_args(5, argv_twice);
+  REQUIRE(std::holds_alternative<int>(result));
+}
@@ -1,6 +1,8 @@
 #include <catch2/catch_test_macros.hpp>
 #include "lava/lang/parser.h"
 #include "lava/lang/firstpass.h"
+#include "lava/lang/iremit.h"
+#include <deque>
 
 using namespace lava::lang;
 
@@ -18,11 +20,11 @@ TEST_CASE("Function declaration", "[firstpass]") {
 
   auto docnode = parser.parse_document();
   REQUIRE(docnode);
-  fp.NodeVisitor::visit(*docnode);
+  fp.visit(*docnode);
 
   auto main_sym = symtab.global_namespace().get(symtab.intern("main"));
   REQUIRE(main_sym);
-  auto main_fn = dynamic_cast<Function*>(main_sym);
+  auto main_fn = lava::dyn_cast<Function>(main_sym);
   REQUIRE(main_fn);
   REQUIRE(main_fn->args_namespace().get(symtab.intern("argc")));
 }
@@ -32,11 +34,11 @@ TEST_CASE("Function declaration/definition", "[firstpass]") {
 
   auto docnode = parser.parse_document();
   REQUIRE(docnode);
-  fp.NodeVisitor::visit(*docnode);
+  fp.visit(*docnode);
 
   auto test_sym = symtab.global_namespace().get(symtab.intern("test"));
   REQUIRE(test_sym);
-  auto test_fn = dynamic_cast<Function*>(test_sym);
+  auto test_fn = lava::dyn_cast<Function>(test_sym);
   REQUIRE(test_fn);
 }
 
@@ -45,11 +47,11 @@ TEST_CASE("Function type equivalence", "[firstpass]") {
 
   auto docnode = parser.parse_document();
   REQUIRE(docnode);
-  fp.NodeVisitor::visit(*docnode);
+  fp.visit(*docnode);
 
   auto test_sym = symtab.global_namespace().get(symtab.intern("test"));
   REQUIRE(test_sym);
-  auto test_fn = dynamic_cast<Function*>(test_sym);
+  auto test_fn = lava::dyn_cast<Function>(test_sym);
   REQUIRE(test_fn);
 
   FunctionType::ArgVector args;
@@ -64,3 +66,84 @@ TEST_CASE("Function type equivalence", "[firstpass]") {
   REQUIRE(test_fn->args_namespace().size() == 1);
   REQUIRE(test_fn->args_namespace()[0]->name() == symtab.intern("b"));
 }
+
+TEST_CASE("Replacing one function", "[firstpass]") {
+  SETUP(
+    "fun a(int x) -> int { return x + 1; };\n"
+    "fun b(int y) -> int { return a(y); };\n"
+    "fun c() -> int { return 2; };\n"
+  );
+
+  auto docnode = parser.parse_document();
+  REQUIRE(docnode);
+  fp.visit(*docnode);
+  IREmitter ire{symtab};
+  ire.visit(*docnode);
+
+  auto &global = symtab.global_namespace();
+  auto a = symtab.intern("a");
+  auto b_fn = lava::dyn_cast<Function>(global.get(symtab.intern("b")));
+  auto c_fn = lava::dyn_cast<Function>(global.get(symtab.intern("c")));
+  REQUIRE(b_fn);
+  REQUIRE(c_fn);
+  auto b_users = global.dependencies().users(a);
+  REQUIRE(b_users);
+  REQUIRE(*b_users == std::vector<InternString>{b_fn->name()});
+  REQUIRE_FALSE(global.dependencies().users(symtab.intern("y")));
+
+  // Nodes point into their document, so keep every edit's around.
+  std::deque<SourceDoc> edits;
+  auto reparse = [&](const char *content) {
+    auto &doc = edits.emplace_back(SourceDoc{
+      .name = "edit", .content = content
+    });
+    Lexer lexer{doc};
+    Parser parser{lexer};
+    auto docnode = parser.parse_document();
+    REQUIRE(docnode);
+    return docnode;
+  };
+
+  // A new body with the same type leaves the users alone.
+  auto edited = reparse("fun a(int x) -> int { return x * 3; };");
+  auto &a_item = static_cast<const FunDefItem&>(*edited->items()[0]);
+  auto *old_a = global.get(a);
+  REQUIRE(fp.replace(a_item).empty());
+  auto a_fn = lava::dyn_cast<Function>(global.get(a));
+  REQUIRE(a_fn);
+  REQUIRE(a_fn != old_a);
+  REQUIRE(a_fn->basicblocks().empty());
+  REQUIRE(global[global.size() - 3] == a_fn);
+  REQUIRE(global.get(symtab.intern("b")) == b_fn);
+  REQUIRE_FALSE(b_fn->basicblocks().empty());
+  ire.visit(a_item);
+  REQUIRE_FALSE(a_fn->basicblocks().empty());
+
+  // A new type invalidates the functions that read the name.
+  edited = reparse("fun a(uint8 x) -> int { return x; };");
+  auto invalidated = fp.replace(
+    static_cast<const FunDefItem&>(*edited->items()[0])
+  );
+  REQUIRE(invalidated == std::vector<Function*>{b_fn});
+  REQUIRE(b_fn->basicblocks().empty());
+  REQUIRE(b_fn->register_count() == 0);
+  REQUIRE_FALSE(c_fn->basicblocks().empty());
+  REQUIRE_FALSE(global.dependencies().users(a));
+
+  // Emitting a user again records what it reads again.
+  for (auto const &item : docnode->items()) {
+    if (item->item_kind() != ItemKind::FunDef) {
+      continue;
+    }
+    auto &def = static_cast<const FunDefItem&>(*item);
+    if (def.name() == "b") {
+      ire.visit(def);
+    }
+  }
+  REQUIRE(global.dependencies().users(a));
+
+  REQUIRE(fp.remove(a) == std::vector<Function*>{b_fn});
+  REQUIRE_FALSE(global.get(a));
+  REQUIRE(global.get(symtab.intern("c")) == c_fn);
+  REQUIRE(fp.remove(a).empty());
+}
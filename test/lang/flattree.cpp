@@ -0,0 +1,113 @@
+#include <catch2/catch_test_macros.hpp>
+#include "lava/lang/flattree.h"
+#include "lava/lang/parser.h"
+#include "lava/lang/visitor.h"
+
+using namespace lava::lang;
+
+namespace {
+
+// Records every node a NodeVisitor pass sees, with its source range.
+struct Recorder : NodeVisitor {
+  using NodeVisitor::visit;
+
+  std::vector<std::pair<size_t, size_t>> ranges;
+
+  void visit(const Expr &expr) override {
+    ranges.emplace_back(expr.start().offset, expr.end().offset);
+    NodeVisitor::visit(expr);
+  }
+
+  void visit(const Item &item) override {
+    ranges.emplace_back(item.start().offset, item.end().offset);
+    NodeVisitor::visit(item);
+  }
+};
+
+const char *const Source =
+  "struct S { int x, y = 1; }\n"
+  "fun f(int a, S b = S()) -> int {\n"
+  "  if (a > 0) { return -a; } else if a { x++; } else { break 1.5; };\n"
+  "  while a { a = foo(a, 'str', 0x10); };\n"
+  "  loop { continue; };\n"
+  "};\n"
+  "fun g();\n"
+  "int v = (1 + 2) * 3;\n";
+
+} // anonymous namespace
+
+TEST_CASE("Flat tree round trip", "[syntax][flattree]") {
+  SourceDoc doc{ .name = "test", .content = Source };
+  TokenBuffer tokens{doc};
+  auto tree = Parser{tokens}.parse_document();
+  REQUIRE(tree != nullptr);
+
+  FlatTree flat{*tree, tokens};
+  REQUIRE(flat.kind(0) == FlatKind::Document);
+  REQUIRE(flat.node(0).end == flat.size());
+  REQUIRE(flat.children(0).size() == tree->items().size());
+
+  // Existing passes run on the expanded tree and see the same nodes.
+  Recorder expected;
+  expected.visit(*tree);
+  auto expanded = flat.expand();
+  Recorder actual;
+  actual.visit(*expanded);
+  REQUIRE(actual.ranges == expected.ranges);
+
+  // A copy is independent of the original.
+  FlatTree copy = flat;
+  REQUIRE(copy.size() == flat.size());
+  REQUIRE(FlatTree{*copy.expand(), tokens}.size() == flat.size());
+}
+
+TEST_CASE("Flat tree scans", "[syntax][flattree]") {
+  SourceDoc doc{ .name = "test", .content = Source };
+  TokenBuffer tokens{doc};
+  auto tree = Parser{tokens, Parser::PF_LazyBodies}.parse_document();
+  REQUIRE(tree != nullptr);
+  // Skipped bodies are parsed into the flat tree, but not into `tree`.
+  FlatTree flat{*tree, tokens};
+  REQUIRE(!static_cast<const FunDefItem&>(*tree->items()[1])
+             .is_body_parsed());
+
+  // Pre-order: a scan sees the nodes in source order.
+  std::vector<std::string_view> idents;
+  for (uint32_t n = 0; n < flat.size(); ++n) {
+    if (flat.kind(n) == FlatKind::Ident) {
+      idents.push_back(flat.token(n, 0).text());
+    }
+  }
+  REQUIRE(idents == std::vector<std::string_view>{
+    "int", "int", "S", "S", "int", "a", "a", "a", "x", "a", "a", "foo", "a",
+    "int"
+  });
+
+  // Subtrees are contiguous.
+  uint32_t fun = flat.children(0)[1];
+  REQUIRE(flat.kind(fun) == FlatKind::FunDefItem);
+  for (uint32_t child : flat.children(fun)) {
+    if (child != FlatTree::None) {
+      REQUIRE(child > fun);
+      REQUIRE(flat.node(child).end <= flat.node(fun).end);
+    }
+  }
+
+  uint32_t literal = 0;
+  for (uint32_t n = 0; n < flat.size(); ++n) {
+    if (flat.kind(n) == FlatKind::Literal
+        && flat.token(n, 0).text() == "0x10") {
+      literal = n;
+    }
+  }
+  REQUIRE(literal != 0);
+  REQUIRE(flat.literal_bits(literal) == 16);
+}
+
+TEST_CASE("Flat tree with an invalid skipped body", "[syntax][flattree]") {
+  SourceDoc doc{ .name = "test", .content = "fun f() { x y }\n" };
+  TokenBuffer tokens{doc};
+  auto tree = Parser{tokens, Parser::PF_LazyBodies}.parse_document();
+  REQUIRE(tree != nullptr);
+  REQUIRE_THROWS_AS((FlatTree{*tree, tokens}), ParseError);
+}
@@ -0,0 +1,77 @@
+#include <catch2/catch_test_macros.hpp>
+#include "lava/lang/interner.h"
+#include <string>
+#include <thread>
+
+using namespace lava::lang;
+
+TEST_CASE("Interning deduplicates strings", "[interner]") {
+  StringInterner strings;
+  auto a = strings.intern("alpha");
+  auto b = strings.intern("beta");
+  REQUIRE(a != b);
+  REQUIRE(strings.intern(std::string{"alpha"}) == a);
+  REQUIRE(strings.get(a) == "alpha");
+  REQUIRE(strings.get(b) == "beta");
+  REQUIRE(strings.size() == 2);
+
+  REQUIRE(strings.find("beta") == b);
+  REQUIRE_FALSE(strings.find("gamma"));
+  REQUIRE(strings.size() == 2);
+
+  auto empty = strings.intern("");
+  REQUIRE_FALSE(empty);
+  REQUIRE(strings.get(empty).empty());
+}
+
+TEST_CASE("Interned strings don't move", "[interner]") {
+  StringInterner strings;
+  auto first = strings.intern("first");
+  auto view = strings.get(first);
+
+  std::vector<InternString> interned;
+  for (int i = 0; i < 100000; ++i) {
+    interned.push_back(strings.intern("name" + std::to_string(i)));
+  }
+
+  REQUIRE(strings.get(first).data() == view.data());
+  REQUIRE(view == "first");
+  for (int i = 0; i < 100000; ++i) {
+    REQUIRE(strings.intern("name" + std::to_string(i)) == interned[i]);
+  }
+  REQUIRE(strings.size() == 100001);
+}
+
+TEST_CASE("Concurrent interning", "[interner]") {
+  ConcurrentStringInterner strings;
+  constexpr int Threads = 8;
+  constexpr int Names = 20000;
+
+  // Every thread interns the same names in a different order, so most
+  // strings are raced for.
+  std::vector<std::vector<InternString>> results(Threads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < Threads; ++t) {
+    threads.emplace_back([&, t] {
+      auto &result = results[t];
+      result.resize(Names);
+      for (int i = 0; i < Names; ++i) {
+        int n = (i * 7 + t * 1009) % Names;
+        result[n] = strings.intern("name" + std::to_string(n));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  REQUIRE(strings.size() == Names);
+  for (int i = 0; i < Names; ++i) {
+    auto name = "name" + std::to_string(i);
+    REQUIRE(strings.get(results[0][i]) == name);
+    REQUIRE(strings.find(name) == results[0][i]);
+    for (int t = 1; t < Threads; ++t) {
+      REQUIRE(results[t][i] == results[0][i]);
+    }
+  }
+}
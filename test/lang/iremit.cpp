@@ -0,0 +1,45 @@
+#include <catch2/catch_test_macros.hpp>
+#include "lava/lang/parser.h"
+#include "lava/lang/firstpass.h"
+#include "lava/lang/iremit.h"
+#include <string>
+
+using namespace lava::lang;
+
+TEST_CASE("Emit a very long operator chain", "[iremit]") {
+  // Deep enough that a recursive walk or destructor would run out of stack.
+  constexpr size_t terms = 500000;
+  std::string content = "fun f(int a) -> int { return a";
+  for (size_t i = 1; i < terms; ++i) {
+    content += " + a";
+  }
+  content += "; }";
+
+  PointerType::TargetPointerSize = sizeof(size_t);
+  SymbolTable symtab;
+  SourceDoc doc{ .name = "test", .content = std::move(content) };
+  Lexer lexer{doc};
+  Parser parser{lexer};
+  auto docnode = parser.parse_document();
+  REQUIRE(docnode);
+
+  FirstPass fp{symtab};
+  fp.visit(*docnode);
+  IREmitter ire{symtab};
+  ire.visit(*docnode);
+
+  auto fn = lava::dyn_cast<Function>(
+    symtab.global_namespace().get(symtab.intern("f"))
+  );
+  REQUIRE(fn);
+  REQUIRE(fn->basicblocks().size() == 1);
+  auto const &instrs = fn->basicblocks()[0].instrs;
+  size_t adds = 0;
+  for (auto const &instr : instrs) {
+    adds += instr.op == Op::Add;
+  }
+  REQUIRE(adds == terms - 1);
+  REQUIRE(instrs.back().op == Op::Ret);
+
+  docnode.reset();
+}
@@ -1,5 +1,6 @@
 #include <catch2/catch_test_macros.hpp>
 #include "lava/lang/lexer.h"
+#include "lava/lang/chunklexer.h"
 
 using namespace lava::lang;
 
@@ -45,3 +46,168 @@ TEST_CASE("Lex strings", "[syntax][lexer]") {
   token = lexer.lex();
   REQUIRE(token.what == TkEof);
 }
+
+TEST_CASE("Lex long runs", "[syntax][lexer]") {
+  INIT_LEXER(
+    "/* a block comment that spans more than one vector register\n"
+    "   and more than one line */"
+    "                                                                  \n"
+    "an_identifier_that_is_long_enough_to_need_more_than_one_load_ok"
+    "// trailing comment\n"
+    "'a string\nwith a newline' x"
+  );
+
+  Token token = lexer.lex();
+  REQUIRE(token.what == TkBlockComment);
+  REQUIRE(token.end.line == 2);
+  REQUIRE(token.end.column == 29);
+
+  token = lexer.lex();
+  REQUIRE(token.what == TkWhitespace);
+  REQUIRE(token.end.line == 3);
+  REQUIRE(token.end.column == 1);
+
+  token = lexer.lex();
+  REQUIRE(token.what == TkIdent);
+  REQUIRE(token.text() ==
+    "an_identifier_that_is_long_enough_to_need_more_than_one_load_ok");
+
+  token = lexer.lex();
+  REQUIRE(token.what == TkLineComment);
+  REQUIRE(token.end.line == 4);
+
+  token = lexer.lex();
+  REQUIRE(token.what == TkStringLiteral);
+  REQUIRE(token.end.line == 5);
+  REQUIRE(token.end.column == 16);
+
+  token = lexer.lex();
+  REQUIRE(token.what == TkWhitespace);
+  token = lexer.lex();
+  REQUIRE(token.what == TkIdent);
+  REQUIRE(token.start.column == 17);
+  token = lexer.lex();
+  REQUIRE(token.what == TkEof);
+}
+
+TEST_CASE("Lex offsets only", "[syntax][lexer]") {
+  SourceDoc doc{
+    "test",
+    "fun f() {\n  x = 1; /* two\nlines */\n\n  'a\nb' y\n}"
+  };
+  Lexer full{doc};
+  Lexer offsets{doc, Lexer::LF_OffsetsOnly};
+
+  while (true) {
+    Token expected = full.lex();
+    Token token = offsets.lex();
+    REQUIRE(token.what == expected.what);
+    REQUIRE(token.start.offset == expected.start.offset);
+    REQUIRE(token.end.offset == expected.end.offset);
+    REQUIRE_FALSE(token.start.is_resolved());
+
+    SourceLoc start = doc.resolve(token.start);
+    REQUIRE(start.line == expected.start.line);
+    REQUIRE(start.column == expected.start.column);
+    SourceLoc end = doc.resolve(token.end);
+    REQUIRE(end.line == expected.end.line);
+    REQUIRE(end.column == expected.end.column);
+
+    if (token.what == TkEof) {
+      break;
+    }
+  }
+}
+
+TEST_CASE("Lex keywords", "[syntax][lexer]") {
+  auto lex_one = [](std::string text) {
+    SourceDoc doc{ "test", std::move(text) };
+    Lexer lexer{doc};
+    return lexer.lex().what;
+  };
+
+#define X(Name) \
+  { \
+    std::string word{get_token_name(Tk##Name)}; \
+    for (auto &c : word) { \
+      c |= 0x20; \
+    } \
+    REQUIRE(lex_one(word) == Tk##Name); \
+    REQUIRE(lex_one(word + "_") == TkIdent); \
+    REQUIRE(lex_one(word.substr(1)) == TkIdent); \
+  }
+  LAVA_KEYWORDS(X)
+#undef X
+
+  REQUIRE(lex_one("If") == TkIdent);
+  REQUIRE(lex_one("fan") == TkIdent);
+  REQUIRE(lex_one("continuation") == TkIdent);
+  REQUIRE(lex_one("a_very_long_identifier_name") == TkIdent);
+}
+
+namespace {
+
+// Splits a string into chunks of a fixed size.
+struct SplitChunkReader : ChunkReader {
+  std::string_view rest;
+  size_t size;
+
+  SplitChunkReader(std::string_view text, size_t size)
+    : rest{text}, size{size}
+  {}
+
+  std::string_view next_chunk() override {
+    auto chunk = rest.substr(0, size);
+    rest.remove_prefix(chunk.size());
+    return chunk;
+  }
+};
+
+void require_same_tokens(const SourceDoc &doc, ChunkReader &reader,
+                         unsigned flags = 0) {
+  Lexer lexer{doc, flags};
+  SourceDoc name_only{ .name = doc.name, .content = "" };
+  ChunkLexer chunk_lexer{name_only, reader, flags};
+  while (true) {
+    Token expected = lexer.lex();
+    Token token = chunk_lexer.lex();
+    REQUIRE(token.what == expected.what);
+    REQUIRE(token.start.offset == expected.start.offset);
+    REQUIRE(token.end.offset == expected.end.offset);
+    REQUIRE(token.start.line == expected.start.line);
+    REQUIRE(token.start.column == expected.start.column);
+    REQUIRE(token.end.line == expected.end.line);
+    REQUIRE(token.end.column == expected.end.column);
+    REQUIRE(chunk_lexer.text() == expected.text());
+    if (token.what == TkEof) {
+      break;
+    }
+  }
+}
+
+} // anonymous namespace
+
+TEST_CASE("Lex from chunks", "[syntax][lexer]") {
+  SourceDoc doc{
+    .name = "test",
+    .content =
+      "fun main() {\n"
+      "  /* a block comment long enough to cross several chunks\n"
+      "     of the input */ x <-<= y; a <- b; 0x 0x1f 0b2 1.5 .. ...\n"
+      "  'a string that is also\nfairly long' // line comment\n"
+      "  an_identifier_spanning_chunks + _x;\n"
+      "} /* unterminated"
+  };
+
+  for (size_t size : {1, 2, 3, 7, 16, 64, 1000}) {
+    SplitChunkReader reader{doc.content, size};
+    require_same_tokens(doc, reader);
+  }
+
+  SplitChunkReader reader{doc.content, 5};
+  require_same_tokens(doc, reader, Lexer::LF_OffsetsOnly);
+
+  lava::data::Rope rope{doc.content};
+  RopeChunkReader rope_reader{rope};
+  require_same_tokens(doc, rope_reader);
+}
@@ -0,0 +1,181 @@
+#include <catch2/catch_test_macros.hpp>
+#include "lava/lang/module.h"
+#include "lava/lang/parser.h"
+#include "lava/lang/firstpass.h"
+#include "lava/lang/iremit.h"
+#include "lava/util/scope_exit.h"
+#include "../temppath.h"
+#include <fstream>
+
+using namespace lava::lang;
+namespace fs = std::filesystem;
+using lava::test::unique_temp_path;
+
+namespace {
+
+const char *const Source =
+  "fun add(int a, int b) -> int { return a + b; };\n"
+  "fun twice(int32 x) -> int32 {\n"
+  "  if x > 0 { return add(x, 'str'); };\n"
+  "  while x { add(x, 2.5); };\n"
+  "  return ~x;\n"
+  "};\n"
+  "fun flag(uint8 c) -> bool { return c; };\n";
+
+void build(SymbolTable &symtab) {
+  SourceDoc doc{ .name = "test", .content = Source };
+  Lexer lexer{doc};
+  Parser parser{lexer};
+  auto docnode = parser.parse_document();
+  REQUIRE(docnode);
+  FirstPass fp{symtab};
+  fp.visit(*docnode);
+  IREmitter ire{symtab};
+  ire.visit(*docnode);
+}
+
+// Compares everything but string operands, which are compared by content.
+void require_same_ir(const SymbolTable &expected_symtab,
+                     const Function &expected,
+                     const SymbolTable &actual_symtab,
+                     const Function &actual) {
+  REQUIRE(actual.register_count() == expected.register_count());
+  auto const &expected_bbs = expected.basicblocks();
+  auto const &actual_bbs = actual.basicblocks();
+  REQUIRE(actual_bbs.size() == expected_bbs.size());
+  for (size_t b = 0; b < expected_bbs.size(); ++b) {
+    auto const &e = expected_bbs[b].instrs;
+    auto const &a = actual_bbs[b].instrs;
+    REQUIRE(a.size() == e.size());
+    for (size_t i = 0; i < e.size(); ++i) {
+      REQUIRE(a[i].op == e[i].op);
+      if (e[i].op == Op::LdStr || e[i].op == Op::LdVar) {
+        auto const &es = e[i].ldvar;
+        auto const &as = a[i].ldvar;
+        REQUIRE(as.dest == es.dest);
+        REQUIRE(actual_symtab.get_string(InternString{as.index, as.size})
+                == expected_symtab.get_string(
+                     InternString{es.index, es.size}));
+      } else {
+        REQUIRE(instr_to_string(a[i]) == instr_to_string(e[i]));
+      }
+    }
+  }
+}
+
+} // anonymous namespace
+
+TEST_CASE("Save and load a module", "[symbol][module]") {
+  PointerType::TargetPointerSize = sizeof(size_t);
+  auto path = unique_temp_path("lava-test-module");
+  LAVA_SCOPE_EXIT { fs::remove(path); };
+
+  SymbolTable source;
+  build(source);
+  StructType::FieldVector fields;
+  fields.emplace_back(source.intern("tag"), &source.int_type(1, false));
+  fields.emplace_back(source.intern("total"), &source.int_type(8, true));
+  fields.emplace_back(source.intern("note"), &source.int_type(2, true), true);
+  source.global_namespace().add(std::make_unique<TypeAlias>(
+    source.intern("record"),
+    &source.struct_type(StructType{fields, StructLayout::Compact})
+  ));
+  REQUIRE(save_module(source, source.global_namespace(), path));
+
+  // Shift the string indices so that loading has to remap them.
+  SymbolTable symtab;
+  symtab.intern("padding");
+  symtab.intern("x");
+  auto *lib = load_module(symtab, symtab.intern("lib"), path);
+  REQUIRE(lib);
+  REQUIRE(symtab.global_namespace().get(symtab.intern("lib")) == lib);
+  REQUIRE(lib->size() == 4);
+
+  for (auto name : {"add", "twice", "flag"}) {
+    auto *expected = lava::dyn_cast<Function>(
+      source.global_namespace().get(source.intern(name))
+    );
+    auto *actual = lava::dyn_cast<Function>(lib->get(symtab.intern(name)));
+    REQUIRE(expected);
+    REQUIRE(actual);
+    require_same_ir(source, *expected, symtab, *actual);
+  }
+
+  auto *add = lava::dyn_cast<Function>(lib->get(symtab.intern("add")));
+  auto const &int_type = symtab.int_type(true);
+  REQUIRE(add->type()->return_type == &int_type);
+  REQUIRE(add->type()->arg_types.size() == 2);
+  REQUIRE(add->type()->arg_types[1].type == &int_type);
+  REQUIRE(symtab.get_string(add->type()->arg_types[1].name) == "b");
+  // Types are interned into the destination table.
+  REQUIRE(add->type() == &symtab.function_type(FunctionType{
+    &int_type, {
+      FunctionArg{symtab.intern("a"), &int_type},
+      FunctionArg{symtab.intern("b"), &int_type},
+    }
+  }));
+  REQUIRE(lava::dyn_cast<Variable>(
+    add->args_namespace().get(symtab.intern("a"))
+  ));
+
+  auto *flag = lava::dyn_cast<Function>(lib->get(symtab.intern("flag")));
+  REQUIRE(flag->type()->return_type == &symtab.bool_type());
+  REQUIRE(flag->type()->arg_types[0].type == &symtab.int_type(1, false));
+
+  // Struct layouts and their hints survive the trip.
+  auto *record = lava::dyn_cast<TypeAlias>(lib->get(symtab.intern("record")));
+  REQUIRE(record);
+  for (auto &field : fields) {
+    field.name = symtab.intern(source.get_string(field.name));
+    field.type = &symtab.int_type(field.type->size,
+                                  static_cast<const IntType*>(field.type)
+                                    ->is_signed);
+  }
+  auto const &record_type =
+    symtab.struct_type(StructType{fields, StructLayout::Compact});
+  REQUIRE(record->type == &record_type);
+  REQUIRE(record_type.order == StructType::OrderVector{1, 0, 2});
+
+  // A loaded module can be used like any other namespace.
+  Namespace user{symtab.intern("user"), symtab.global_namespace()};
+  REQUIRE_FALSE(user.getrec(symtab.intern("twice")));
+  user.add_using(*lib);
+  auto twice = symtab.intern("twice");
+  REQUIRE(user.getrec(twice) == lib->get(twice));
+
+  // The name is taken now.
+  REQUIRE_FALSE(load_module(symtab, symtab.intern("lib"), path));
+}
+
+TEST_CASE("Load rejects damaged modules", "[symbol][module]") {
+  PointerType::TargetPointerSize = sizeof(size_t);
+  auto path = unique_temp_path("lava-test-module-damaged");
+  LAVA_SCOPE_EXIT { fs::remove(path); };
+
+  SymbolTable source;
+  build(source);
+  REQUIRE(save_module(source, source.global_namespace(), path));
+
+  SymbolTable symtab;
+  REQUIRE_FALSE(load_module(symtab, symtab.intern("missing"),
+                            unique_temp_path("lava-test-module-missing")));
+
+  auto size = fs::file_size(path);
+  {
+    std::fstream fs{path, std::ios::in | std::ios::out | std::ios::binary};
+    fs.seekp((std::streamoff)size - 1);
+    fs.put('\x7F');
+  }
+  REQUIRE_FALSE(load_module(symtab, symtab.intern("lib"), path));
+
+  fs::resize_file(path, size / 2);
+  REQUIRE_FALSE(load_module(symtab, symtab.intern("lib"), path));
+  REQUIRE_FALSE(symtab.global_namespace().get(symtab.intern("lib")));
+
+  // Modules are only valid for the pointer size they were built for.
+  REQUIRE(save_module(source, source.global_namespace(), path));
+  PointerType::TargetPointerSize = 4;
+  REQUIRE_FALSE(load_module(symtab, symtab.intern("lib"), path));
+  PointerType::TargetPointerSize = sizeof(size_t);
+  REQUIRE(load_module(symtab, symtab.intern("lib"), path));
+}
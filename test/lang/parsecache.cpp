@@ -0,0 +1,134 @@
+#include <catch2/catch_test_macros.hpp>
+#include "lava/lang/parsecache.h"
+#include "lava/lang/parser.h"
+#include "lava/util/scope_exit.h"
+#include "../temppath.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+using namespace lava::lang;
+namespace fs = std::filesystem;
+using lava::test::unique_temp_path;
+
+namespace {
+
+const char *const Source =
+  "struct S { int x; }\n"
+  "fun f(int a) -> int {\n"
+  "  if a > 0 { return -a; };\n"
+  "  while a { a = foo(a, 'str', 0x10); };\n"
+  "};\n"
+  "int v = (1 + 2) * 3.5;\n";
+
+size_t count_entries(const fs::path &dir) {
+  size_t count = 0;
+  for (auto const &file : fs::directory_iterator{dir}) {
+    count += file.path().extension() == ".lavacache";
+  }
+  return count;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Parse cache hit", "[syntax][parsecache]") {
+  auto dir = unique_temp_path("lava-test-parsecache-hit");
+  LAVA_SCOPE_EXIT { fs::remove_all(dir); };
+  ParseCache cache{dir};
+
+  SourceDoc doc{ .name = "test", .content = Source };
+  auto first = cache.parse(doc);
+  REQUIRE_FALSE(first.hit);
+  REQUIRE(first.document());
+  REQUIRE(count_entries(dir) == 1);
+  // The temporary file was renamed into place.
+  REQUIRE(std::distance(fs::directory_iterator{dir},
+                        fs::directory_iterator{}) == 1);
+
+  // A different document with the same content loads the stored entry.
+  SourceDoc same{ .name = "same", .content = Source };
+  auto second = cache.parse(same);
+  REQUIRE(second.hit);
+  REQUIRE(second.document());
+  REQUIRE(second.tokens->size() == first.tokens->size());
+  for (size_t i = 0; i < first.tokens->size(); ++i) {
+    REQUIRE(second.tokens->kind(i) == first.tokens->kind(i));
+    REQUIRE(second.tokens->start(i) == first.tokens->start(i));
+    REQUIRE(second.tokens->length(i) == first.tokens->length(i));
+  }
+
+  // The loaded flat tree matches, and so does the tree expanded from it.
+  REQUIRE(second.tree->size() == first.tree->size());
+  FlatTree expected{*first.document(), *first.tokens};
+  FlatTree actual{*second.document(), *second.tokens};
+  REQUIRE(actual.size() == expected.size());
+  for (uint32_t n = 0; n < expected.size(); ++n) {
+    REQUIRE(actual.kind(n) == expected.kind(n));
+    auto a = actual.token_refs(n), e = expected.token_refs(n);
+    REQUIRE(std::equal(a.begin(), a.end(), e.begin(), e.end()));
+  }
+
+  SourceDoc other{ .name = "other", .content = "int w;" };
+  REQUIRE_FALSE(cache.parse(other).hit);
+  REQUIRE(count_entries(dir) == 2);
+
+  // Invalid documents aren't stored.
+  SourceDoc invalid{ .name = "invalid", .content = "fun f() { a b; }" };
+  auto result = cache.parse(invalid);
+  REQUIRE_FALSE(result.document());
+  REQUIRE(count_entries(dir) == 2);
+}
+
+TEST_CASE("Parse cache rejects damaged entries", "[syntax][parsecache]") {
+  auto dir = unique_temp_path("lava-test-parsecache-damaged");
+  LAVA_SCOPE_EXIT { fs::remove_all(dir); };
+  ParseCache cache{dir};
+
+  SourceDoc doc{ .name = "test", .content = Source };
+  cache.parse(doc);
+  auto path = fs::directory_iterator{dir}->path();
+  auto size = fs::file_size(path);
+  {
+    std::fstream fs{path, std::ios::in | std::ios::out | std::ios::binary};
+    fs.seekp((std::streamoff)size - 1);
+    fs.put('\x7F');
+  }
+  REQUIRE_FALSE(cache.load(doc).tokens);
+
+  // Parsing again replaces the damaged entry.
+  REQUIRE_FALSE(cache.parse(doc).hit);
+  REQUIRE(cache.parse(doc).hit);
+
+  fs::resize_file(path, size / 2);
+  REQUIRE_FALSE(cache.load(doc).tokens);
+}
+
+TEST_CASE("Parse cache eviction", "[syntax][parsecache]") {
+  auto dir = unique_temp_path("lava-test-parsecache-evict");
+  LAVA_SCOPE_EXIT { fs::remove_all(dir); };
+  ParseCache cache{dir};
+
+  SourceDoc a{ .name = "a", .content = "int a;" };
+  SourceDoc b{ .name = "b", .content = "int b;" };
+  SourceDoc c{ .name = "c", .content = "int c;" };
+  cache.parse(a);
+  cache.parse(b);
+  cache.parse(c);
+  REQUIRE(count_entries(dir) == 3);
+
+  // Age every entry, then use `a` and `c` so that `b` is least recently
+  // used.
+  auto now = fs::file_time_type::clock::now();
+  for (auto const &file : fs::directory_iterator{dir}) {
+    fs::last_write_time(file.path(), now - std::chrono::hours{1});
+  }
+  REQUIRE(cache.load(c).hit);
+  REQUIRE(cache.load(a).hit);
+
+  auto entry_size = fs::file_size(fs::directory_iterator{dir}->path());
+  cache.evict(2 * entry_size);
+  REQUIRE(count_entries(dir) == 2);
+  REQUIRE_FALSE(cache.load(b).hit);
+  REQUIRE(cache.load(a).hit);
+  REQUIRE(cache.load(c).hit);
+}
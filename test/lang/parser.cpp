@@ -1,5 +1,9 @@
 #include <catch2/catch_test_macros.hpp>
 #include "lava/lang/parser.h"
+#include "lava/lang/visitor.h"
+#include "lava/util/thread_pool.h"
+#include <string>
+#include <vector>
 
 using namespace lava::lang;
 
@@ -179,3 +183,283 @@ TEST_CASE("Fun return", "[syntax][parser][item]") {
   auto fundecl = static_cast<FunDeclItem*>(item.get());
   REQUIRE(fundecl->return_type() != nullptr);
 }
+
+TEST_CASE("Parse from token buffer", "[syntax][parser]") {
+  SourceDoc doc{
+    .name = "test",
+    .content = "fun foo(int a) { /* hi */ a * 2; }\n// end\nx = y;"
+  };
+  TokenBuffer tokens{doc};
+  Parser parser{tokens};
+
+  REQUIRE(parser.peek(0) == TkFun);
+  REQUIRE(parser.peek() == TkIdent);
+  REQUIRE(parser.peek(2) == TkLeftParen);
+  auto start = parser.mark();
+
+  auto item = parser.parse_item();
+  REQUIRE(item != nullptr);
+  REQUIRE(item->item_kind() == ItemKind::FunDef);
+  REQUIRE(parser.peek(0) == TkIdent);
+  REQUIRE(parser.peek(100) == TkEof);
+
+  parser.reset(start);
+  auto doc_node = parser.parse_document();
+  REQUIRE(doc_node != nullptr);
+  REQUIRE(doc_node->items().size() == 2);
+  REQUIRE(doc_node->items()[1]->item_kind() == ItemKind::Expr);
+}
+
+namespace {
+
+void require_same_items(const Document &a, const Document &b) {
+  REQUIRE(a.items().size() == b.items().size());
+  for (size_t i = 0; i < a.items().size(); ++i) {
+    auto &x = *a.items()[i];
+    auto &y = *b.items()[i];
+    REQUIRE(x.item_kind() == y.item_kind());
+    REQUIRE(x.start().offset == y.start().offset);
+    REQUIRE(x.end().offset == y.end().offset);
+    REQUIRE(x.span().offset == y.span().offset);
+    REQUIRE(x.span().width == y.span().width);
+    REQUIRE(x.span().fingerprint == y.span().fingerprint);
+  }
+}
+
+const Expr *first_in_loop(const Item &item) {
+  auto &body = static_cast<const FunDefItem&>(item).body();
+  auto loop = static_cast<const LoopExpr*>(body.exprs()[0].value.get());
+  return loop->scope().exprs()[0].value.get();
+}
+
+const Expr *last_in_loop(const Item &item) {
+  auto &body = static_cast<const FunDefItem&>(item).body();
+  auto loop = static_cast<const LoopExpr*>(body.exprs().back().value.get());
+  return loop->scope().exprs()[0].value.get();
+}
+
+} // anonymous namespace
+
+TEST_CASE("Reparse after edit", "[syntax][parser]") {
+  SourceDoc doc{
+    .name = "test",
+    .content =
+      "fun a() { x = 1; }\n"
+      "fun b(int n) {\n"
+      "  loop { n = n - 1; };\n"
+      "  y = n;\n"
+      "  loop { n = n + 1; };\n"
+      "}\n"
+      "fun c() { z = 'two'; }\n"
+  };
+  TokenBuffer tokens{doc};
+  auto old = Parser{tokens}.parse_document();
+  REQUIRE(old != nullptr);
+  REQUIRE(old->items().size() == 3);
+  const Item *a = old->items()[0].get();
+  const Item *b = old->items()[1].get();
+  const Item *c = old->items()[2].get();
+  const Expr *first = first_in_loop(*b);
+  const Expr *last = last_in_loop(*b);
+
+  // Rename `y` inside b: a and c are kept whole, as are both loop bodies.
+  TextEdit edit{
+    .offset = doc.content.find("y = n"), .removed = 1, .inserted = "yy"
+  };
+  doc.apply(edit);
+  auto splice = tokens.relex(edit);
+  auto doc_node = Parser{tokens}.reparse_document(*old, splice, edit);
+  REQUIRE(doc_node != nullptr);
+  require_same_items(*doc_node, *Parser{tokens}.parse_document());
+  REQUIRE(doc_node->items()[0].get() == a);
+  REQUIRE(doc_node->items()[1].get() != b);
+  REQUIRE(doc_node->items()[2].get() == c);
+  b = doc_node->items()[1].get();
+  REQUIRE(first_in_loop(*b) == first);
+  REQUIRE(last_in_loop(*b) == last);
+  REQUIRE(last->start().offset == doc.content.find("n = n + 1"));
+  REQUIRE(c->start().offset == doc.content.find("fun c"));
+
+  // Strings are views into the document and follow the shift.
+  auto &body = static_cast<const FunDefItem*>(c)->body();
+  auto assign = static_cast<const BinaryExpr*>(body.exprs()[0].value.get());
+  auto literal = static_cast<const LiteralExpr*>(assign->right());
+  REQUIRE(literal->string_value() == "'two'");
+
+  // Insert a new item between b and c.
+  edit = TextEdit{
+    .offset = doc.content.find("fun c") - 1, .removed = 0,
+    .inserted = "\nw = 3;"
+  };
+  doc.apply(edit);
+  splice = tokens.relex(edit);
+  old = std::move(doc_node);
+  doc_node = Parser{tokens}.reparse_document(*old, splice, edit);
+  REQUIRE(doc_node != nullptr);
+  require_same_items(*doc_node, *Parser{tokens}.parse_document());
+  REQUIRE(doc_node->items().size() == 4);
+  REQUIRE(doc_node->items()[0].get() == a);
+  REQUIRE(doc_node->items()[3].get() == c);
+  // b ends right before the edit, so it is parsed again, but its scopes are
+  // not adjacent to it.
+  b = doc_node->items()[1].get();
+  REQUIRE(first_in_loop(*b) == first);
+  REQUIRE(last_in_loop(*b) == last);
+  REQUIRE(c->start().offset == doc.content.find("fun c"));
+}
+
+TEST_CASE("Lazy fun bodies", "[syntax][parser][item]") {
+  SourceDoc doc{
+    .name = "test",
+    .content =
+      "// lazy\n"
+      "fun a(int n) { loop { n = n - 1; }; { x = '}'; }; }\n"
+      "fun b() { y }\n"
+      "z = 1;\n"
+  };
+  TokenBuffer tokens{doc};
+  auto doc_node = Parser{tokens, Parser::PF_LazyBodies}.parse_document();
+  REQUIRE(doc_node != nullptr);
+  REQUIRE(doc_node->items().size() == 3);
+  auto a = static_cast<FunDefItem*>(doc_node->items()[0].get());
+  auto b = static_cast<FunDefItem*>(doc_node->items()[1].get());
+  REQUIRE(!a->is_body_parsed());
+  REQUIRE(!b->is_body_parsed());
+  REQUIRE(a->end().offset == doc.content.find("\nfun b"));
+  REQUIRE(doc_node->items()[2]->item_kind() == ItemKind::Expr);
+
+  // Moving a skipped body keeps it parseable.
+  TextEdit edit{ .offset = 0, .removed = 0, .inserted = ";" };
+  doc.apply(edit);
+  auto splice = tokens.relex(edit);
+  doc_node = Parser{tokens, Parser::PF_LazyBodies}
+    .reparse_document(*doc_node, splice, edit);
+  REQUIRE(doc_node != nullptr);
+  REQUIRE(doc_node->items()[1].get() == a);
+  REQUIRE(!a->is_body_parsed());
+  b = static_cast<FunDefItem*>(doc_node->items()[2].get());
+
+  REQUIRE(a->body_start().offset == doc.content.find('{'));
+  REQUIRE(Parser{tokens}.expand_body(*a));
+  auto &body = a->body();
+  REQUIRE(a->is_body_parsed());
+  REQUIRE(body.exprs().size() == 2);
+  REQUIRE(body.exprs()[0].value->expr_kind() == ExprKind::Loop);
+  REQUIRE(body.exprs()[1].value->expr_kind() == ExprKind::Scope);
+  REQUIRE(body.start().offset == doc.content.find('{'));
+
+  auto eager = Parser{tokens}.parse_document();
+  REQUIRE(eager == nullptr);
+
+  // A bad body is reported when it is expanded, not when it is skipped.
+  Diagnostics diagnostics;
+  Parser parser{tokens, 0, &diagnostics};
+  REQUIRE_FALSE(parser.expand_bodies(*doc_node));
+  REQUIRE_FALSE(b->is_body_parsed());
+  REQUIRE(diagnostics.error_count() == 1);
+  REQUIRE(diagnostics[0].start == doc.content.find(" }\nz") + 1);
+  REQUIRE(diagnostics[0].found == TkRightBrace);
+}
+
+namespace {
+struct IdentCollector : NodeVisitor {
+  std::vector<std::string_view> idents;
+
+  using NodeVisitor::visit;
+  void visit(const IdentExpr &expr) override {
+    idents.push_back(expr.value());
+  }
+};
+} // anonymous namespace
+
+TEST_CASE("Visiting lazy fun bodies", "[syntax][parser][item]") {
+  SourceDoc doc{
+    .name = "test",
+    .content = "fun a() -> int { x; y; }\nfun b() { z }\n"
+  };
+  TokenBuffer tokens{doc};
+  auto doc_node = Parser{tokens, Parser::PF_LazyBodies}.parse_document();
+  REQUIRE(doc_node != nullptr);
+
+  // Skipped bodies, even invalid ones, are not visited.
+  IdentCollector before;
+  before.visit(*doc_node);
+  REQUIRE(before.idents == std::vector<std::string_view>{"int"});
+
+  auto a = static_cast<FunDefItem*>(doc_node->items()[0].get());
+  REQUIRE(Parser{tokens}.expand_body(*a));
+  IdentCollector after;
+  after.visit(*doc_node);
+  REQUIRE(after.idents == std::vector<std::string_view>{"int", "x", "y"});
+}
+
+TEST_CASE("Lazy fun body missing '}'", "[syntax][parser][item]") {
+  SourceDoc doc{ .name = "test", .content = "fun a() { { x; }" };
+  TokenBuffer tokens{doc};
+  REQUIRE(Parser{tokens, Parser::PF_LazyBodies}.parse_document() == nullptr);
+}
+
+TEST_CASE("Parallel parse", "[syntax][parser]") {
+  std::string content = "// items\n";
+  for (int i = 0; i < 100; ++i) {
+    auto n = std::to_string(i);
+    content += "fun f" + n + "(int a) { loop { a = a - " + n + "; }; }\n";
+    content += "struct S" + n + " { int x; int y; }\n";
+    content += "fun g" + n + "();\n";
+    content += "int v" + n + " = { x; };\n";
+    content += ";\n";
+  }
+  SourceDoc doc{ .name = "test", .content = content };
+  TokenBuffer tokens{doc};
+  lava::ThreadPool pool{3};
+
+  auto doc_node = Parser{tokens}.parse_document(pool, 16);
+  REQUIRE(doc_node != nullptr);
+  REQUIRE(doc_node->items().size() == 500);
+  require_same_items(*doc_node, *Parser{tokens}.parse_document());
+
+  // An error late in the document is reported once the sequential parse
+  // reaches it.
+  doc.content += "fun h() { x }\n";
+  TokenBuffer bad_tokens{doc};
+  REQUIRE(Parser{bad_tokens}.parse_document(pool, 16) == nullptr);
+}
+
+TEST_CASE("Parse errors are collected", "[syntax][parser]") {
+  SourceDoc doc{
+    .name = "test",
+    .content = "fun f() {}\nfun g() { a = 1 b; }",
+  };
+  Lexer lexer{doc};
+  Diagnostics diagnostics;
+  Parser parser{lexer, &diagnostics};
+
+  REQUIRE_FALSE(parser.parse_document());
+  // "missing fun body" at the same token cascades from the first error.
+  REQUIRE(diagnostics.size() == 1);
+  REQUIRE(diagnostics.error_count() == 1);
+  REQUIRE(diagnostics.suppressed() == 1);
+  REQUIRE(diagnostics[0].start == doc.content.find("b;"));
+  REQUIRE(diagnostics[0].end == doc.content.find(";", 20));
+  REQUIRE(diagnostics[0].found == TkIdent);
+
+  std::string out;
+  diagnostics.format(out);
+  REQUIRE(out == "test:2:17: error: missing ';' (found Ident)\n");
+}
+
+TEST_CASE("Only errors inside the last one cascade", "[syntax][parser]") {
+  SourceDoc doc{ .name = "test", .content = "a b c d e f" };
+  Diagnostics diagnostics;
+  REQUIRE(diagnostics.report(Severity::Error, doc, 4, 7, "first"));
+  REQUIRE_FALSE(diagnostics.report(Severity::Error, doc, 4, 5, "same"));
+  REQUIRE_FALSE(diagnostics.report(Severity::Error, doc, 6, 9, "inside"));
+  // Before the last error, such as after backtracking.
+  REQUIRE(diagnostics.report(Severity::Error, doc, 0, 1, "before"));
+  REQUIRE(diagnostics.report(Severity::Error, doc, 8, 9, "after"));
+  // An empty range still suppresses errors at the same place.
+  REQUIRE(diagnostics.report(Severity::Error, doc, 11, 11, "end"));
+  REQUIRE_FALSE(diagnostics.report(Severity::Error, doc, 11, 11, "again"));
+  REQUIRE(diagnostics.error_count() == 4);
+  REQUIRE(diagnostics.suppressed() == 3);
+}
@@ -0,0 +1,176 @@
+#include <catch2/catch_test_macros.hpp>
+#include "lava/lang/query.h"
+#include "lava/lang/parser.h"
+#include "lava/lang/firstpass.h"
+#include "lava/lang/iremit.h"
+#include <string>
+
+using namespace lava::lang;
+
+namespace {
+
+const char *const Source =
+  "fun a(int x) -> int { return x + 1; };\n"
+  "fun b(int x, int y) -> int {\n"
+  "  // sum\n"
+  "  if x > y { return a(x); };\n"
+  "  return y - 1;\n"
+  "};\n"
+  "fun c() -> bool;\n"
+  "fun d(uint8 n) -> uint8 { while n { a(n); }; return n; };\n";
+
+// Runs the one-shot passes over the engine's current text.
+void require_same_as_passes(SymbolTable &symtab, QueryEngine &engine) {
+  Lexer lexer{engine.doc()};
+  Parser parser{lexer};
+  auto docnode = parser.parse_document();
+  REQUIRE(docnode);
+  Namespace scratch{symtab.global_namespace()};
+  FirstPass fp{symtab};
+  fp._current_ns = &scratch;
+  fp.visit(*docnode);
+  IREmitter ire{symtab};
+  ire._current_ns = &scratch;
+  for (auto const &item : docnode->items()) {
+    if (item->item_kind() == ItemKind::FunDef) {
+      ire.visit(static_cast<const FunDefItem&>(*item));
+    }
+  }
+
+  for (auto name : engine.items().names) {
+    auto *expected = lava::dyn_cast<Function>(scratch.get(name));
+    REQUIRE(expected);
+    REQUIRE(engine.signature(name) == expected->type());
+    auto *actual = engine.function_ir(name);
+    if (expected->basicblocks().empty()) {
+      REQUIRE_FALSE(actual);
+      continue;
+    }
+    REQUIRE(actual);
+    REQUIRE(actual->register_count() == expected->register_count());
+    REQUIRE(actual->basicblocks().size() == expected->basicblocks().size());
+    for (size_t i = 0; i < actual->basicblocks().size(); ++i) {
+      REQUIRE(actual->basicblocks()[i].instrs
+              == expected->basicblocks()[i].instrs);
+    }
+  }
+}
+
+void emit_all(QueryEngine &engine) {
+  for (auto name : engine.items().names) {
+    engine.function_ir(name);
+  }
+}
+
+TextEdit replace(const QueryEngine &engine, std::string_view from,
+                 std::string_view to) {
+  return TextEdit{
+    .offset = engine.doc().content.find(from),
+    .removed = from.size(),
+    .inserted = to,
+  };
+}
+
+} // anonymous namespace
+
+TEST_CASE("Queries match the one-shot passes", "[query]") {
+  PointerType::TargetPointerSize = sizeof(size_t);
+  SymbolTable symtab;
+  QueryEngine engine{symtab, "test", Source};
+  REQUIRE(engine.items().names.size() == 4);
+  require_same_as_passes(symtab, engine);
+
+  engine.edit(replace(engine, "return y - 1;", "return y * 2;"));
+  require_same_as_passes(symtab, engine);
+}
+
+TEST_CASE("Editing a body reruns only that function", "[query]") {
+  PointerType::TargetPointerSize = sizeof(size_t);
+  SymbolTable symtab;
+  QueryEngine engine{symtab, "test", Source};
+  emit_all(engine);
+  REQUIRE(engine.executions(QueryKind::Signature) == 4);
+  REQUIRE(engine.executions(QueryKind::FunctionIr) == 4);
+
+  auto a = symtab.intern("a");
+  auto b = symtab.intern("b");
+  auto d = symtab.intern("d");
+  auto *a_ir = engine.function_ir(a);
+  auto *b_ir = engine.function_ir(b);
+  auto *a_type = engine.signature(a);
+
+  // Nothing changed, so nothing reruns.
+  emit_all(engine);
+  REQUIRE(engine.executions(QueryKind::FunctionIr) == 4);
+
+  engine.edit(replace(engine, "return y - 1;", "return y * 2;"));
+  emit_all(engine);
+  REQUIRE(engine.executions(QueryKind::Signature) == 4);
+  REQUIRE(engine.executions(QueryKind::FunctionIr) == 5);
+  REQUIRE(engine.function_ir(a) == a_ir);
+  REQUIRE(engine.signature(a) == a_type);
+  auto *new_b = engine.function_ir(b);
+  REQUIRE(new_b != b_ir);
+  bool has_mul = false;
+  for (auto const &bb : new_b->basicblocks()) {
+    for (auto const &instr : bb.instrs) {
+      has_mul |= instr.op == Op::Mul;
+    }
+  }
+  REQUIRE(has_mul);
+
+  // Comments and whitespace don't change any fingerprint.
+  size_t fingerprints = engine.executions(QueryKind::ItemTokens);
+  engine.edit(replace(engine, "// sum", "// the sum\n "));
+  emit_all(engine);
+  REQUIRE(engine.executions(QueryKind::ItemTokens) == fingerprints + 1);
+  REQUIRE(engine.executions(QueryKind::Signature) == 4);
+  REQUIRE(engine.executions(QueryKind::FunctionIr) == 5);
+  REQUIRE(engine.function_ir(b) == new_b);
+
+  // A new signature reruns that function's signature and IR.
+  engine.edit(replace(engine, "fun d(uint8 n)", "fun d(int8 n)"));
+  emit_all(engine);
+  REQUIRE(engine.executions(QueryKind::Signature) == 5);
+  REQUIRE(engine.executions(QueryKind::FunctionIr) == 6);
+  REQUIRE(engine.signature(d)->arg_types[0].type
+          == &symtab.int_type(1, true));
+  require_same_as_passes(symtab, engine);
+}
+
+TEST_CASE("Items come and go", "[query]") {
+  PointerType::TargetPointerSize = sizeof(size_t);
+  SymbolTable symtab;
+  QueryEngine engine{symtab, "test", Source};
+  emit_all(engine);
+  auto c = symtab.intern("c");
+  auto e = symtab.intern("e");
+  REQUIRE_FALSE(engine.function_ir(c));
+  REQUIRE_FALSE(engine.item(e));
+
+  // Defining a declared function gives it IR; its signature is the same.
+  auto *c_type = engine.signature(c);
+  engine.edit(replace(engine, "fun c() -> bool;",
+                      "fun c() -> bool { return 1 > 0; };"));
+  REQUIRE(engine.function_ir(c));
+  REQUIRE(engine.signature(c) == c_type);
+
+  engine.edit(TextEdit{
+    .offset = engine.doc().content.size(), .removed = 0,
+    .inserted = "fun e() { };\n",
+  });
+  REQUIRE(engine.items().names.size() == 5);
+  REQUIRE(engine.signature(e)->return_type == &symtab.void_type());
+
+  engine.edit(replace(engine, "fun e() { };\n", ""));
+  REQUIRE_FALSE(engine.item(e));
+  REQUIRE_FALSE(engine.signature(e));
+  REQUIRE_FALSE(engine.function_ir(e));
+
+  // A change to the global namespace reruns name resolution, which cuts
+  // off if nothing it found changed.
+  size_t signatures = engine.executions(QueryKind::Signature);
+  engine.scope_changed();
+  emit_all(engine);
+  REQUIRE(engine.executions(QueryKind::Signature) == signatures);
+}
@@ -1,5 +1,6 @@
 #include <catch2/catch_test_macros.hpp>
 #include "lava/lang/symbol.h"
+#include <vector>
 
 using namespace lava::lang;
 
@@ -76,6 +77,93 @@ TEST_CASE("Struct type cache", "[symbol]") {
   REQUIRE(struct_type_1.align == 8);
 }
 
+TEST_CASE("Compact struct layout", "[symbol]") {
+  PointerType::TargetPointerSize = 8;
+  SymbolTable symtab;
+  auto const *i8 = &symtab.int_type(1, true);
+  auto const *i16 = &symtab.int_type(2, true);
+  auto const *i32 = &symtab.int_type(4, true);
+  auto const *i64 = &symtab.int_type(8, true);
+  auto const *f64 = &symtab.float_type(8);
+  auto const *b = &symtab.bool_type();
+  auto const *ptr = &symtab.pointer_type(PointerType{i8});
+  // Not a multiple of its alignment, so it leaves a hole after it.
+  auto const *tail = &symtab.struct_type(StructType{{i64, i8}});
+  REQUIRE(tail->size == 9);
+
+  struct Shape {
+    std::vector<const DataType*> fields;
+    unsigned declared;
+    unsigned compact;
+  };
+  const Shape shapes[] = {
+    {{i8, i64, i8}, 17, 10},
+    {{i8, i32, i16, i64}, 24, 15},
+    {{b, f64, b, i32, i16}, 26, 16},
+    {{b, ptr, i16, ptr, b, i32}, 40, 24},
+    {{tail, i32, i8}, 17, 16},
+    {{i64, i32, i16, i8}, 15, 15},
+    {{i32}, 4, 4},
+  };
+  for (auto const &shape : shapes) {
+    StructType::FieldVector fields;
+    for (auto const *field : shape.fields) {
+      fields.emplace_back(field);
+    }
+    auto const &declared = symtab.struct_type(StructType{fields});
+    auto const &compact = symtab.struct_type(
+      StructType{fields, StructLayout::Compact}
+    );
+    CHECK(declared.size == shape.declared);
+    CHECK(compact.size == shape.compact);
+    REQUIRE(compact.align == declared.align);
+    REQUIRE(&compact != &declared);
+
+    // Fields keep their declaration order and types; `order` walks them
+    // by offset without overlapping.
+    REQUIRE(compact.order.size() == fields.size());
+    unsigned end = 0;
+    for (auto i : compact.order) {
+      auto const &field = compact.fields[i];
+      REQUIRE(field.type == shape.fields[i]);
+      REQUIRE(field.offset >= end);
+      REQUIRE(field.offset % field.type->align == 0);
+      end = field.offset + field.type->size;
+    }
+    REQUIRE(end == compact.size);
+  }
+
+  // Cold fields go after the hot ones, except to fill a hole.
+  StructType::FieldVector fields;
+  fields.emplace_back(symtab.intern("log"), i64, true);
+  fields.emplace_back(symtab.intern("flags"), i8);
+  fields.emplace_back(symtab.intern("debug"), i8, true);
+  fields.emplace_back(symtab.intern("count"), i32);
+  auto const &split = symtab.struct_type(
+    StructType{fields, StructLayout::Compact}
+  );
+  REQUIRE(split.fields[3].offset == 0);
+  REQUIRE(split.fields[1].offset == 4);
+  REQUIRE(split.fields[2].offset == 5);
+  REQUIRE(split.fields[0].offset == 8);
+  REQUIRE(split.size == 16);
+  REQUIRE(split.order == StructType::OrderVector{3, 1, 2, 0});
+
+  // The hint is part of the type.
+  fields[0].cold = false;
+  auto const &unsplit = symtab.struct_type(
+    StructType{fields, StructLayout::Compact}
+  );
+  REQUIRE(&unsplit != &split);
+  REQUIRE(unsplit.fields[0].offset == 0);
+  REQUIRE(unsplit.order == StructType::OrderVector{0, 3, 1, 2});
+
+  // Declared layout ignores it.
+  auto const &declared = symtab.struct_type(StructType{fields});
+  REQUIRE(declared.order == StructType::OrderVector{0, 1, 2, 3});
+  PointerType::TargetPointerSize = sizeof(size_t);
+}
+
 TEST_CASE("Function type cache", "[symbol]") {
   PointerType::TargetPointerSize = sizeof(size_t);
   SymbolTable symtab;
@@ -100,3 +188,126 @@ TEST_CASE("Function type cache", "[symbol]") {
   REQUIRE(fnty1 == fnty2);
   REQUIRE(&fnty1 == &fnty2);
 }
+
+TEST_CASE("Symbol tables share names", "[symbol]") {
+  PointerType::TargetPointerSize = sizeof(size_t);
+  ConcurrentStringInterner strings;
+  SymbolTable a{&strings};
+  SymbolTable b{&strings};
+  REQUIRE(a.intern("name") == b.intern("name"));
+  REQUIRE(b.get_string(a.intern("other")) == "other");
+  REQUIRE(a.global_namespace().get(b.intern("int32")));
+}
+
+TEST_CASE("Scope chain lookups see later changes", "[symbol]") {
+  PointerType::TargetPointerSize = sizeof(size_t);
+  SymbolTable symtab;
+  auto &global = symtab.global_namespace();
+  auto *outer = static_cast<Namespace*>(global.add(
+    std::make_unique<Namespace>(symtab.intern("outer"), global)
+  ));
+  Namespace inner{*outer};
+  auto x = symtab.intern("x");
+  auto *int32 = &symtab.int_type(4, true);
+
+  REQUIRE_FALSE(inner.getrec(x));
+  auto *global_x = global.add(std::make_unique<Variable>(x, int32));
+  REQUIRE(inner.getrec(x) == global_x);
+  REQUIRE(inner.getrec(x) == global_x);
+
+  // A closer declaration shadows the cached one.
+  auto *outer_x = outer->add(std::make_unique<Variable>(x, int32));
+  REQUIRE(inner.getrec(x) == outer_x);
+  REQUIRE(global.getrec(x) == global_x);
+
+  Namespace used{global};
+  auto *used_x = used.add(std::make_unique<Variable>(x, int32));
+  inner.add_using(used);
+  REQUIRE(inner.getrec(x) == used_x);
+
+  SymbolPath path;
+  path.push_back(symtab.intern("outer"));
+  path.push_back(x);
+  REQUIRE(inner.getrec(path) == outer_x);
+  outer->clear();
+  REQUIRE_FALSE(inner.getrec(path));
+}
+
+TEST_CASE("Function scopes don't retire cached lookups", "[symbol]") {
+  PointerType::TargetPointerSize = sizeof(size_t);
+  SymbolTable symtab;
+  auto &global = symtab.global_namespace();
+  Namespace user{global};
+  auto int32 = symtab.intern("int32");
+  auto *int32_alias = global.get(int32);
+  auto const *cache = user.resolution_cache();
+  REQUIRE(cache);
+  REQUIRE(user.getrec(int32) == int32_alias);
+  auto generation = cache->generation();
+
+  // Creating a function adds its args, and emitting it adds locals.
+  FunctionType::ArgVector args;
+  args.emplace_back(symtab.intern("n"), &symtab.int_type(4, true));
+  auto const &type = symtab.function_type(
+    FunctionType{&symtab.void_type(), std::move(args)}
+  );
+  Function fn{symtab.intern("f"), &type, global};
+  fn.locals_namespace().add(std::make_unique<Variable>(
+    symtab.intern("local"), &symtab.bool_type()
+  ));
+  REQUIRE_FALSE(fn.args_namespace().resolution_cache());
+  REQUIRE_FALSE(fn.locals_namespace().resolution_cache());
+  REQUIRE(cache->generation() == generation);
+  Symbol *found = nullptr;
+  REQUIRE(cache->find(&user, int32, found));
+  REQUIRE(found == int32_alias);
+
+  // Lookups from a function scope still see everything above it.
+  REQUIRE(fn.locals_namespace().getrec(symtab.intern("n")));
+  REQUIRE(fn.locals_namespace().getrec(int32) == int32_alias);
+  auto *global_local = global.add(std::make_unique<Variable>(
+    symtab.intern("g"), &symtab.bool_type()
+  ));
+  REQUIRE(cache->generation() != generation);
+  REQUIRE(fn.locals_namespace().getrec(symtab.intern("g")) == global_local);
+}
+
+TEST_CASE("Symbol kind casts", "[symbol]") {
+  PointerType::TargetPointerSize = sizeof(size_t);
+  SymbolTable symtab;
+  const Symbol *int32 = symtab.global_namespace().get(symtab.intern("int32"));
+  REQUIRE(int32->kind() == SymbolKind::TypeAlias);
+  REQUIRE(lava::isa<TypeAlias>(int32));
+  REQUIRE_FALSE(lava::isa<Namespace>(int32));
+  REQUIRE(lava::dyn_cast<TypeAlias>(int32) == int32);
+  REQUIRE_FALSE(lava::dyn_cast<Function>(int32));
+  REQUIRE_FALSE(lava::dyn_cast<Function>(static_cast<Symbol*>(nullptr)));
+
+  auto const *type = lava::cast<TypeAlias>(int32)->type;
+  REQUIRE(lava::isa<DataType>(type));
+  REQUIRE(lava::dyn_cast<DataType>(type)->size == 4);
+  REQUIRE_FALSE(lava::isa<DataType>(symtab.any_type()));
+}
+
+TEST_CASE("Nested types are shared", "[symbol]") {
+  PointerType::TargetPointerSize = sizeof(size_t);
+  SymbolTable symtab;
+  auto make = [&](unsigned length) -> const PointerType & {
+    auto const &array = symtab.array_type(ArrayType{
+      &symtab.pointer_type(PointerType{&symtab.int_type(4, true)}),
+      length
+    });
+    return symtab.pointer_type(PointerType{&array});
+  };
+
+  auto const &a = make(3);
+  auto const &b = make(3);
+  auto const &c = make(4);
+  REQUIRE(&a == &b);
+  REQUIRE(&a != &c);
+  REQUIRE(a.hash() == b.hash());
+  REQUIRE(a.hash() != c.hash());
+  REQUIRE(a.pointed_at != c.pointed_at);
+  REQUIRE(static_cast<const ArrayType*>(a.pointed_at)->element_type
+          == static_cast<const ArrayType*>(c.pointed_at)->element_type);
+}
@@ -0,0 +1,31 @@
+#include <catch2/catch_test_macros.hpp>
+#include "lava/lang/symbol.h"
+
+using namespace lava::lang;
+
+TEST_CASE("Symbol map lookup", "[symbolmap]") {
+  StringInterner strings;
+  std::vector<std::unique_ptr<Variable>> vars;
+  SymbolMap map;
+  REQUIRE_FALSE(map.find(strings.intern("missing")));
+
+  for (int i = 0; i < 10000; ++i) {
+    auto name = strings.intern("v" + std::to_string(i));
+    vars.push_back(std::make_unique<Variable>(name, nullptr));
+    REQUIRE(map.insert(name, vars.back().get()));
+  }
+  REQUIRE(map.size() == 10000);
+  REQUIRE_FALSE(map.insert(vars[5]->name(), vars[6].get()));
+  REQUIRE(map.size() == 10000);
+
+  for (auto const &var : vars) {
+    REQUIRE(map.find(var->name()) == var.get());
+  }
+  REQUIRE_FALSE(map.contains(strings.intern("missing")));
+
+  map.clear();
+  REQUIRE(map.empty());
+  REQUIRE_FALSE(map.find(vars[0]->name()));
+  REQUIRE(map.insert(vars[0]->name(), vars[0].get()));
+  REQUIRE(map.find(vars[0]->name()) == vars[0].get());
+}
@@ -0,0 +1,178 @@
+#include "lava/lava.h"
+#include <catch2/catch_test_macros.hpp>
+#include "lava/lang/tokenbuffer.h"
+#include "lava/lang/lexer.h"
+#include "lava/util/thread_pool.h"
+
+using namespace lava::lang;
+
+TEST_CASE("Token buffer matches lexer", "[syntax][lexer]") {
+  SourceDoc doc{
+    .name = "test",
+    .content = "fun f(int x) { /* c */ x + 1 } // end\n`"
+  };
+  TokenBuffer tokens{doc};
+  Lexer lexer{doc};
+
+  size_t i = 0;
+  while (true) {
+    Token token = lexer.lex();
+    REQUIRE(i < tokens.size());
+    REQUIRE(tokens.kind(i) == token.what);
+    REQUIRE(tokens.start(i) == token.start.offset);
+    REQUIRE(tokens.end(i) == token.end.offset);
+    REQUIRE(tokens.text(i) == token.text());
+    REQUIRE(tokens.is_trivia(i) == (token.what == TkWhitespace
+                                 || token.what == TkLineComment
+                                 || token.what == TkBlockComment));
+    ++i;
+    if (token.what == TkEof) {
+      break;
+    }
+  }
+  REQUIRE(i == tokens.size());
+  REQUIRE(tokens.kind(i - 2) == TkInvalid);
+}
+
+TEST_CASE("Token buffer range", "[syntax][lexer]") {
+  SourceDoc doc{ .name = "test", .content = "a b\nc d" };
+  TokenBuffer tokens{doc, 2, 5};
+
+  REQUIRE(tokens.size() == 4);
+  REQUIRE(tokens.kind(0) == TkIdent);
+  REQUIRE(tokens.text(0) == "b");
+  REQUIRE(tokens.is_trivia(1));
+  REQUIRE(tokens.text(2) == "c");
+  REQUIRE(tokens.kind(3) == TkEof);
+  REQUIRE(tokens.start(3) == 5);
+
+  Token token = tokens.token(2);
+  REQUIRE_FALSE(token.start.is_resolved());
+  REQUIRE(doc.resolve(token.start).line == 2);
+}
+
+namespace {
+
+void require_same_tokens(const TokenBuffer &a, const TokenBuffer &b) {
+  REQUIRE(a.size() == b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    REQUIRE(a.kind(i) == b.kind(i));
+    REQUIRE(a.is_trivia(i) == b.is_trivia(i));
+    REQUIRE(a.start(i) == b.start(i));
+    REQUIRE(a.length(i) == b.length(i));
+  }
+}
+
+} // anonymous namespace
+
+TEST_CASE("Relex small edit", "[syntax][lexer]") {
+  SourceDoc doc{ .name = "test", .content = "a = b + c;\nd = e;\n" };
+  TokenBuffer tokens{doc};
+
+  TextEdit edit{ .offset = 4, .removed = 1, .inserted = "bee" };
+  doc.apply(edit);
+  auto splice = tokens.relex(edit);
+  require_same_tokens(tokens, TokenBuffer{doc});
+  // Only the tokens near the edit are relexed.
+  REQUIRE(splice.removed <= 3);
+  REQUIRE(splice.inserted == splice.removed);
+  REQUIRE(tokens.text(splice.first + splice.inserted - 1) == "bee");
+}
+
+TEST_CASE("Relex opening a block comment", "[syntax][lexer]") {
+  SourceDoc doc{
+    .name = "test",
+    .content = "x; 'a' y; z */ w 'b'"
+  };
+  TokenBuffer tokens{doc};
+
+  TextEdit edit{ .offset = 2, .removed = 0, .inserted = "/*" };
+  doc.apply(edit);
+  tokens.relex(edit);
+  require_same_tokens(tokens, TokenBuffer{doc});
+  REQUIRE(tokens.kind(2) == TkBlockComment);
+  REQUIRE(tokens.text(2) == "/* 'a' y; z */");
+
+  edit = TextEdit{ .offset = 2, .removed = 2, .inserted = "" };
+  doc.apply(edit);
+  tokens.relex(edit);
+  require_same_tokens(tokens, TokenBuffer{doc});
+}
+
+TEST_CASE("Relex random edits", "[syntax][lexer]") {
+  static const char *const pieces[] = {
+    " ", "\n", "a", "_b1", "0x", "0b1", "1.5", ".", "..", "<", "-", "<-<=",
+    "/", "*", "/*", "*/", "//", "'", "\"", "fun", "if", "{", "}", ";", "`",
+  };
+  constexpr size_t piece_count = sizeof(pieces) / sizeof(pieces[0]);
+
+  SourceDoc doc{
+    .name = "test",
+    .content = "fun f(int a) { /* c */ if a < 0x1f { 'str' } }\n// end\n"
+  };
+  TokenBuffer tokens{doc};
+  doc.resolve(SourceLoc{});
+
+  // A small LCG keeps the sequence the same on every platform.
+  uint32_t seed = 12345;
+  auto next = [&](uint32_t bound) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % bound;
+  };
+
+  for (int i = 0; i < 500; ++i) {
+    size_t offset = next((uint32_t)doc.content.size() + 1);
+    size_t removed = next(4);
+    removed = std::min(removed, doc.content.size() - offset);
+    std::string inserted;
+    for (uint32_t n = next(3); n > 0; --n) {
+      inserted += pieces[next(piece_count)];
+    }
+
+    TextEdit edit{ offset, removed, inserted };
+    doc.apply(edit);
+    tokens.relex(edit);
+    require_same_tokens(tokens, TokenBuffer{doc});
+
+    SourceDoc fresh{ .name = "test", .content = doc.content };
+    fresh.resolve(SourceLoc{});
+    REQUIRE(doc.line_starts == fresh.line_starts);
+  }
+}
+
+TEST_CASE("Parallel lexing", "[syntax][lexer]") {
+  // Block comments, strings and whitespace runs that cross line starts put
+  // some chunks in the wrong starting state.
+  static const char *const lines[] = {
+    "fun f(int a) { return a + 0x1f; }\n",
+    "/* a comment\n",
+    "fun g() {} */ x = 1;\n",
+    "'a string\n",
+    "that continues' y;\n",
+    "  indented; // trailing\n",
+    "\n",
+    "\n    \n",
+    "z <-<= w; 1.5 .. 0b\n",
+  };
+
+  std::string content;
+  uint32_t seed = 1;
+  for (int i = 0; i < 2000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    content += lines[(seed >> 16) % LAVA_ARRAYLEN(lines)];
+  }
+  SourceDoc doc{ .name = "test", .content = content };
+  TokenBuffer expected{doc};
+
+  for (unsigned threads : {0u, 3u}) {
+    lava::ThreadPool pool{threads};
+    for (size_t chunk_size : {1, 7, 100, 4096, 1 << 20}) {
+      require_same_tokens(TokenBuffer{doc, pool, chunk_size}, expected);
+    }
+  }
+
+  // An unterminated comment swallows every later chunk.
+  doc.content = "x; /*" + content;
+  lava::ThreadPool pool{2};
+  require_same_tokens(TokenBuffer{doc, pool, 64}, TokenBuffer{doc});
+}
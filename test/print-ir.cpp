@@ -39,20 +39,22 @@ int main(int argc, char *argv[]) {
   };
 
   Lexer lexer{doc};
-  Parser parser{lexer};
+  Diagnostics diagnostics;
+  Parser parser{lexer, &diagnostics};
 
   auto document = parser.parse_document();
+  diagnostics.print(stderr);
 
   PointerType::TargetPointerSize = sizeof(size_t);
   SymbolTable symtab;
   FirstPass fp{symtab};
-  fp.NodeVisitor::visit(*document);
+  fp.visit(*document);
   IREmitter ire{symtab};
-  ire.NodeVisitor::visit(*document);
+  ire.visit(*document);
 
   for (size_t i = 0; i < symtab.global_namespace().size(); ++i) {
     auto sym = symtab.global_namespace()[i];
-    if (auto fn = dynamic_cast<Function*>(sym)) {
+    if (auto fn = lava::dyn_cast<Function>(sym)) {
       fmt::print("function {}:\n", symtab.get_string(fn->name()));
       for (size_t j = 0; j < fn->basicblocks().size(); ++j) {
         fmt::print("#{}:\n", j);
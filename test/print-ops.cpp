@@ -171,9 +171,11 @@ int main(int argc, char *argv[]) {
   };
 
   Lexer lexer{doc};
-  Parser parser{lexer};
+  Diagnostics diagnostics;
+  Parser parser{lexer, &diagnostics};
 
   auto document = parser.parse_document();
+  diagnostics.print(stderr);
   Printer printer;
   printer.NodeVisitor::visit(*document);
 }
@@ -0,0 +1,33 @@
+#ifndef LAVA_TEST_TEMPPATH_H_
+#define LAVA_TEST_TEMPPATH_H_
+
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <string_view>
+
+namespace lava::test {
+
+// A path under the system temp directory that starts with `name` and is
+// unique to this process and call, so concurrent test runs don't share
+// files. Nothing is created there.
+inline std::filesystem::path unique_temp_path(std::string_view name) {
+  static const uint64_t run = [] {
+    std::random_device device;
+    return (uint64_t)device() << 32 | device();
+  }();
+  static std::atomic<unsigned> counter{0};
+
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), "-%016llx-%u",
+                (unsigned long long)run, counter++);
+  return std::filesystem::temp_directory_path()
+    / (std::string{name} + suffix);
+}
+
+} // namespace lava::test
+
+#endif /* LAVA_TEST_TEMPPATH_H_ */